@@ -0,0 +1,1059 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 David Antliff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Simple throughput benchmarks. Run all with:
+//
+//     $ ./bench_datastore
+//
+// or a single benchmark by name:
+//
+//     $ ./bench_datastore stores_per_thread
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "datastore.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const uint32_t ITERATIONS = 200000;
+
+double elapsed_s(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void report(const char * name, const char * variant, uint64_t ops, double seconds)
+{
+    printf("%-24s %-40s %12.0f ops/s %10.1f ns/op\n", name, variant, ops / seconds, seconds * 1e9 / ops);
+}
+
+unsigned max_threads()
+{
+    unsigned n = std::thread::hardware_concurrency();
+    return n < 8 ? 8 : n;
+}
+
+// N independent datastores, each driven by its own thread. With a lock per datastore,
+// throughput should scale with the number of cores.
+void bench_stores_per_thread()
+{
+    for (unsigned num_threads = 1; num_threads <= max_threads(); num_threads *= 2)
+    {
+        std::vector<datastore_t *> stores(num_threads);
+        for (auto & ds : stores)
+        {
+            ds = datastore_create();
+            datastore_add_resource(ds, 0, datastore_create_resource(DATASTORE_TYPE_UINT32, 1));
+        }
+
+        auto start = Clock::now();
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < num_threads; ++t)
+        {
+            threads.emplace_back([&stores, t]() {
+                uint32_t value = 0;
+                for (uint32_t i = 0; i < ITERATIONS; ++i)
+                {
+                    datastore_set_uint32(stores[t], 0, 0, i);
+                    datastore_get_uint32(stores[t], 0, 0, &value);
+                }
+            });
+        }
+        for (auto & thread : threads)
+        {
+            thread.join();
+        }
+        double seconds = elapsed_s(start);
+
+        char variant[32];
+        snprintf(variant, sizeof(variant), "%u stores, %u threads", num_threads, num_threads);
+        report("stores_per_thread", variant, 2ull * ITERATIONS * num_threads, seconds);
+
+        for (auto & ds : stores)
+        {
+            datastore_free(&ds);
+        }
+    }
+}
+
+// N reader threads on a single datastore. Readers take the lock in shared mode, so
+// read throughput should scale with the number of cores.
+void bench_shared_readers()
+{
+    datastore_t * ds = datastore_create();
+    datastore_add_resource(ds, 0, datastore_create_resource(DATASTORE_TYPE_UINT32, 16));
+
+    for (unsigned num_threads = 1; num_threads <= max_threads(); num_threads *= 2)
+    {
+        auto start = Clock::now();
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < num_threads; ++t)
+        {
+            threads.emplace_back([ds, t]() {
+                uint32_t value = 0;
+                for (uint32_t i = 0; i < ITERATIONS; ++i)
+                {
+                    datastore_get_uint32(ds, 0, (i + t) % 16, &value);
+                }
+            });
+        }
+        for (auto & thread : threads)
+        {
+            thread.join();
+        }
+        double seconds = elapsed_s(start);
+
+        char variant[32];
+        snprintf(variant, sizeof(variant), "%u readers", num_threads);
+        report("shared_readers", variant, 1ull * ITERATIONS * num_threads, seconds);
+    }
+
+    datastore_free(&ds);
+}
+
+// Rate of one writer while readers hold the lock shared back to back - a reader-preferring lock lets them starve it
+void bench_writer_under_readers()
+{
+    datastore_t * ds = datastore_create();
+    datastore_add_resource(ds, 0, datastore_create_resource(DATASTORE_TYPE_UINT32, 16));
+
+    const uint32_t WRITES = 2000;
+    unsigned num_readers = max_threads() > 1 ? max_threads() - 1 : 1;
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> readers;
+    for (unsigned t = 0; t < num_readers; ++t)
+    {
+        readers.emplace_back([ds, t, &stop]() {
+            uint32_t value = 0;
+            for (uint32_t i = 0; !stop.load(std::memory_order_relaxed); ++i)
+            {
+                datastore_get_uint32(ds, 0, (i + t) % 16, &value);
+            }
+        });
+    }
+
+    auto start = Clock::now();
+    for (uint32_t i = 0; i < WRITES; ++i)
+    {
+        datastore_set_uint32(ds, 0, i % 16, i);
+    }
+    double seconds = elapsed_s(start);
+    stop = true;
+    for (auto & thread : readers)
+    {
+        thread.join();
+    }
+
+    char variant[32];
+    snprintf(variant, sizeof(variant), "%u readers", num_readers);
+    report("writer_under_readers", variant, WRITES, seconds);
+
+    datastore_free(&ds);
+}
+
+// Readers of a scalar resource with and without lock-free (seqlock) reads, while one
+// writer updates a neighbouring instance.
+void bench_lock_free_reads()
+{
+    const uint32_t flags[] = { 0, DATASTORE_RESOURCE_FLAG_LOCK_FREE_READS };
+    const char * names[] = { "shared lock", "lock-free" };
+    for (unsigned f = 0; f < 2; ++f)
+    {
+        for (unsigned num_threads = 1; num_threads <= max_threads(); num_threads *= 2)
+        {
+            datastore_t * ds = datastore_create();
+            datastore_resource_t resource = datastore_create_resource(DATASTORE_TYPE_UINT32, 2);
+            resource.flags = flags[f];
+            datastore_add_resource(ds, 0, resource);
+
+            std::atomic<bool> done(false);
+            std::thread writer([ds, &done]() {
+                for (uint32_t i = 0; !done; ++i)
+                {
+                    datastore_set_uint32(ds, 0, 1, i);
+                    std::this_thread::yield();
+                }
+            });
+
+            auto start = Clock::now();
+            std::vector<std::thread> threads;
+            for (unsigned t = 0; t < num_threads; ++t)
+            {
+                threads.emplace_back([ds]() {
+                    uint32_t value = 0;
+                    for (uint32_t i = 0; i < ITERATIONS; ++i)
+                    {
+                        datastore_get_uint32(ds, 0, 0, &value);
+                    }
+                });
+            }
+            for (auto & thread : threads)
+            {
+                thread.join();
+            }
+            double seconds = elapsed_s(start);
+            done = true;
+            writer.join();
+
+            char variant[32];
+            snprintf(variant, sizeof(variant), "%s, %u readers", names[f], num_threads);
+            report("lock_free_reads", variant, 1ull * ITERATIONS * num_threads, seconds);
+
+            datastore_free(&ds);
+        }
+    }
+}
+
+// Concurrent counters: read-modify-write under the lock versus hardware atomic add.
+void bench_increment()
+{
+    const uint32_t flags[] = { 0, DATASTORE_RESOURCE_FLAG_ATOMIC };
+    const char * names[] = { "locked", "atomic" };
+    for (unsigned f = 0; f < 2; ++f)
+    {
+        for (unsigned num_threads = 1; num_threads <= max_threads(); num_threads *= 2)
+        {
+            datastore_t * ds = datastore_create();
+            datastore_resource_t resource = datastore_create_resource(DATASTORE_TYPE_UINT32, 1);
+            resource.flags = flags[f];
+            datastore_add_resource(ds, 0, resource);
+
+            auto start = Clock::now();
+            std::vector<std::thread> threads;
+            for (unsigned t = 0; t < num_threads; ++t)
+            {
+                threads.emplace_back([ds]() {
+                    for (uint32_t i = 0; i < ITERATIONS; ++i)
+                    {
+                        datastore_increment(ds, 0, 0);
+                    }
+                });
+            }
+            for (auto & thread : threads)
+            {
+                thread.join();
+            }
+            double seconds = elapsed_s(start);
+
+            char variant[32];
+            snprintf(variant, sizeof(variant), "%s, %u threads", names[f], num_threads);
+            report("increment", variant, 1ull * ITERATIONS * num_threads, seconds);
+
+            datastore_free(&ds);
+        }
+    }
+}
+
+// Resolve names to IDs in a datastore with 10k named resources: hash index versus a
+// linear scan of datastore_get_name(), which is what callers had to do before.
+void bench_find_by_name()
+{
+    const int NUM_RESOURCES = 10000;
+    const uint32_t LOOKUPS = 20000;
+    datastore_t * ds = datastore_create();
+    std::vector<std::string> names;
+    for (int i = 0; i < NUM_RESOURCES; ++i)
+    {
+        names.push_back("sensor/" + std::to_string(i) + "/temperature");
+        datastore_add_resource(ds, i, datastore_create_resource(DATASTORE_TYPE_FLOAT, 1));
+        datastore_set_name(ds, i, names.back().c_str());
+    }
+
+    uint64_t found = 0;
+    auto start = Clock::now();
+    for (uint32_t i = 0; i < LOOKUPS; ++i)
+    {
+        datastore_resource_id_t id = -1;
+        datastore_find_by_name(ds, names[(i * 7919) % NUM_RESOURCES].c_str(), &id);
+        found += id;
+    }
+    report("find_by_name", "hash index, 10k names", LOOKUPS, elapsed_s(start));
+
+    const uint32_t SCANS = LOOKUPS / 100;
+    start = Clock::now();
+    for (uint32_t i = 0; i < SCANS; ++i)
+    {
+        const char * name = names[(i * 7919) % NUM_RESOURCES].c_str();
+        for (datastore_resource_id_t id = 0; id < NUM_RESOURCES; ++id)
+        {
+            if (strcmp(datastore_get_name(ds, id), name) == 0)
+            {
+                found += id;
+                break;
+            }
+        }
+    }
+    report("find_by_name", "linear scan, 10k names", SCANS, elapsed_s(start));
+
+    datastore_free(&ds);
+}
+
+// One ingest "tick" of 256 values: individual datastore_set_uint32() calls versus a single
+// datastore_set_batch().
+void bench_set_batch()
+{
+    const int NUM_VALUES = 256;
+    const uint32_t TICKS = ITERATIONS / NUM_VALUES;
+    datastore_t * ds = datastore_create();
+    for (int i = 0; i < NUM_VALUES; ++i)
+    {
+        datastore_add_resource(ds, i, datastore_create_resource(DATASTORE_TYPE_UINT32, 1));
+    }
+
+    std::vector<uint32_t> values(NUM_VALUES);
+    auto start = Clock::now();
+    for (uint32_t tick = 0; tick < TICKS; ++tick)
+    {
+        for (int i = 0; i < NUM_VALUES; ++i)
+        {
+            values[i] = tick + i;
+            datastore_set_uint32(ds, i, 0, values[i]);
+        }
+    }
+    report("set_batch", "individual sets, 256 values", 1ull * TICKS * NUM_VALUES, elapsed_s(start));
+
+    std::vector<datastore_write_t> writes(NUM_VALUES);
+    for (int i = 0; i < NUM_VALUES; ++i)
+    {
+        writes[i] = { i, 0, DATASTORE_TYPE_UINT32, &values[i], sizeof(values[i]) };
+    }
+    start = Clock::now();
+    for (uint32_t tick = 0; tick < TICKS; ++tick)
+    {
+        for (int i = 0; i < NUM_VALUES; ++i)
+        {
+            values[i] = tick + i;
+        }
+        datastore_set_batch(ds, writes.data(), writes.size());
+    }
+    report("set_batch", "one batch, 256 values", 1ull * TICKS * NUM_VALUES, elapsed_s(start));
+
+    datastore_free(&ds);
+}
+
+// Build a 32-field status frame: individual datastore_get_uint32() calls versus a single
+// datastore_get_batch(), while another thread keeps writing.
+void bench_get_batch()
+{
+    const int NUM_FIELDS = 32;
+    const uint32_t FRAMES = ITERATIONS / NUM_FIELDS;
+    datastore_t * ds = datastore_create();
+    for (int i = 0; i < NUM_FIELDS; ++i)
+    {
+        datastore_add_resource(ds, i, datastore_create_resource(DATASTORE_TYPE_UINT32, 1));
+    }
+
+    std::atomic<bool> done(false);
+    std::thread writer([ds, &done]() {
+        for (uint32_t i = 0; !done; ++i)
+        {
+            datastore_set_uint32(ds, i % NUM_FIELDS, 0, i);
+            std::this_thread::yield();
+        }
+    });
+
+    std::vector<uint32_t> frame(NUM_FIELDS);
+    auto start = Clock::now();
+    for (uint32_t f = 0; f < FRAMES; ++f)
+    {
+        for (int i = 0; i < NUM_FIELDS; ++i)
+        {
+            datastore_get_uint32(ds, i, 0, &frame[i]);
+        }
+    }
+    report("get_batch", "individual gets, 32 fields", 1ull * FRAMES * NUM_FIELDS, elapsed_s(start));
+
+    std::vector<datastore_read_t> reads(NUM_FIELDS);
+    for (int i = 0; i < NUM_FIELDS; ++i)
+    {
+        reads[i] = { i, 0, DATASTORE_TYPE_UINT32, &frame[i], sizeof(frame[i]) };
+    }
+    start = Clock::now();
+    for (uint32_t f = 0; f < FRAMES; ++f)
+    {
+        datastore_get_batch(ds, reads.data(), reads.size());
+    }
+    report("get_batch", "one batch, 32 fields", 1ull * FRAMES * NUM_FIELDS, elapsed_s(start));
+
+    done = true;
+    writer.join();
+    datastore_free(&ds);
+}
+
+// Copy a 4096-instance table out and back in: per-instance get/set versus one range copy.
+void bench_range()
+{
+    const uint32_t NUM_INSTANCES = 4096;
+    const uint32_t TABLES = ITERATIONS / NUM_INSTANCES;
+    datastore_t * ds = datastore_create();
+    datastore_add_resource(ds, 0, datastore_create_resource(DATASTORE_TYPE_UINT32, NUM_INSTANCES));
+    std::vector<uint32_t> table(NUM_INSTANCES);
+
+    auto start = Clock::now();
+    for (uint32_t t = 0; t < TABLES; ++t)
+    {
+        for (uint32_t i = 0; i < NUM_INSTANCES; ++i)
+        {
+            datastore_get_uint32(ds, 0, i, &table[i]);
+        }
+        for (uint32_t i = 0; i < NUM_INSTANCES; ++i)
+        {
+            datastore_set_uint32(ds, 0, i, table[i] + 1);
+        }
+    }
+    report("range", "per instance, 4096 instances", 2ull * TABLES * NUM_INSTANCES, elapsed_s(start));
+
+    start = Clock::now();
+    for (uint32_t t = 0; t < TABLES; ++t)
+    {
+        datastore_get_range(ds, 0, DATASTORE_TYPE_UINT32, 0, NUM_INSTANCES, table.data(), table.size() * sizeof(uint32_t));
+        for (uint32_t i = 0; i < NUM_INSTANCES; ++i)
+        {
+            table[i] += 1;
+        }
+        datastore_set_range(ds, 0, DATASTORE_TYPE_UINT32, 0, NUM_INSTANCES, table.data(), table.size() * sizeof(uint32_t));
+    }
+    report("range", "range copy, 4096 instances", 2ull * TABLES * NUM_INSTANCES, elapsed_s(start));
+
+    datastore_free(&ds);
+}
+
+void count_callback(const datastore_t *, datastore_resource_id_t, datastore_instance_id_t, void * context)
+{
+    ++*static_cast<uint64_t *>(context);
+}
+
+// A poller rewriting an unchanging value to a resource with 8 subscribers, with and without
+// suppression of unchanged writes.
+void bench_suppress_unchanged()
+{
+    const uint32_t flags[] = { 0, DATASTORE_RESOURCE_FLAG_SUPPRESS_UNCHANGED };
+    const char * names[] = { "every write notifies", "unchanged suppressed" };
+    for (unsigned f = 0; f < 2; ++f)
+    {
+        datastore_t * ds = datastore_create();
+        datastore_resource_t resource = datastore_create_resource(DATASTORE_TYPE_FLOAT, 1);
+        resource.flags = flags[f];
+        datastore_add_resource(ds, 0, resource);
+        uint64_t calls = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+            datastore_add_set_callback(ds, 0, 0, count_callback, &calls);
+        }
+
+        auto start = Clock::now();
+        for (uint32_t i = 0; i < ITERATIONS; ++i)
+        {
+            datastore_set_float(ds, 0, 0, 21.5f);
+        }
+        double seconds = elapsed_s(start);
+
+        char variant[48];
+        snprintf(variant, sizeof(variant), "%s, 8 subscribers", names[f]);
+        report("suppress_unchanged", variant, ITERATIONS, seconds);
+
+        datastore_free(&ds);
+    }
+}
+
+void slow_callback(const datastore_t *, datastore_resource_id_t, datastore_instance_id_t, void *)
+{
+    // stands in for logging or a network publish
+    auto until = Clock::now() + std::chrono::microseconds(5);
+    while (Clock::now() < until)
+    {
+    }
+}
+
+// Producer throughput with a slow subscriber: callbacks on the writer's thread versus the notifier
+// with each backpressure policy. With "block", the producer is limited by the subscriber once the
+// queue fills; the other policies shed or merge notifications instead.
+void bench_notifier()
+{
+    const uint32_t WRITES = ITERATIONS / 10;
+    const char * names[] = { "synchronous", "block", "drop oldest", "coalesce" };
+    for (int mode = 0; mode < 4; ++mode)
+    {
+        datastore_t * ds = datastore_create();
+        datastore_add_resource(ds, 0, datastore_create_resource(DATASTORE_TYPE_UINT32, 16));
+        for (int i = 0; i < 16; ++i)
+        {
+            datastore_add_set_callback(ds, 0, i, slow_callback, NULL);
+        }
+        if (mode > 0)
+        {
+            datastore_notifier_config_t config = { 1024, 2, (datastore_backpressure_t)(mode - 1) };
+            datastore_start_notifier(ds, &config);
+        }
+
+        auto start = Clock::now();
+        for (uint32_t i = 0; i < WRITES; ++i)
+        {
+            datastore_set_uint32(ds, 0, i % 16, i);
+        }
+        double seconds = elapsed_s(start);
+
+        datastore_flush_notifier(ds);
+        datastore_stats_t stats;
+        datastore_get_stats(ds, &stats);
+        char variant[64];
+        snprintf(variant, sizeof(variant), "%s, %llu dropped, %llu merged", names[mode],
+                 (unsigned long long)stats.notifications_dropped, (unsigned long long)stats.notifications_coalesced);
+        report("notifier", variant, WRITES, seconds);
+
+        datastore_free(&ds);
+    }
+}
+
+void reading_callback(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, void * context)
+{
+    uint32_t value = 0;
+    datastore_get_uint32(datastore, id, instance, &value);
+    *static_cast<uint64_t *>(context) += value;
+    slow_callback(datastore, id, instance, context);
+}
+
+// Bursts of 100 sets per instance, with a subscriber that re-reads the latest value: a callback
+// per set versus coalesced callbacks dispatched once per burst.
+void bench_coalesce()
+{
+    const int NUM_INSTANCES = 16;
+    const uint32_t BURST = 100;
+    const uint32_t BURSTS = ITERATIONS / 10 / BURST / NUM_INSTANCES;
+    const uint32_t flags[] = { 0, DATASTORE_CALLBACK_FLAG_COALESCE };
+    const char * names[] = { "callback per set", "coalesced per burst" };
+    for (int f = 0; f < 2; ++f)
+    {
+        datastore_t * ds = datastore_create();
+        datastore_add_resource(ds, 0, datastore_create_resource(DATASTORE_TYPE_UINT32, NUM_INSTANCES));
+        uint64_t sum = 0;
+        for (int i = 0; i < NUM_INSTANCES; ++i)
+        {
+            datastore_add_set_callback_ex(ds, 0, i, reading_callback, &sum, flags[f]);
+        }
+
+        auto start = Clock::now();
+        for (uint32_t b = 0; b < BURSTS; ++b)
+        {
+            for (uint32_t n = 0; n < BURST; ++n)
+            {
+                for (int i = 0; i < NUM_INSTANCES; ++i)
+                {
+                    datastore_set_uint32(ds, 0, i, n);
+                }
+            }
+            datastore_dispatch_pending(ds);
+        }
+        report("coalesce", names[f], 1ull * BURSTS * BURST * NUM_INSTANCES, elapsed_s(start));
+
+        datastore_free(&ds);
+    }
+}
+
+void counting_callback(const datastore_t *, datastore_resource_id_t, datastore_instance_id_t, void * context)
+{
+    ++*static_cast<uint64_t *>(context);
+}
+
+// Synchronous dispatch cost per set, spread over enough instances that their callback lists do not
+// all stay in cache, with 1, 4 and 32 trivial subscribers per instance.
+void bench_callbacks()
+{
+    const int NUM_INSTANCES = 1024;
+    const int subscribers[] = { 0, 1, 4, 32 };
+    for (int s = 0; s < 4; ++s)
+    {
+        datastore_t * ds = datastore_create();
+        datastore_add_resource(ds, 0, datastore_create_resource(DATASTORE_TYPE_UINT32, NUM_INSTANCES));
+        uint64_t calls = 0;
+        for (int n = 0; n < subscribers[s]; ++n)
+        {
+            for (int i = 0; i < NUM_INSTANCES; ++i)
+            {
+                datastore_add_set_callback(ds, 0, i, counting_callback, &calls);
+            }
+        }
+
+        auto start = Clock::now();
+        for (uint32_t i = 0; i < ITERATIONS; ++i)
+        {
+            // stride through the instances so consecutive sets touch different lists
+            datastore_set_uint32(ds, 0, (i * 97) % NUM_INSTANCES, i);
+        }
+        char variant[64];
+        snprintf(variant, sizeof(variant), "%d subscribers", subscribers[s]);
+        report("callbacks", variant, ITERATIONS, elapsed_s(start));
+
+        datastore_free(&ds);
+    }
+
+    // one registration covering every instance
+    datastore_t * ds = datastore_create();
+    datastore_add_resource(ds, 0, datastore_create_resource(DATASTORE_TYPE_UINT32, NUM_INSTANCES));
+    uint64_t calls = 0;
+    datastore_add_set_callback(ds, 0, DATASTORE_INSTANCE_ALL, counting_callback, &calls);
+    auto start = Clock::now();
+    for (uint32_t i = 0; i < ITERATIONS; ++i)
+    {
+        datastore_set_uint32(ds, 0, (i * 97) % NUM_INSTANCES, i);
+    }
+    report("callbacks", "1 resource-wide subscriber", ITERATIONS, elapsed_s(start));
+    datastore_free(&ds);
+}
+
+// A large batch to a subscribed resource, where finding each changed instance's last write must stay linear
+void bench_set_batch_subscribed()
+{
+    const uint32_t NUM_VALUES = 16384;
+    const uint32_t TICKS = 20;
+    datastore_t * ds = datastore_create();
+    datastore_add_fixed_length_resource(ds, 0, DATASTORE_TYPE_UINT32, NUM_VALUES);
+    uint64_t calls = 0;
+    datastore_add_set_callback(ds, 0, DATASTORE_INSTANCE_ALL, counting_callback, &calls);
+
+    std::vector<uint32_t> values(NUM_VALUES);
+    std::vector<datastore_write_t> writes(NUM_VALUES);
+    for (uint32_t i = 0; i < NUM_VALUES; ++i)
+    {
+        writes[i] = { 0, (datastore_instance_id_t)i, DATASTORE_TYPE_UINT32, &values[i], sizeof(values[i]) };
+    }
+    auto start = Clock::now();
+    for (uint32_t tick = 0; tick < TICKS; ++tick)
+    {
+        for (uint32_t i = 0; i < NUM_VALUES; ++i)
+        {
+            values[i] = tick + i;
+        }
+        datastore_set_batch(ds, writes.data(), writes.size());
+    }
+    report("set_batch_subscribed", "one batch, 16384 values", 1ull * TICKS * NUM_VALUES, elapsed_s(start));
+
+    datastore_free(&ds);
+}
+
+// Set throughput with each clock source, and with timestamps turned off for the resource.
+void bench_clock()
+{
+    const char * names[] = { "monotonic", "coarse", "no timestamp" };
+    for (int mode = 0; mode < 3; ++mode)
+    {
+        datastore_t * ds = datastore_create();
+        datastore_resource_t resource = datastore_create_resource(DATASTORE_TYPE_UINT32, 16);
+        if (mode == 1)
+        {
+            datastore_set_clock(ds, DATASTORE_CLOCK_COARSE);
+        }
+        else if (mode == 2)
+        {
+            resource.flags = DATASTORE_RESOURCE_FLAG_NO_TIMESTAMP;
+        }
+        datastore_add_resource(ds, 0, resource);
+
+        auto start = Clock::now();
+        for (uint32_t i = 0; i < ITERATIONS; ++i)
+        {
+            datastore_set_uint32(ds, 0, i % 16, i);
+        }
+        report("clock", names[mode], ITERATIONS, elapsed_s(start));
+
+        datastore_free(&ds);
+    }
+}
+
+// A watchdog pass over every instance: datastore_get_age() per instance versus one datastore_find_stale().
+void bench_find_stale()
+{
+    const int NUM_RESOURCES = 16;
+    const int NUM_INSTANCES = 1024;
+    const uint32_t PASSES = 20;
+    datastore_t * ds = datastore_create();
+    for (int r = 0; r < NUM_RESOURCES; ++r)
+    {
+        datastore_add_resource(ds, r, datastore_create_resource(DATASTORE_TYPE_UINT32, NUM_INSTANCES));
+        for (int i = 0; i < NUM_INSTANCES; ++i)
+        {
+            datastore_set_uint32(ds, r, i, i);
+        }
+    }
+
+    size_t found = 0;
+    auto start = Clock::now();
+    for (uint32_t p = 0; p < PASSES; ++p)
+    {
+        for (int r = 0; r < NUM_RESOURCES; ++r)
+        {
+            for (int i = 0; i < NUM_INSTANCES; ++i)
+            {
+                datastore_age_t age_us = 0;
+                datastore_get_age(ds, r, i, &age_us);
+                found += age_us > 1000000;
+            }
+        }
+    }
+    report("find_stale", "get_age per instance", 1ull * PASSES * NUM_RESOURCES * NUM_INSTANCES, elapsed_s(start));
+
+    start = Clock::now();
+    for (uint32_t p = 0; p < PASSES; ++p)
+    {
+        size_t num_stale = 0;
+        datastore_find_stale(ds, 1000000, NULL, 0, &num_stale);
+        found += num_stale;
+    }
+    report("find_stale", "one scan", 1ull * PASSES * NUM_RESOURCES * NUM_INSTANCES, elapsed_s(start));
+
+    datastore_free(&ds);
+}
+
+void stale_counting_callback(const datastore_t *, datastore_resource_id_t, datastore_instance_id_t, void * context)
+{
+    static_cast<std::atomic<uint64_t> *>(context)->fetch_add(1, std::memory_order_relaxed);
+}
+
+// Write cost of watching 100k instances with a TTL, and how quickly the expiry thread reports them all stale.
+void bench_ttl()
+{
+    const int NUM_INSTANCES = 100000;
+    for (int watched = 0; watched < 2; ++watched)
+    {
+        datastore_t * ds = datastore_create();
+        datastore_add_resource(ds, 0, datastore_create_resource(DATASTORE_TYPE_UINT32, NUM_INSTANCES));
+        std::atomic<uint64_t> stale(0);
+        if (watched)
+        {
+            datastore_set_ttl(ds, 0, 3600000000ull, stale_counting_callback, &stale);
+        }
+
+        auto start = Clock::now();
+        for (uint32_t i = 0; i < ITERATIONS; ++i)
+        {
+            datastore_set_uint32(ds, 0, (i * 97) % NUM_INSTANCES, i);
+        }
+        report("ttl", watched ? "set, 100k instances with TTL" : "set, no TTL", ITERATIONS, elapsed_s(start));
+
+        datastore_free(&ds);
+    }
+
+    datastore_t * ds = datastore_create();
+    datastore_add_resource(ds, 0, datastore_create_resource(DATASTORE_TYPE_UINT32, NUM_INSTANCES));
+    std::atomic<uint64_t> stale(0);
+    auto start = Clock::now();
+    datastore_set_ttl(ds, 0, 1, stale_counting_callback, &stale);
+    while (stale.load() < NUM_INSTANCES)
+    {
+        std::this_thread::yield();
+    }
+    report("ttl", "arm and expire 100k instances", NUM_INSTANCES, elapsed_s(start));
+    datastore_free(&ds);
+}
+
+// Full-table age scan over a large resource, reading every instance's age through the public API.
+void bench_age_scan()
+{
+    const int NUM_INSTANCES = 100000;
+    const uint32_t PASSES = 10;
+    datastore_t * ds = datastore_create();
+    datastore_add_resource(ds, 0, datastore_create_resource(DATASTORE_TYPE_UINT32, NUM_INSTANCES));
+    for (int i = 0; i < NUM_INSTANCES; ++i)
+    {
+        datastore_set_uint32(ds, 0, i, i);
+    }
+
+    uint64_t total = 0;
+    auto start = Clock::now();
+    for (uint32_t p = 0; p < PASSES; ++p)
+    {
+        for (int i = 0; i < NUM_INSTANCES; ++i)
+        {
+            datastore_age_t age_us = 0;
+            datastore_get_age(ds, 0, i, &age_us);
+            total += age_us;
+        }
+    }
+    report("age_scan", "get_age, 100k instances", 1ull * PASSES * NUM_INSTANCES, elapsed_s(start));
+
+    // the same table scanned inside the library, which reads only the timestamp array
+    size_t num_stale = 0;
+    start = Clock::now();
+    for (uint32_t p = 0; p < PASSES; ++p)
+    {
+        datastore_find_stale(ds, 1000000000, NULL, 0, &num_stale);
+        total += num_stale;
+    }
+    report("age_scan", "find_stale, 100k instances", 1ull * PASSES * NUM_INSTANCES, elapsed_s(start));
+
+    // the layout alone: timestamps in their own array, as now, against timestamps interleaved with
+    // the rest of the per-instance metadata, as before the split
+    struct Interleaved
+    {
+        uint64_t timestamp;
+        uint32_t sequence;
+        uint8_t queued;
+        uint8_t dirty;
+        uint8_t expired;
+        void * callbacks;
+    };
+    std::vector<uint64_t> timestamps(NUM_INSTANCES);
+    std::vector<Interleaved> entries(NUM_INSTANCES);
+    for (int i = 0; i < NUM_INSTANCES; ++i)
+    {
+        timestamps[i] = entries[i].timestamp = i % 7 == 0 ? 0 : 1000 + i;
+    }
+    const uint64_t cutoff = 500;
+
+    size_t stale = 0;
+    start = Clock::now();
+    for (uint32_t p = 0; p < PASSES * 10; ++p)
+    {
+        for (int i = 0; i < NUM_INSTANCES; ++i)
+        {
+            stale += __atomic_load_n(&timestamps[i], __ATOMIC_RELAXED) < cutoff;
+        }
+    }
+    report("age_scan", "timestamp array (after)", 10ull * PASSES * NUM_INSTANCES, elapsed_s(start));
+
+    start = Clock::now();
+    for (uint32_t p = 0; p < PASSES * 10; ++p)
+    {
+        for (int i = 0; i < NUM_INSTANCES; ++i)
+        {
+            stale += __atomic_load_n(&entries[i].timestamp, __ATOMIC_RELAXED) < cutoff;
+        }
+    }
+    report("age_scan", "interleaved entries (before)", 10ull * PASSES * NUM_INSTANCES, elapsed_s(start));
+    total += stale;
+
+    datastore_free(&ds);
+}
+
+// Each thread increments its own atomic counter in a shared table: adjacent counters share a cache line
+// unless the resource is cache-aligned.
+void bench_false_sharing()
+{
+    const uint32_t flags[] = { DATASTORE_RESOURCE_FLAG_ATOMIC, DATASTORE_RESOURCE_FLAG_ATOMIC | DATASTORE_RESOURCE_FLAG_CACHE_ALIGNED };
+    const char * names[] = { "packed", "cache aligned" };
+    for (unsigned f = 0; f < 2; ++f)
+    {
+        for (unsigned num_threads = 2; num_threads <= max_threads(); num_threads *= 2)
+        {
+            datastore_t * ds = datastore_create();
+            datastore_resource_t resource = datastore_create_resource(DATASTORE_TYPE_UINT32, num_threads);
+            resource.flags = flags[f];
+            datastore_add_resource(ds, 0, resource);
+
+            auto start = Clock::now();
+            std::vector<std::thread> threads;
+            for (unsigned t = 0; t < num_threads; ++t)
+            {
+                threads.emplace_back([ds, t]() {
+                    for (uint32_t i = 0; i < ITERATIONS; ++i)
+                    {
+                        datastore_increment(ds, 0, t);
+                    }
+                });
+            }
+            for (auto & thread : threads)
+            {
+                thread.join();
+            }
+            double seconds = elapsed_s(start);
+
+            char variant[32];
+            snprintf(variant, sizeof(variant), "%s, %u threads", names[f], num_threads);
+            report("false_sharing", variant, 1ull * ITERATIONS * num_threads, seconds);
+
+            datastore_free(&ds);
+        }
+    }
+}
+
+// Build and free a store of many small resources, each with a name and a callback
+void bench_allocator()
+{
+    const unsigned num_resources = 5000;
+    const char * names[] = { "heap", "arena" };
+    for (unsigned a = 0; a < 2; ++a)
+    {
+        const unsigned rounds = 20;
+        auto start = Clock::now();
+        for (unsigned round = 0; round < rounds; ++round)
+        {
+            datastore_allocator_t arena;
+            datastore_t * ds = NULL;
+            if (a == 1 && datastore_arena_allocator(&arena, 64 * 1024) == DATASTORE_STATUS_OK)
+            {
+                ds = datastore_create_with_allocator(&arena);
+            }
+            else
+            {
+                ds = datastore_create();
+            }
+            for (unsigned id = 0; id < num_resources; ++id)
+            {
+                char name[32];
+                snprintf(name, sizeof(name), "resource%u", id);
+                datastore_add_fixed_length_resource(ds, id, DATASTORE_TYPE_UINT32, 1 + id % 4);
+                datastore_set_name(ds, id, name);
+                datastore_add_set_callback(ds, id, 0, counting_callback, NULL);
+            }
+            datastore_free(&ds);
+        }
+        report("allocator", names[a], 1ull * rounds * num_resources, elapsed_s(start));
+    }
+}
+
+// Per-call cost of the validating typed functions against a handle resolved once
+void bench_handle()
+{
+    datastore_t * ds = datastore_create();
+    for (datastore_resource_id_t id = 0; id < 1000; ++id)
+    {
+        datastore_add_resource(ds, id, datastore_create_resource(DATASTORE_TYPE_UINT32, 4));
+    }
+    const datastore_resource_id_t id = 777;
+    datastore_handle_t handle;
+    datastore_resolve(ds, id, 3, DATASTORE_TYPE_UINT32, &handle);
+
+    uint32_t value = 0;
+    auto start = Clock::now();
+    for (uint32_t i = 0; i < ITERATIONS; ++i)
+    {
+        datastore_get_uint32(ds, id, 3, &value);
+    }
+    report("handle", "get, typed", ITERATIONS, elapsed_s(start));
+
+    start = Clock::now();
+    for (uint32_t i = 0; i < ITERATIONS; ++i)
+    {
+        datastore_handle_get(&handle, &value);
+    }
+    report("handle", "get, handle", ITERATIONS, elapsed_s(start));
+
+    start = Clock::now();
+    for (uint32_t i = 0; i < ITERATIONS; ++i)
+    {
+        datastore_set_uint32(ds, id, 3, i);
+    }
+    report("handle", "set, typed", ITERATIONS, elapsed_s(start));
+
+    start = Clock::now();
+    for (uint32_t i = 0; i < ITERATIONS; ++i)
+    {
+        datastore_handle_set(&handle, &i);
+    }
+    report("handle", "set, handle", ITERATIONS, elapsed_s(start));
+
+    datastore_free(&ds);
+}
+
+// Set rate and RAM of a 1024-instance string table sized for its longest value, fixed-width against variable-length
+void bench_variable_strings()
+{
+    const uint32_t num_instances = 1024;
+    const size_t length = 256;
+    const char * names[] = { "fixed", "variable" };
+    char value[length];
+    for (unsigned v = 0; v < 2; ++v)
+    {
+        datastore_t * ds = datastore_create();
+        if (v == 0)
+        {
+            datastore_add_string_resource(ds, 0, num_instances, length);
+        }
+        else
+        {
+            datastore_add_variable_string_resource(ds, 0, num_instances, length);
+        }
+
+        // mostly short values, with one in sixteen near the limit
+        uint32_t seed = 1;
+        auto start = Clock::now();
+        for (uint32_t i = 0; i < ITERATIONS; ++i)
+        {
+            seed = seed * 1103515245u + 12345u;
+            size_t size = (seed >> 24) % 16 == 0 ? 200 : 4 + (seed >> 4) % 12;
+            memset(value, 'a' + i % 26, size);
+            value[size] = '\0';
+            datastore_set_string(ds, 0, (seed >> 8) % num_instances, value);
+        }
+        double seconds = elapsed_s(start);
+
+        char variant[48];
+        snprintf(variant, sizeof(variant), "%s, %zu bytes", names[v], datastore_get_ram_usage(ds));
+        report("variable_strings", variant, ITERATIONS, seconds);
+        datastore_free(&ds);
+    }
+}
+
+struct Benchmark
+{
+    const char * name;
+    void (*func)(void);
+};
+
+const Benchmark BENCHMARKS[] = {
+    { "stores_per_thread", bench_stores_per_thread },
+    { "shared_readers", bench_shared_readers },
+    { "writer_under_readers", bench_writer_under_readers },
+    { "lock_free_reads", bench_lock_free_reads },
+    { "increment", bench_increment },
+    { "find_by_name", bench_find_by_name },
+    { "set_batch", bench_set_batch },
+    { "set_batch_subscribed", bench_set_batch_subscribed },
+    { "get_batch", bench_get_batch },
+    { "range", bench_range },
+    { "suppress_unchanged", bench_suppress_unchanged },
+    { "notifier", bench_notifier },
+    { "coalesce", bench_coalesce },
+    { "callbacks", bench_callbacks },
+    { "clock", bench_clock },
+    { "find_stale", bench_find_stale },
+    { "ttl", bench_ttl },
+    { "age_scan", bench_age_scan },
+    { "false_sharing", bench_false_sharing },
+    { "allocator", bench_allocator },
+    { "handle", bench_handle },
+    { "variable_strings", bench_variable_strings },
+};
+
+} // namespace
+
+int main(int argc, char ** argv)
+{
+    for (const auto & benchmark : BENCHMARKS)
+    {
+        if (argc < 2 || strcmp(argv[1], benchmark.name) == 0)
+        {
+            benchmark.func();
+        }
+    }
+    return 0;
+}
@@ -41,22 +41,23 @@
 #endif
 
 
-// TODO: String instances are all the same size. Consider using a linked list of variable size strings.
-
-struct callback_entry_t
+typedef struct
 {
-    struct callback_entry_t * next;
     datastore_set_callback func;
     void * context;
-};
-typedef struct callback_entry_t callback_entry_t;
+    uint32_t flags;   // DATASTORE_CALLBACK_FLAG_*
+} callback_entry_t;
 
-struct instance_entry_t
+// Callback lists are never modified once published. Adding or removing a callback publishes a copy,
+// and the old list is retired until no dispatcher can still be reading it - see _callbacks_enter().
+struct callback_list_t
 {
-    uint64_t timestamp;
-    callback_entry_t * callbacks;
+    struct callback_list_t * retired;   // next in the retired list
+    uint32_t retire_epoch;
+    uint32_t count;
+    callback_entry_t entries[];
 };
-typedef struct instance_entry_t instance_entry_t;
+typedef struct callback_list_t callback_list_t;
 
 typedef struct
 {
@@ -66,16 +67,173 @@ typedef struct
     datastore_instance_id_t num_instances;
     void * data;   // pointer to first byte of first instance
     size_t size;   // per instance size
+    size_t stride; // distance between instances - larger than size for DATASTORE_RESOURCE_FLAG_CACHE_ALIGNED
     bool managed;  // data allocation is managed by API
-    instance_entry_t * instances;
+    bool variable_length;  // data is a string_heap_t - see datastore_add_variable_string_resource()
+    uint32_t flags;  // DATASTORE_RESOURCE_FLAG_*
+
+    // Per-instance metadata, as parallel arrays in a single allocation, so that a scan over one
+    // field (ages, staleness, callbacks) does not stride over the others.
+    uint64_t * timestamps;                 // UINT64_MAX until set; the start of the allocation
+    callback_list_t ** instance_callbacks;
+    uint32_t * sequences;                  // odd while a write is in progress, for resources with lock-free reads
+    uint32_t * batch_writes;               // 1 + index of the latest write to the instance in the batch being applied, else 0
+    uint8_t * queued;                      // a notification is pending, with DATASTORE_BACKPRESSURE_COALESCE
+    uint8_t * dirty;                       // set since coalesced callbacks were last dispatched
+    uint8_t * expired;                     // reported stale and not set since, for resources with a TTL
+
+    callback_list_t * callbacks;   // subscribed to every instance
+    uint64_t ttl_us;               // 0 if instances do not expire
+    datastore_stale_callback stale_callback;
+    void * stale_context;
 } index_row_t;
 
+// Variable-length strings share one buffer per resource, stored without their terminators. Each instance
+// keeps a slot in it, rewritten in place while the new value fits and appended to the end otherwise. When
+// the end is reached the live values are compacted into a new buffer, which grows if they would nearly fill it.
+typedef struct
+{
+    uint32_t offset;
+    uint32_t length;
+    uint32_t capacity;   // bytes reserved at offset - a shorter value leaves room for a longer one
+} string_slot_t;
+
+typedef struct
+{
+    char * buffer;
+    size_t capacity;   // bytes in buffer
+    size_t used;       // bytes appended since the last compaction
+    size_t stored;     // total length of the values - what a compaction would use
+    string_slot_t slots[];
+} string_heap_t;
+
+#define STRING_HEAP_MIN_CAPACITY 64
+
+// The resource index is a three-level radix table: a directory of tables, each table holding pointers to
+// pages of rows. Memory is proportional to the IDs actually in use, and rows never move once allocated,
+// so readers may hold a row pointer without the lock. Only the directory grows - the old directory is kept
+// (and freed along with the datastore) in case a reader is still looking at it.
+#define INDEX_PAGE_BITS   6
+#define INDEX_TABLE_BITS  8
+#define INDEX_PAGE_ROWS   (1 << INDEX_PAGE_BITS)    // rows per page
+#define INDEX_TABLE_PAGES (1 << INDEX_TABLE_BITS)   // pages per table
+
+typedef struct
+{
+    index_row_t rows[INDEX_PAGE_ROWS];
+} index_page_t;
+
+typedef struct
+{
+    index_page_t * pages[INDEX_TABLE_PAGES];
+} index_table_t;
+
+struct index_directory_t
+{
+    struct index_directory_t * retired;   // previous, smaller directory
+    size_t num_tables;
+    index_table_t * tables[];
+};
+typedef struct index_directory_t index_directory_t;
+
+// Open-addressing (linear probing) hash table mapping resource names to IDs
+#define NAME_SLOT_EMPTY    (-1)
+#define NAME_SLOT_DELETED  (-2)
+#define NAME_INDEX_MIN_CAPACITY 16
+
+typedef struct
+{
+    uint32_t hash;
+    datastore_resource_id_t id;   // or NAME_SLOT_EMPTY, NAME_SLOT_DELETED
+} name_slot_t;
+
+// Asynchronous callback dispatch: writers post (id, instance) notifications into a bounded lock-free
+// ring (a sequence number per slot, after Dmitry Vyukov's MPMC queue) and a pool of workers drains it.
+typedef struct
+{
+    uint32_t sequence;   // equals the ring position when free, position + 1 when it holds a notification
+    datastore_resource_id_t id;
+    datastore_instance_id_t instance;
+} notification_t;
+
+typedef struct
+{
+    const datastore_t * datastore;
+    datastore_backpressure_t backpressure;
+    notification_t * ring;
+    uint32_t mask;                           // ring length - 1
+    uint32_t enqueue_pos;
+    uint32_t dequeue_pos;
+    platform_counting_semaphore_t items;     // one count per posted notification, and one per worker to stop it
+    platform_counting_semaphore_t slots;     // free slots, for writers that wait
+    bool stopping;
+    uint32_t pending;                        // posted but not yet delivered or dropped
+    uint32_t high_water;
+    uint64_t dropped;
+    uint64_t coalesced;
+    uint32_t num_workers;
+    platform_thread_t workers[];
+} notifier_t;
+
+#define NOTIFIER_MAX_QUEUE_LENGTH (1u << 24)
+#define NOTIFIER_MAX_WORKERS      64
+
+// Expiry for resources with a TTL: one thread keeps a min-heap of (deadline, instance). Sets only refresh
+// the timestamp - when an entry comes due, the thread checks the timestamp and either re-arms the entry at
+// the new deadline or reports the instance stale. A stale instance is re-armed by its next set, so the work
+// per tick is proportional to the entries that come due, not to the number of instances watched.
+typedef struct
+{
+    uint64_t deadline;
+    datastore_resource_id_t id;
+    datastore_instance_id_t instance;
+} expiry_entry_t;
+
+typedef struct
+{
+    const datastore_t * datastore;
+    platform_mutex_t lock;                   // protects the heap and the rows' TTL settings
+    platform_counting_semaphore_t wake;      // an earlier deadline was armed, or stopping
+    expiry_entry_t * heap;
+    size_t num_entries;
+    size_t capacity;
+    bool stopping;
+    platform_thread_t thread;
+} expiry_t;
+
+#define EXPIRY_MAX_WAIT_US 1000000
+
+// An instance with coalesced callbacks waiting for datastore_dispatch_pending()
 typedef struct
 {
+    datastore_resource_id_t id;
+    datastore_instance_id_t instance;
+} pending_t;
+
+#define PENDING_MIN_CAPACITY 16
+
+typedef struct
+{
+    datastore_allocator_t allocator;
     platform_semaphore_t semaphore;
-    // TODO: replace with dynamic array of pointers to index rows (rather than dynamic full array)
-    index_row_t * index_rows;
-    size_t index_size;
+    notifier_t * notifier;          // NULL if callbacks are invoked by the writer
+    expiry_t * expiry;              // NULL until a TTL is set
+    platform_mutex_t pending_lock;
+    pending_t * pending;            // dirty instances, in the order they were first set
+    size_t num_pending;
+    size_t pending_capacity;
+    uint32_t epoch;                      // callback list reclamation epoch
+    uint32_t readers[2];                 // dispatchers pinned to an even or odd epoch
+    callback_list_t * retired_callbacks;
+    callback_list_t * callbacks;         // subscribed to every resource
+    datastore_clock_t clock;
+    index_directory_t * index;
+    name_slot_t * name_index;
+    size_t name_index_capacity;   // power of two
+    size_t name_index_used;       // including deleted slots
+    uint64_t suppressed_writes;   // writes of an unchanged value, see DATASTORE_RESOURCE_FLAG_SUPPRESS_UNCHANGED
+    bool is_static;                     // created by datastore_create_static()
+    datastore_static_config_t limits;   // if is_static
 } private_t;
 
 // must be in same order as datastore_type_t!
@@ -90,95 +248,2524 @@ uint8_t TYPE_SIZES[DATASTORE_TYPE_LAST] = {
     0,    // string is handled differently
 };
 
-datastore_t * datastore_create(void)
+// Cache-aligned resources pad each instance to this, and the arena aligns its larger size classes to it.
+#define CACHE_LINE_SIZE 64
+
+// Enough for any value or structure the datastore stores - allocations that need more say so explicitly.
+#define ALLOC_ALIGNMENT 8
+
+static void * _heap_alloc(void * context, size_t size, size_t alignment)
 {
-    datastore_t * datastore = NULL;
-    private_t * private = malloc(sizeof(*private));
-    if (private != NULL)
+    (void)context;
+    return alignment <= ALLOC_ALIGNMENT ? malloc(size) : platform_aligned_alloc(alignment, size);
+}
+
+static void _heap_free(void * context, void * ptr, size_t size, size_t alignment)
+{
+    (void)context;
+    (void)size;
+    if (alignment <= ALLOC_ALIGNMENT)
+    {
+        free(ptr);
+    }
+    else
+    {
+        platform_aligned_free(ptr);
+    }
+}
+
+static const datastore_allocator_t HEAP_ALLOCATOR = { _heap_alloc, _heap_free, NULL, NULL };
+
+static void * _alloc(const private_t * private, size_t size, size_t alignment)
+{
+    return private->allocator.alloc(private->allocator.context, size, alignment);
+}
+
+static void _free(const private_t * private, void * ptr, size_t size, size_t alignment)
+{
+    if (ptr != NULL)
+    {
+        private->allocator.free(private->allocator.context, ptr, size, alignment);
+    }
+}
+
+// Callback lists are allocated with room for a power of two entries, so that the lists left behind by
+// adding and removing callbacks come in few sizes and are readily reused.
+static size_t _callback_list_size(uint32_t count)
+{
+    uint32_t capacity = 1;
+    while (capacity < count)
+    {
+        capacity *= 2;
+    }
+    return sizeof(callback_list_t) + capacity * sizeof(callback_entry_t);
+}
+
+static void _free_callback_list(const private_t * private, callback_list_t * list)
+{
+    if (list != NULL)
+    {
+        _free(private, list, _callback_list_size(list->count), ALLOC_ALIGNMENT);
+    }
+}
+
+// Per-instance metadata - see index_row_t
+static size_t _metadata_size(size_t num_instances)
+{
+    return num_instances * (sizeof(uint64_t) + sizeof(callback_list_t *) + 2 * sizeof(uint32_t) + 3 * sizeof(uint8_t));
+}
+
+static size_t _data_alignment(const index_row_t * row)
+{
+    return (row->flags & DATASTORE_RESOURCE_FLAG_CACHE_ALIGNED) ? CACHE_LINE_SIZE : ALLOC_ALIGNMENT;
+}
+
+static size_t _string_heap_size(uint32_t num_instances)
+{
+    return sizeof(string_heap_t) + num_instances * sizeof(string_slot_t);
+}
+
+static void _string_heap_free(const private_t * private, index_row_t * row)
+{
+    string_heap_t * heap = (string_heap_t *)row->data;
+    _free(private, heap->buffer, heap->capacity, 1);
+    _free(private, heap, _string_heap_size(row->num_instances), ALLOC_ALIGNMENT);
+}
+
+// Values and slots - read without the lock, so only the capacity is looked at
+static size_t _string_heap_usage(const index_row_t * row)
+{
+    const string_heap_t * heap = (const string_heap_t *)row->data;
+    return _string_heap_size(row->num_instances) + __atomic_load_n(&heap->capacity, __ATOMIC_RELAXED);
+}
+
+// Copy out an instance, truncated to size - 1 characters - caller must hold the lock
+static void _string_heap_read(const index_row_t * row, datastore_instance_id_t instance, char * value, size_t size)
+{
+    const string_heap_t * heap = (const string_heap_t *)row->data;
+    const string_slot_t * slot = &heap->slots[instance];
+    size_t length = slot->length < size - 1 ? slot->length : size - 1;
+    if (length > 0)
+    {
+        memcpy(value, heap->buffer + slot->offset, length);
+    }
+    value[length] = '\0';
+}
+
+// Move every value but one instance's into a new buffer, with that instance's slot emptied.
+// Returns false, with the heap unchanged, if the buffer can't be allocated.
+static bool _string_heap_compact(const private_t * private, index_row_t * row, datastore_instance_id_t instance, size_t capacity)
+{
+    string_heap_t * heap = (string_heap_t *)row->data;
+    char * buffer = _alloc(private, capacity, 1);
+    if (buffer != NULL)
+    {
+        size_t used = 0;
+        for (datastore_instance_id_t i = 0; i < row->num_instances; ++i)
+        {
+            string_slot_t * slot = &heap->slots[i];
+            if (i == instance)
+            {
+                slot->length = 0;
+            }
+            else if (slot->length > 0)
+            {
+                memcpy(buffer + used, heap->buffer + slot->offset, slot->length);
+            }
+            slot->offset = used;
+            slot->capacity = slot->length;
+            used += slot->length;
+        }
+        _free(private, heap->buffer, heap->capacity, 1);
+        heap->buffer = buffer;
+        __atomic_store_n(&heap->capacity, capacity, __ATOMIC_RELAXED);
+        heap->used = used;
+        heap->stored = used;
+    }
+    return buffer != NULL;
+}
+
+// Store a new value of an instance - caller must hold the exclusive lock
+static datastore_status_t _string_heap_store(const private_t * private, index_row_t * row, datastore_instance_id_t instance, const char * value, size_t length)
+{
+    datastore_status_t err = DATASTORE_STATUS_OK;
+    string_heap_t * heap = (string_heap_t *)row->data;
+    string_slot_t * slot = &heap->slots[instance];
+    if (length > slot->capacity)
+    {
+        if (heap->used + length > heap->capacity)
+        {
+            // grow if the compacted values would leave less than a third free, but never beyond every instance at full length
+            size_t needed = heap->stored - slot->length + length;
+            size_t capacity = heap->capacity;
+            if (needed + needed / 2 > capacity)
+            {
+                size_t largest = (row->size - 1) * row->num_instances;
+                capacity = needed * 2 > STRING_HEAP_MIN_CAPACITY ? needed * 2 : STRING_HEAP_MIN_CAPACITY;
+                capacity = capacity < largest ? capacity : largest;
+            }
+            if (!_string_heap_compact(private, row, instance, capacity))
+            {
+                platform_error("malloc failed");
+                err = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
+            }
+        }
+        if (err == DATASTORE_STATUS_OK)
+        {
+            slot->offset = heap->used;
+            slot->capacity = length;
+            heap->used += length;
+        }
+    }
+    if (err == DATASTORE_STATUS_OK)
+    {
+        if (length > 0)
+        {
+            memcpy(heap->buffer + slot->offset, value, length);
+        }
+        heap->stored = heap->stored - slot->length + length;
+        slot->length = length;
+    }
+    return err;
+}
+
+// The built-in arena. Small allocations are rounded up to a power-of-two size class and carved from the
+// current block, aligned to their size (up to a cache line), so that any freed chunk of a class can be
+// reused for any later allocation of that class. Larger allocations, typically arrays that grow by doubling,
+// are allocated separately so that the copies they leave behind go back to the system.
+#define ARENA_MIN_SLAB_BITS 4    // 16 bytes
+#define ARENA_NUM_SLABS     8    // up to DATASTORE_ARENA_MAX_SLAB
+
+typedef struct arena_block_t
+{
+    struct arena_block_t * next;
+} arena_block_t;
+
+// Immediately precedes a large allocation
+typedef struct arena_large_t
+{
+    struct arena_large_t * prev;
+    struct arena_large_t * next;
+    void * base;
+} arena_large_t;
+
+typedef struct
+{
+    platform_mutex_t lock;
+    size_t block_size;
+    arena_block_t * blocks;
+    uint8_t * next;                      // first unused byte in the current block
+    uint8_t * end;
+    void * free_slabs[ARENA_NUM_SLABS];  // freed chunks of each size class, linked through their first word
+    arena_large_t * large;
+} arena_t;
+
+// Returns the size class for an allocation, or ARENA_NUM_SLABS if it must be allocated separately.
+static size_t _arena_slab(size_t size, size_t alignment)
+{
+    size_t slab = 0;
+    size = size > alignment ? size : alignment;
+    if (alignment > CACHE_LINE_SIZE || size > DATASTORE_ARENA_MAX_SLAB)
+    {
+        slab = ARENA_NUM_SLABS;
+    }
+    else
+    {
+        while (((size_t)1 << (ARENA_MIN_SLAB_BITS + slab)) < size)
+        {
+            ++slab;
+        }
+    }
+    return slab;
+}
+
+static void * _arena_alloc_large(arena_t * arena, size_t size, size_t alignment)
+{
+    void * ptr = NULL;
+    alignment = alignment > sizeof(void *) ? alignment : sizeof(void *);
+    size_t header_size = (sizeof(arena_large_t) + alignment - 1) / alignment * alignment;
+    uint8_t * base = platform_aligned_alloc(alignment, header_size + size);
+    if (base != NULL)
     {
-        memset(private, 0, sizeof(*private));
-        platform_debug("malloc private %p", private);
-        private->index_rows = NULL;
-        private->index_size = 0;
+        ptr = base + header_size;
+        arena_large_t * large = (arena_large_t *)ptr - 1;
+        large->base = base;
+        large->prev = NULL;
+        large->next = arena->large;
+        if (arena->large != NULL)
+        {
+            arena->large->prev = large;
+        }
+        arena->large = large;
+    }
+    return ptr;
+}
 
-        datastore = malloc(sizeof(*datastore));
-        if (datastore)
+static void * _arena_alloc(void * context, size_t size, size_t alignment)
+{
+    arena_t * arena = (arena_t *)context;
+    void * ptr = NULL;
+    size_t slab = _arena_slab(size, alignment);
+    platform_mutex_take(&arena->lock);
+    if (slab == ARENA_NUM_SLABS)
+    {
+        ptr = _arena_alloc_large(arena, size, alignment);
+    }
+    else if (arena->free_slabs[slab] != NULL)
+    {
+        ptr = arena->free_slabs[slab];
+        arena->free_slabs[slab] = *(void **)ptr;
+    }
+    else
+    {
+        size_t slab_size = (size_t)1 << (ARENA_MIN_SLAB_BITS + slab);
+        size_t slab_alignment = slab_size < CACHE_LINE_SIZE ? slab_size : CACHE_LINE_SIZE;
+        uint8_t * next = (uint8_t *)(((uintptr_t)arena->next + slab_alignment - 1) & ~(uintptr_t)(slab_alignment - 1));
+        if (arena->next == NULL || next + slab_size > arena->end)
+        {
+            arena_block_t * block = malloc(arena->block_size);
+            if (block != NULL)
+            {
+                block->next = arena->blocks;
+                arena->blocks = block;
+                arena->end = (uint8_t *)block + arena->block_size;
+                next = (uint8_t *)(((uintptr_t)(block + 1) + slab_alignment - 1) & ~(uintptr_t)(slab_alignment - 1));
+            }
+            else
+            {
+                next = NULL;
+            }
+        }
+        if (next != NULL)
         {
-            platform_debug("malloc datastore %p", datastore);
-            memset(datastore, 0, sizeof(*datastore));
+            ptr = next;
+            arena->next = next + slab_size;
+        }
+    }
+    platform_mutex_give(&arena->lock);
+    return ptr;
+}
 
-            private->semaphore = platform_semaphore_create();
-            datastore->private_data = private;
+static void _arena_free(void * context, void * ptr, size_t size, size_t alignment)
+{
+    arena_t * arena = (arena_t *)context;
+    size_t slab = _arena_slab(size, alignment);
+    platform_mutex_take(&arena->lock);
+    if (slab == ARENA_NUM_SLABS)
+    {
+        arena_large_t * large = (arena_large_t *)ptr - 1;
+        if (large->prev != NULL)
+        {
+            large->prev->next = large->next;
         }
         else
         {
-            platform_error("malloc failed");
-            free(private);
+            arena->large = large->next;
+        }
+        if (large->next != NULL)
+        {
+            large->next->prev = large->prev;
         }
+        platform_aligned_free(large->base);
     }
     else
     {
-        platform_error("malloc failed");
+        *(void **)ptr = arena->free_slabs[slab];
+        arena->free_slabs[slab] = ptr;
     }
+    platform_mutex_give(&arena->lock);
+}
 
-    return datastore;
+static void _arena_release(void * context)
+{
+    arena_t * arena = (arena_t *)context;
+    while (arena->blocks != NULL)
+    {
+        arena_block_t * next = arena->blocks->next;
+        free(arena->blocks);
+        arena->blocks = next;
+    }
+    while (arena->large != NULL)
+    {
+        arena_large_t * next = arena->large->next;
+        platform_aligned_free(arena->large->base);
+        arena->large = next;
+    }
+    platform_mutex_delete(&arena->lock);
+    free(arena);
 }
 
-void datastore_free(datastore_t ** datastore)
+datastore_status_t datastore_arena_allocator(datastore_allocator_t * allocator, size_t block_size)
 {
-    if (datastore != NULL && (*datastore != NULL))
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    if (allocator != NULL)
     {
-        private_t * private = (private_t *)(*datastore)->private_data;
-        if (private != NULL)
+        if (block_size >= DATASTORE_ARENA_MIN_BLOCK_SIZE)
+        {
+            arena_t * arena = malloc(sizeof(*arena));
+            if (arena != NULL)
+            {
+                memset(arena, 0, sizeof(*arena));
+                platform_mutex_create(&arena->lock);
+                arena->block_size = block_size;
+                allocator->alloc = _arena_alloc;
+                allocator->free = _arena_free;
+                allocator->release = _arena_release;
+                allocator->context = arena;
+                err = DATASTORE_STATUS_OK;
+            }
+            else
+            {
+                platform_error("malloc failed");
+                err = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
+            }
+        }
+        else
+        {
+            platform_error("block size %zu is less than %d", block_size, DATASTORE_ARENA_MIN_BLOCK_SIZE);
+            err = DATASTORE_STATUS_ERROR_INVALID_ARGUMENT;
+        }
+    }
+    else
+    {
+        platform_error("allocator is NULL");
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+    }
+    return err;
+}
+
+// Static mode: everything is carved from one caller-supplied region, and nothing is returned to the heap.
+// Freed allocations are kept for reuse by later allocations of exactly the same (rounded) size - with
+// callback lists in power-of-two sizes, that bounds the memory used by any sequence of changes.
+typedef struct static_chunk_t
+{
+    struct static_chunk_t * next;
+    size_t size;
+} static_chunk_t;
+
+typedef struct
+{
+    platform_mutex_t lock;
+    uint8_t * next;          // first unused byte
+    uint8_t * end;
+    static_chunk_t * free;   // freed allocations
+} static_region_t;
+
+// Every allocation is a multiple of this, so that a freed one can hold a static_chunk_t
+#define STATIC_GRANULE sizeof(static_chunk_t)
+
+static size_t _static_round(size_t size)
+{
+    return (size + STATIC_GRANULE - 1) / STATIC_GRANULE * STATIC_GRANULE;
+}
+
+static void * _static_alloc(void * context, size_t size, size_t alignment)
+{
+    static_region_t * region = (static_region_t *)context;
+    void * ptr = NULL;
+    size = _static_round(size > 0 ? size : 1);
+    platform_mutex_take(&region->lock);
+    static_chunk_t ** link = &region->free;
+    while (*link != NULL && ((*link)->size != size || (uintptr_t)*link % alignment != 0))
+    {
+        link = &(*link)->next;
+    }
+    if (*link != NULL)
+    {
+        ptr = *link;
+        *link = (*link)->next;
+    }
+    else
+    {
+        uint8_t * next = (uint8_t *)(((uintptr_t)region->next + alignment - 1) & ~(uintptr_t)(alignment - 1));
+        if (next <= region->end && size <= (size_t)(region->end - next))
+        {
+            ptr = next;
+            region->next = next + size;
+        }
+    }
+    platform_mutex_give(&region->lock);
+    return ptr;
+}
+
+static void _static_free(void * context, void * ptr, size_t size, size_t alignment)
+{
+    (void)alignment;
+    static_region_t * region = (static_region_t *)context;
+    static_chunk_t * chunk = (static_chunk_t *)ptr;
+    platform_mutex_take(&region->lock);
+    chunk->size = _static_round(size > 0 ? size : 1);
+    chunk->next = region->free;
+    region->free = chunk;
+    platform_mutex_give(&region->lock);
+}
+
+static void _static_release(void * context)
+{
+    static_region_t * region = (static_region_t *)context;
+    platform_mutex_delete(&region->lock);
+}
+
+// Returns the row for a defined resource, or NULL. Safe to call without the lock.
+static index_row_t * _get_row(const private_t * private, datastore_resource_id_t id)
+{
+    index_row_t * row = NULL;
+    if (id >= 0)
+    {
+        size_t table_index = (size_t)id >> (INDEX_PAGE_BITS + INDEX_TABLE_BITS);
+        size_t page_index = ((size_t)id >> INDEX_PAGE_BITS) & (INDEX_TABLE_PAGES - 1);
+        size_t row_index = (size_t)id & (INDEX_PAGE_ROWS - 1);
+
+        index_directory_t * directory = __atomic_load_n(&private->index, __ATOMIC_ACQUIRE);
+        if (directory != NULL && table_index < directory->num_tables)
+        {
+            index_table_t * table = __atomic_load_n(&directory->tables[table_index], __ATOMIC_ACQUIRE);
+            if (table != NULL)
+            {
+                index_page_t * page = __atomic_load_n(&table->pages[page_index], __ATOMIC_ACQUIRE);
+                // a row is published by setting its data pointer last
+                if (page != NULL && __atomic_load_n(&page->rows[row_index].data, __ATOMIC_ACQUIRE) != NULL)
+                {
+                    row = &page->rows[row_index];
+                }
+            }
+        }
+    }
+    return row;
+}
+
+// Iterate over defined rows in ID order - returns the row with the lowest ID >= *cursor and
+// advances the cursor past it, or returns NULL if there are no more. Start with *cursor = 0.
+static index_row_t * _next_row(const private_t * private, size_t * cursor)
+{
+    index_row_t * row = NULL;
+    index_directory_t * directory = __atomic_load_n(&private->index, __ATOMIC_ACQUIRE);
+    size_t next = *cursor;
+    while (row == NULL && directory != NULL && (next >> (INDEX_PAGE_BITS + INDEX_TABLE_BITS)) < directory->num_tables)
+    {
+        index_table_t * table = __atomic_load_n(&directory->tables[next >> (INDEX_PAGE_BITS + INDEX_TABLE_BITS)], __ATOMIC_ACQUIRE);
+        if (table == NULL)
+        {
+            // skip to the start of the next table
+            next = ((next >> (INDEX_PAGE_BITS + INDEX_TABLE_BITS)) + 1) << (INDEX_PAGE_BITS + INDEX_TABLE_BITS);
+        }
+        else if (__atomic_load_n(&table->pages[(next >> INDEX_PAGE_BITS) & (INDEX_TABLE_PAGES - 1)], __ATOMIC_ACQUIRE) == NULL)
+        {
+            // skip to the start of the next page
+            next = ((next >> INDEX_PAGE_BITS) + 1) << INDEX_PAGE_BITS;
+        }
+        else
+        {
+            row = _get_row(private, (datastore_resource_id_t)next);
+            ++next;
+        }
+    }
+    *cursor = next;
+    return row;
+}
+
+// Returns the (possibly undefined) row for an ID, allocating index memory as required. Caller must hold the lock.
+static index_row_t * _allocate_row(private_t * private, datastore_resource_id_t id)
+{
+    index_row_t * row = NULL;
+    size_t table_index = (size_t)id >> (INDEX_PAGE_BITS + INDEX_TABLE_BITS);
+    size_t page_index = ((size_t)id >> INDEX_PAGE_BITS) & (INDEX_TABLE_PAGES - 1);
+    size_t row_index = (size_t)id & (INDEX_PAGE_ROWS - 1);
+
+    index_directory_t * directory = private->index;
+    if (directory == NULL || table_index >= directory->num_tables)
+    {
+        // must extend directory
+        size_t num_tables = directory != NULL ? directory->num_tables : 1;
+        while (num_tables <= table_index)
+        {
+            num_tables *= 2;
+        }
+        platform_debug("extend index directory to %zu tables", num_tables);
+
+        index_directory_t * new_directory = _alloc(private, sizeof(*new_directory) + num_tables * sizeof(new_directory->tables[0]), ALLOC_ALIGNMENT);
+        if (new_directory != NULL)
+        {
+            memset(new_directory, 0, sizeof(*new_directory) + num_tables * sizeof(new_directory->tables[0]));
+            new_directory->num_tables = num_tables;
+            new_directory->retired = directory;
+            if (directory != NULL)
+            {
+                memcpy(new_directory->tables, directory->tables, directory->num_tables * sizeof(directory->tables[0]));
+            }
+            __atomic_store_n(&private->index, new_directory, __ATOMIC_RELEASE);
+            directory = new_directory;
+        }
+        else
+        {
+            platform_error("malloc failed");
+            directory = NULL;
+        }
+    }
+
+    index_table_t * table = directory != NULL ? directory->tables[table_index] : NULL;
+    if (directory != NULL && table == NULL)
+    {
+        table = _alloc(private, sizeof(*table), ALLOC_ALIGNMENT);
+        if (table != NULL)
+        {
+            memset(table, 0, sizeof(*table));
+            __atomic_store_n(&directory->tables[table_index], table, __ATOMIC_RELEASE);
+        }
+        else
+        {
+            platform_error("malloc failed");
+        }
+    }
+
+    index_page_t * page = table != NULL ? table->pages[page_index] : NULL;
+    if (table != NULL && page == NULL)
+    {
+        page = _alloc(private, sizeof(*page), ALLOC_ALIGNMENT);
+        if (page != NULL)
+        {
+            memset(page, 0, sizeof(*page));
+            __atomic_store_n(&table->pages[page_index], page, __ATOMIC_RELEASE);
+        }
+        else
+        {
+            platform_error("malloc failed");
+        }
+    }
+
+    if (page != NULL)
+    {
+        row = &page->rows[row_index];
+    }
+    return row;
+}
+
+datastore_t * datastore_create(void)
+{
+    return datastore_create_with_allocator(NULL);
+}
+
+datastore_t * datastore_create_with_allocator(const datastore_allocator_t * allocator)
+{
+    datastore_t * datastore = NULL;
+    if (allocator == NULL)
+    {
+        allocator = &HEAP_ALLOCATOR;
+    }
+
+    if (allocator->alloc != NULL && allocator->free != NULL)
+    {
+        private_t * private = allocator->alloc(allocator->context, sizeof(*private), ALLOC_ALIGNMENT);
+        if (private != NULL)
+        {
+            memset(private, 0, sizeof(*private));
+            platform_debug("malloc private %p", private);
+            private->allocator = *allocator;
+            private->index = NULL;
+
+            datastore = _alloc(private, sizeof(*datastore), ALLOC_ALIGNMENT);
+            if (datastore)
+            {
+                platform_debug("malloc datastore %p", datastore);
+                memset(datastore, 0, sizeof(*datastore));
+
+                platform_semaphore_create(&private->semaphore);
+                platform_mutex_create(&private->pending_lock);
+                datastore->private_data = private;
+            }
+            else
+            {
+                platform_error("malloc failed");
+                _free(private, private, sizeof(*private), ALLOC_ALIGNMENT);
+            }
+        }
+        else
+        {
+            platform_error("malloc failed");
+        }
+    }
+    else
+    {
+        platform_error("allocator must provide alloc and free");
+    }
+
+    return datastore;
+}
+
+// Pages of rows needed for IDs below max_resources
+static size_t _static_index_pages(const datastore_static_config_t * config)
+{
+    return ((size_t)config->max_resources + INDEX_PAGE_ROWS - 1) / INDEX_PAGE_ROWS;
+}
+
+// Bytes allocated for a name - a static datastore allocates them all at one size, so a freed name is always reused
+static size_t _name_alloc_size(const private_t * private, const char * name)
+{
+    return private->is_static ? (size_t)private->limits.max_name_length + 1 : strlen(name) + 1;
+}
+
+size_t datastore_static_size(const datastore_static_config_t * config)
+{
+    size_t size = 0;
+    if (config != NULL)
+    {
+        size = _static_round(sizeof(static_region_t)) + _static_round(sizeof(private_t)) + _static_round(sizeof(datastore_t));
+
+        // the whole index, with the directory allocated once at its final size
+        size_t num_pages = _static_index_pages(config);
+        if (num_pages > 0)
+        {
+            size_t num_tables = (num_pages + INDEX_TABLE_PAGES - 1) / INDEX_TABLE_PAGES;
+            size_t directory_tables = 1;
+            while (directory_tables < num_tables)
+            {
+                directory_tables *= 2;
+            }
+            size += _static_round(sizeof(index_directory_t) + directory_tables * sizeof(index_table_t *))
+                  + num_tables * _static_round(sizeof(index_table_t))
+                  + num_pages * _static_round(sizeof(index_page_t));
+        }
+
+        // per-instance metadata, rounded up for each resource
+        size += _metadata_size(config->max_instances) + (size_t)config->max_resources * (STATIC_GRANULE - 1);
+
+        // A list with room for 2^j entries (j > 0) holds more than 2^(j-1) of them, so at most
+        // max_callbacks / (2^(j-1) + 1) lists of that size are in use, plus one being replaced.
+        for (uint32_t capacity = 1; config->max_callbacks > 0 && capacity / 2 < config->max_callbacks; capacity *= 2)
+        {
+            uint32_t min_count = capacity == 1 ? 1 : capacity / 2 + 1;
+            size += (config->max_callbacks / min_count + 1 + config->max_retired) * _static_round(_callback_list_size(capacity));
+        }
+
+        // every name at the longest length, and the name index at each capacity it can grow through -
+        // up to two at once while it is rebuilt
+        if (config->max_name_length > 0)
+        {
+            size += (size_t)config->max_resources * _static_round((size_t)config->max_name_length + 1);
+            for (size_t capacity = NAME_INDEX_MIN_CAPACITY; ; capacity *= 2)
+            {
+                size += 2 * _static_round(capacity * sizeof(name_slot_t));
+                if ((size_t)config->max_resources * 4 <= capacity)
+                {
+                    break;
+                }
+            }
+        }
+
+        // the pending set at each capacity it can grow through - up to two at once while it grows,
+        // or while one is being dispatched
+        if (config->max_coalesced > 0)
+        {
+            for (size_t capacity = PENDING_MIN_CAPACITY; ; capacity *= 2)
+            {
+                size += 2 * _static_round(capacity * sizeof(pending_t));
+                if (config->max_coalesced <= capacity)
+                {
+                    break;
+                }
+            }
+        }
+    }
+    else
+    {
+        platform_error("config is NULL");
+    }
+    return size;
+}
+
+datastore_t * datastore_create_static(void * buffer, size_t size, const datastore_static_config_t * config)
+{
+    datastore_t * datastore = NULL;
+    if (buffer != NULL && config != NULL)
+    {
+        size_t required = datastore_static_size(config);
+        if ((uintptr_t)buffer % ALLOC_ALIGNMENT == 0 && size >= required)
+        {
+            static_region_t * region = (static_region_t *)buffer;
+            platform_mutex_create(&region->lock);
+            region->next = (uint8_t *)buffer + _static_round(sizeof(*region));
+            region->end = (uint8_t *)buffer + size;
+            region->free = NULL;
+
+            datastore_allocator_t allocator = { _static_alloc, _static_free, _static_release, region };
+            datastore = datastore_create_with_allocator(&allocator);
+            if (datastore != NULL)
+            {
+                // highest ID first, so that the directory doesn't grow
+                private_t * private = (private_t *)datastore->private_data;
+                private->is_static = true;
+                private->limits = *config;
+                bool allocated = true;
+                platform_semaphore_take(&private->semaphore);
+                for (size_t page = _static_index_pages(config); page > 0 && allocated; --page)
+                {
+                    allocated = _allocate_row(private, (datastore_resource_id_t)((page - 1) * INDEX_PAGE_ROWS)) != NULL;
+                }
+                platform_semaphore_give(&private->semaphore);
+
+                if (!allocated)
+                {
+                    platform_error("failed to allocate index");
+                    datastore_free(&datastore);
+                }
+            }
+            else
+            {
+                platform_mutex_delete(&region->lock);
+            }
+        }
+        else
+        {
+            platform_error("buffer %p of %zu bytes is misaligned or smaller than %zu", buffer, size, required);
+        }
+    }
+    else
+    {
+        platform_error("buffer or config is NULL");
+    }
+    return datastore;
+}
+
+static void _notifier_stop(const private_t * private, notifier_t * notifier);
+static void _expiry_stop(const private_t * private, expiry_t * expiry);
+static void _expiry_arm(expiry_t * expiry, uint64_t deadline, datastore_resource_id_t id, datastore_instance_id_t instance);
+
+void datastore_free(datastore_t ** datastore)
+{
+    if (datastore != NULL && (*datastore != NULL))
+    {
+        private_t * private = (private_t *)(*datastore)->private_data;
+        if (private != NULL)
+        {
+            if (private->expiry != NULL)
+            {
+                _expiry_stop(private, private->expiry);
+                private->expiry = NULL;
+            }
+
+            if (private->notifier != NULL)
+            {
+                // deliver everything still queued before the callbacks are freed
+                _notifier_stop(private, private->notifier);
+                private->notifier = NULL;
+            }
+
+            // an allocator that can release everything at once doesn't need each allocation returned
+            if (private->allocator.release == NULL)
+            {
+                size_t cursor = 0;
+                index_row_t * row = NULL;
+                while ((row = _next_row(private, &cursor)) != NULL)
+                {
+                    if (row->variable_length)
+                    {
+                        _string_heap_free(private, row);
+                    }
+                    else if (row->managed)
+                    {
+                        _free(private, row->data, row->stride * row->num_instances, _data_alignment(row));
+                    }
+                    row->data = NULL;
+
+                    for (datastore_instance_id_t j = 0; j < row->num_instances; ++j)
+                    {
+                        _free_callback_list(private, row->instance_callbacks[j]);
+                    }
+                    _free_callback_list(private, row->callbacks);
+                    row->callbacks = NULL;
+
+                    if (row->name != NULL)
+                    {
+                        _free(private, (void *)row->name, _name_alloc_size(private, row->name), 1);
+                        row->name = NULL;
+                    }
+
+                    _free(private, row->timestamps, _metadata_size(row->num_instances), ALLOC_ALIGNMENT);
+                    row->timestamps = NULL;
+                }
+
+                // tables are shared with retired directories, so only free them once
+                index_directory_t * directory = private->index;
+                if (directory != NULL)
+                {
+                    for (size_t t = 0; t < directory->num_tables; ++t)
+                    {
+                        if (directory->tables[t] != NULL)
+                        {
+                            for (size_t p = 0; p < INDEX_TABLE_PAGES; ++p)
+                            {
+                                _free(private, directory->tables[t]->pages[p], sizeof(index_page_t), ALLOC_ALIGNMENT);
+                            }
+                            _free(private, directory->tables[t], sizeof(index_table_t), ALLOC_ALIGNMENT);
+                        }
+                    }
+                }
+                while (directory != NULL)
+                {
+                    index_directory_t * retired = directory->retired;
+                    _free(private, directory, sizeof(*directory) + directory->num_tables * sizeof(directory->tables[0]), ALLOC_ALIGNMENT);
+                    directory = retired;
+                }
+                private->index = NULL;
+                _free(private, private->name_index, private->name_index_capacity * sizeof(*private->name_index), ALLOC_ALIGNMENT);
+                private->name_index = NULL;
+                _free(private, private->pending, private->pending_capacity * sizeof(*private->pending), ALLOC_ALIGNMENT);
+                private->pending = NULL;
+                _free_callback_list(private, private->callbacks);
+                private->callbacks = NULL;
+                while (private->retired_callbacks != NULL)
+                {
+                    callback_list_t * retired = private->retired_callbacks->retired;
+                    _free_callback_list(private, private->retired_callbacks);
+                    private->retired_callbacks = retired;
+                }
+            }
+            platform_mutex_delete(&private->pending_lock);
+            platform_semaphore_delete(&private->semaphore);
+
+            platform_debug("free private %p", private);
+            datastore_allocator_t allocator = private->allocator;
+            (*datastore)->private_data = NULL;
+            if (allocator.release != NULL)
+            {
+                allocator.release(allocator.context);
+            }
+            else
+            {
+                allocator.free(allocator.context, *datastore, sizeof(**datastore), ALLOC_ALIGNMENT);
+                allocator.free(allocator.context, private, sizeof(*private), ALLOC_ALIGNMENT);
+            }
+        }
+        else
+        {
+            platform_error("private is NULL");
+        }
+        *datastore = NULL;
+    }
+    else
+    {
+        platform_error("invalid pointer");
+    }
+}
+
+// Atomic resources must hold naturally aligned integers (or bools) of a size the hardware can update atomically.
+static bool _is_atomic_compatible(datastore_type_t type, const void * data, size_t size)
+{
+    bool compatible = false;
+    switch (type)
+    {
+    case DATASTORE_TYPE_BOOL:
+    case DATASTORE_TYPE_UINT8:
+    case DATASTORE_TYPE_INT8:
+    case DATASTORE_TYPE_UINT32:
+    case DATASTORE_TYPE_INT32:
+        compatible = (size == TYPE_SIZES[type]) && ((uintptr_t)data % size == 0);
+        break;
+    default:
+        break;
+    }
+    return compatible;
+}
+
+// Instances of cache-aligned resources each start on their own cache line.
+static size_t _cache_aligned_stride(size_t size)
+{
+    return (size + CACHE_LINE_SIZE - 1) / CACHE_LINE_SIZE * CACHE_LINE_SIZE;
+}
+
+static datastore_status_t _add_resource(const datastore_t * datastore, datastore_resource_id_t resource_id, datastore_type_t type, uint32_t num_instances, void * data, size_t size, bool managed, bool variable_length, uint32_t flags)
+{
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    if (datastore != NULL)
+    {
+        private_t * private = (private_t *)datastore->private_data;
+        if (private != NULL)
+        {
+            if (resource_id >= 0)
+            {
+                if (type >= 0 && type < DATASTORE_TYPE_LAST)
+                {
+                    if ((flags & DATASTORE_RESOURCE_FLAG_LOCK_FREE_READS) && (TYPE_SIZES[type] == 0 || size > sizeof(uint64_t)))
+                    {
+                        err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
+                        platform_error("lock-free reads are not supported for resource type %d", type);
+                    }
+                    else if ((flags & DATASTORE_RESOURCE_FLAG_ATOMIC) && !_is_atomic_compatible(type, data, size))
+                    {
+                        err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
+                        platform_error("atomic access is not supported for resource type %d, size %zu, data %p", type, size, data);
+                    }
+                    else if (num_instances > 0)
+                    {
+                        if (data != NULL)
+                        {
+                            platform_semaphore_take(&private->semaphore);
+
+                            index_row_t * row = _allocate_row(private, resource_id);
+                            if (row == NULL)
+                            {
+                                err = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
+                            }
+                            // check for overwrite of existing resource
+                            else if (row->data == NULL)
+                            {
+                                platform_debug("register id %d, data %p", resource_id, data);
+                                // arrays in decreasing order of alignment
+                                size_t metadata_size = _metadata_size(num_instances);
+                                uint8_t * metadata = _alloc(private, metadata_size, ALLOC_ALIGNMENT);
+                                if (metadata != NULL)
+                                {
+                                    memset(metadata, 0, metadata_size);
+                                    uint64_t * timestamps = (uint64_t *)metadata;
+                                    for (size_t i = 0; i < num_instances; ++i)
+                                    {
+                                        timestamps[i] = UINT64_MAX;
+                                    }
+                                    row->timestamps = timestamps;
+                                    row->instance_callbacks = (callback_list_t **)(row->timestamps + num_instances);
+                                    row->sequences = (uint32_t *)(row->instance_callbacks + num_instances);
+                                    row->batch_writes = row->sequences + num_instances;
+                                    row->queued = (uint8_t *)(row->batch_writes + num_instances);
+                                    row->dirty = row->queued + num_instances;
+                                    row->expired = row->dirty + num_instances;
+
+                                    row->id = resource_id;
+                                    row->name = NULL;
+                                    row->num_instances = num_instances;
+                                    row->size = size;
+                                    row->stride = (flags & DATASTORE_RESOURCE_FLAG_CACHE_ALIGNED) ? _cache_aligned_stride(size) : size;
+                                    row->type = type;
+                                    row->managed = managed;
+                                    row->variable_length = variable_length;
+                                    row->flags = flags;
+                                    row->callbacks = NULL;
+                                    row->ttl_us = 0;
+                                    row->stale_callback = NULL;
+                                    row->stale_context = NULL;
+
+                                    // publish the row to lock-free readers
+                                    __atomic_store_n(&row->data, data, __ATOMIC_RELEASE);
+                                    err = DATASTORE_STATUS_OK;
+                                }
+                                else
+                                {
+                                    platform_error("malloc failed");
+                                    err = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
+                                }
+                            }
+                            else
+                            {
+                                err = DATASTORE_STATUS_ERROR_INVALID_ID;
+                                platform_error("resource already defined");
+                            }
+
+                            platform_semaphore_give(&private->semaphore);
+                        }
+                        else
+                        {
+                            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+                            platform_error("data is NULL");
+                        }
+                    }
+                    else
+                    {
+                        err = DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
+                        platform_error("%d instances is invalid", num_instances);
+                    }
+                }
+                else
+                {
+                    err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
+                    platform_error("resource type %d is invalid", type);
+                }
+            }
+            else
+            {
+                err = DATASTORE_STATUS_ERROR_INVALID_ID;
+                platform_error("resource ID %d is invalid", resource_id);
+            }
+        }
+        else
+        {
+            platform_error("private is NULL");
+            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+        }
+    }
+    else
+    {
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+        platform_error("datastore is NULL");
+    }
+    return err;
+}
+
+datastore_resource_t datastore_create_resource(datastore_type_t type, uint32_t num_instances)
+{
+    datastore_resource_t resource = { 0 };
+    if (type >= 0 && type < DATASTORE_TYPE_LAST && type != DATASTORE_TYPE_STRING)
+    {
+        size_t size = TYPE_SIZES[type];
+        void * data = malloc(size * num_instances);
+        if (data != NULL)
+        {
+            memset(data, 0, size * num_instances);
+            resource.data = data;
+            resource.size = size;  // per instance size
+            resource.num_instances = num_instances;
+            resource.type = type;
+            resource._managed = true;
+        }
+        else
+        {
+            platform_error("malloc returned NULL");
+        }
+    }
+    else
+    {
+        platform_error("resource type %d is invalid", type);
+    }
+    return resource;
+}
+
+datastore_resource_t datastore_create_string_resource(size_t length, uint32_t num_instances)
+{
+    datastore_resource_t resource = { 0 };
+    size_t size = length;
+    void * data = malloc(size * num_instances);
+    if (data != NULL)
+    {
+        memset(data, 0, size * num_instances);
+        resource.data = data;
+        resource.size = size;  // per instance size
+        resource.num_instances = num_instances;
+        resource.type = DATASTORE_TYPE_STRING;
+        resource._managed = true;
+    }
+    else
+    {
+        platform_error("malloc returned NULL");
+    }
+    return resource;
+}
+
+datastore_status_t datastore_add_resource(const datastore_t * datastore, datastore_resource_id_t resource_id, const datastore_resource_t resource)
+{
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    const private_t * private = datastore != NULL ? (const private_t *)datastore->private_data : NULL;
+    bool aligned = (resource.flags & DATASTORE_RESOURCE_FLAG_CACHE_ALIGNED) != 0;
+    if (private != NULL && resource._managed && resource.data != NULL
+        && (aligned || private->allocator.alloc != HEAP_ALLOCATOR.alloc))
+    {
+        // move the values into the datastore's allocator, padded if cache-aligned
+        size_t stride = aligned ? _cache_aligned_stride(resource.size) : resource.size;
+        size_t alignment = aligned ? CACHE_LINE_SIZE : ALLOC_ALIGNMENT;
+        uint8_t * data = _alloc(private, stride * resource.num_instances, alignment);
+        if (data != NULL)
+        {
+            memset(data, 0, stride * resource.num_instances);
+            for (uint32_t i = 0; i < resource.num_instances; ++i)
+            {
+                memcpy(data + i * stride, (const uint8_t *)resource.data + i * resource.size, resource.size);
+            }
+            err = _add_resource(datastore, resource_id, resource.type, resource.num_instances, data, resource.size, true, false, resource.flags);
+            if (err == DATASTORE_STATUS_OK)
+            {
+                free(resource.data);
+            }
+            else
+            {
+                _free(private, data, stride * resource.num_instances, alignment);
+            }
+        }
+        else
+        {
+            platform_error("malloc failed");
+            err = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
+        }
+    }
+    else if (private != NULL && aligned)
+    {
+        // only possible if the datastore owns the memory
+        platform_error("cache-aligned resources must be created by datastore_create_resource()");
+        err = DATASTORE_STATUS_ERROR_INVALID_ARGUMENT;
+    }
+    else
+    {
+        err = _add_resource(datastore, resource_id, resource.type, resource.num_instances, resource.data, resource.size, resource._managed, false, resource.flags);
+    }
+    return err;
+}
+
+// Add a resource with zeroed values allocated by the datastore
+static datastore_status_t _add_managed_resource(const datastore_t * datastore, datastore_resource_id_t resource_id, datastore_type_t type, uint32_t num_instances, size_t size)
+{
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    const private_t * private = datastore != NULL ? (const private_t *)datastore->private_data : NULL;
+    if (private != NULL)
+    {
+        void * data = _alloc(private, size * num_instances, ALLOC_ALIGNMENT);
+        if (data != NULL)
+        {
+            memset(data, 0, size * num_instances);
+            err = _add_resource(datastore, resource_id, type, num_instances, data, size, true, false, 0);
+            if (err != DATASTORE_STATUS_OK)
+            {
+                _free(private, data, size * num_instances, ALLOC_ALIGNMENT);
+                data = NULL;
+            }
+        }
+        else
+        {
+            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+            platform_error("malloc returned NULL");
+        }
+    }
+    else
+    {
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+        platform_error("datastore is NULL");
+    }
+    return err;
+}
+
+datastore_status_t datastore_add_fixed_length_resource(const datastore_t * datastore, datastore_resource_id_t resource_id, datastore_type_t type, uint32_t num_instances)
+{
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    size_t size = TYPE_SIZES[type];
+    if (type != DATASTORE_TYPE_STRING)
+    {
+        err = _add_managed_resource(datastore, resource_id, type, num_instances, size);
+    }
+    else
+    {
+        err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
+        platform_error("resource type %d is invalid", type);
+    }
+    return err;
+}
+
+datastore_status_t datastore_add_string_resource(const datastore_t * datastore, datastore_resource_id_t resource_id, uint32_t num_instances, size_t length)
+{
+    return _add_managed_resource(datastore, resource_id, DATASTORE_TYPE_STRING, num_instances, length);
+}
+
+datastore_status_t datastore_add_variable_string_resource(const datastore_t * datastore, datastore_resource_id_t resource_id, uint32_t num_instances, size_t length)
+{
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    const private_t * private = datastore != NULL ? (const private_t *)datastore->private_data : NULL;
+    if (private != NULL)
+    {
+        // slots hold 32-bit offsets
+        if (length > 0 && (num_instances == 0 || length - 1 <= UINT32_MAX / num_instances))
+        {
+            size_t size = _string_heap_size(num_instances);
+            string_heap_t * heap = _alloc(private, size, ALLOC_ALIGNMENT);
+            if (heap != NULL)
+            {
+                memset(heap, 0, size);
+                err = _add_resource(datastore, resource_id, DATASTORE_TYPE_STRING, num_instances, heap, length, true, true, 0);
+                if (err != DATASTORE_STATUS_OK)
+                {
+                    _free(private, heap, size, ALLOC_ALIGNMENT);
+                }
+            }
+            else
+            {
+                platform_error("malloc failed");
+                err = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
+            }
+        }
+        else
+        {
+            platform_error("length %zu is invalid for %u instances", length, num_instances);
+            err = DATASTORE_STATUS_ERROR_INVALID_ARGUMENT;
+        }
+    }
+    else
+    {
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+        platform_error("datastore is NULL");
+    }
+    return err;
+}
+
+// FNV-1a
+static uint32_t _name_hash(const char * name)
+{
+    uint32_t hash = 2166136261u;
+    while (*name != '\0')
+    {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Caller must hold the lock. Returns false if the index needs to grow first.
+static bool _name_index_insert(private_t * private, const char * name, datastore_resource_id_t id)
+{
+    bool inserted = false;
+    if ((private->name_index_used + 1) * 2 <= private->name_index_capacity)
+    {
+        uint32_t hash = _name_hash(name);
+        size_t mask = private->name_index_capacity - 1;
+        size_t i = hash & mask;
+        while (private->name_index[i].id >= 0)
+        {
+            i = (i + 1) & mask;
+        }
+        if (private->name_index[i].id == NAME_SLOT_EMPTY)
+        {
+            ++private->name_index_used;
+        }
+        private->name_index[i].hash = hash;
+        private->name_index[i].id = id;
+        inserted = true;
+    }
+    return inserted;
+}
+
+// Caller must hold the lock. Rebuilds the index without deleted slots, doubling it if required.
+static datastore_status_t _name_index_grow(private_t * private)
+{
+    datastore_status_t err = DATASTORE_STATUS_OK;
+    size_t live = 0;
+    for (size_t i = 0; i < private->name_index_capacity; ++i)
+    {
+        live += private->name_index[i].id >= 0 ? 1 : 0;
+    }
+    size_t capacity = NAME_INDEX_MIN_CAPACITY;
+    while ((live + 1) * 4 > capacity)
+    {
+        capacity *= 2;
+    }
+
+    name_slot_t * old_index = private->name_index;
+    size_t old_capacity = private->name_index_capacity;
+    name_slot_t * new_index = _alloc(private, capacity * sizeof(*new_index), ALLOC_ALIGNMENT);
+    if (new_index != NULL)
+    {
+        for (size_t i = 0; i < capacity; ++i)
+        {
+            new_index[i].hash = 0;
+            new_index[i].id = NAME_SLOT_EMPTY;
+        }
+        private->name_index = new_index;
+        private->name_index_capacity = capacity;
+        private->name_index_used = 0;
+        for (size_t i = 0; i < old_capacity; ++i)
+        {
+            if (old_index[i].id >= 0)
+            {
+                _name_index_insert(private, _get_row(private, old_index[i].id)->name, old_index[i].id);
+            }
+        }
+        _free(private, old_index, old_capacity * sizeof(*old_index), ALLOC_ALIGNMENT);
+    }
+    else
+    {
+        platform_error("malloc failed");
+        err = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
+    }
+    return err;
+}
+
+// Caller must hold the lock.
+static void _name_index_remove(private_t * private, const char * name, datastore_resource_id_t id)
+{
+    if (private->name_index_capacity > 0)
+    {
+        uint32_t hash = _name_hash(name);
+        size_t mask = private->name_index_capacity - 1;
+        for (size_t i = hash & mask; private->name_index[i].id != NAME_SLOT_EMPTY; i = (i + 1) & mask)
+        {
+            if (private->name_index[i].id == id)
+            {
+                private->name_index[i].id = NAME_SLOT_DELETED;
+                break;
+            }
+        }
+    }
+}
+
+// Caller must hold the lock (shared is sufficient).
+static datastore_resource_id_t _name_index_find(const private_t * private, const char * name)
+{
+    datastore_resource_id_t id = NAME_SLOT_EMPTY;
+    if (private->name_index_capacity > 0)
+    {
+        uint32_t hash = _name_hash(name);
+        size_t mask = private->name_index_capacity - 1;
+        for (size_t i = hash & mask; private->name_index[i].id != NAME_SLOT_EMPTY; i = (i + 1) & mask)
+        {
+            if (private->name_index[i].id >= 0 && private->name_index[i].hash == hash
+                && strcmp(_get_row(private, private->name_index[i].id)->name, name) == 0)
+            {
+                id = private->name_index[i].id;
+                break;
+            }
+        }
+    }
+    return id;
+}
+
+datastore_status_t datastore_set_name(const datastore_t * datastore, datastore_resource_id_t resource_id, const char * name)
+{
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    if (datastore != NULL)
+    {
+        private_t * private = (private_t *)datastore->private_data;
+        if (private != NULL)
+        {
+            index_row_t * row = _get_row(private, resource_id);
+            if (row != NULL)
+            {
+                if (name == NULL || !private->is_static || strlen(name) <= private->limits.max_name_length)
+                {
+                    platform_semaphore_take(&private->semaphore);
+                    err = DATASTORE_STATUS_OK;
+
+                    // everything that can fail comes first, so that a failure leaves the old name in place
+                    char * copy = NULL;
+                    if (name != NULL)
+                    {
+                        copy = _alloc(private, _name_alloc_size(private, name), 1);
+                        if (copy != NULL)
+                        {
+                            strcpy(copy, name);
+                            if ((private->name_index_used + 1) * 2 > private->name_index_capacity)
+                            {
+                                err = _name_index_grow(private);
+                                if (err != DATASTORE_STATUS_OK)
+                                {
+                                    _free(private, copy, _name_alloc_size(private, copy), 1);
+                                    copy = NULL;
+                                }
+                            }
+                        }
+                        else
+                        {
+                            platform_error("malloc failed");
+                            err = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
+                        }
+                    }
+
+                    if (err == DATASTORE_STATUS_OK)
+                    {
+                        if (row->name != NULL)
+                        {
+                            _name_index_remove(private, row->name, resource_id);
+                            _free(private, (void *)row->name, _name_alloc_size(private, row->name), 1);
+                        }
+                        row->name = copy;
+                        if (copy != NULL)
+                        {
+                            _name_index_insert(private, copy, resource_id);
+                        }
+                    }
+                    platform_semaphore_give(&private->semaphore);
+                }
+                else
+                {
+                    platform_error("name \"%s\" is longer than %u characters", name, private->limits.max_name_length);
+                    err = DATASTORE_STATUS_ERROR_INVALID_ARGUMENT;
+                }
+            }
+            else
+            {
+                platform_error("id %d is invalid", resource_id);
+                err = DATASTORE_STATUS_ERROR_INVALID_ID;
+            }
+        }
+        else
+        {
+            platform_error("private is NULL");
+            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+        }
+    }
+    else
+    {
+        platform_error("datastore is NULL");
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+    }
+    return err;
+}
+
+const char * datastore_get_name(const datastore_t * datastore, datastore_resource_id_t resource_id)
+{
+    const char * name = NULL;
+    if (datastore != NULL)
+    {
+        private_t * private = (private_t *)datastore->private_data;
+        if (private != NULL)
+        {
+            index_row_t * row = _get_row(private, resource_id);
+            if (row != NULL)
+            {
+                platform_semaphore_take_shared(&private->semaphore);
+                name = row->name;
+                platform_semaphore_give_shared(&private->semaphore);
+            }
+            else
+            {
+                platform_error("id %d is invalid", resource_id);
+            }
+        }
+        else
+        {
+            platform_error("private is NULL");
+        }
+    }
+    else
+    {
+        platform_error("datastore is NULL");
+    }
+    return name;
+}
+
+datastore_status_t datastore_find_by_name(const datastore_t * datastore, const char * name, datastore_resource_id_t * resource_id)
+{
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    if (name != NULL && resource_id != NULL)
+    {
+        if (datastore != NULL)
+        {
+            private_t * private = (private_t *)datastore->private_data;
+            if (private != NULL)
+            {
+                platform_semaphore_take_shared(&private->semaphore);
+                datastore_resource_id_t id = _name_index_find(private, name);
+                platform_semaphore_give_shared(&private->semaphore);
+
+                if (id >= 0)
+                {
+                    *resource_id = id;
+                    err = DATASTORE_STATUS_OK;
+                }
+                else
+                {
+                    platform_debug("name %s not found", name);
+                    err = DATASTORE_STATUS_ERROR_INVALID_ID;
+                }
+            }
+            else
+            {
+                platform_error("private is NULL");
+                err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+            }
+        }
+        else
+        {
+            platform_error("datastore is NULL");
+            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+        }
+    }
+    else
+    {
+        platform_error("name or resource_id is NULL");
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+    }
+    return err;
+}
+
+// Current time in microseconds, from the datastore's clock.
+static uint64_t _now(const private_t * private)
+{
+    return __atomic_load_n(&private->clock, __ATOMIC_RELAXED) == DATASTORE_CLOCK_COARSE ? platform_get_time_coarse() : platform_get_time();
+}
+
+// Timestamp for a write to a row - resources without timestamps keep the "never set" value and never read the clock.
+static uint64_t _timestamp(const private_t * private, const index_row_t * row)
+{
+    return (row->flags & DATASTORE_RESOURCE_FLAG_NO_TIMESTAMP) ? UINT64_MAX : _now(private);
+}
+
+datastore_status_t datastore_get_age(const datastore_t * datastore, datastore_resource_id_t resource_id, datastore_instance_id_t instance, datastore_age_t * age_us)
+{
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    if (age_us != NULL)
+    {
+        if (datastore != NULL)
+        {
+            private_t * private = (private_t *)datastore->private_data;
+            if (private != NULL)
+            {
+                index_row_t * row = _get_row(private, resource_id);
+                if (row != NULL)
+                {
+                    if (instance >= 0 && instance < row->num_instances)
+                    {
+                        platform_semaphore_take_shared(&private->semaphore);
+                        uint64_t timestamp = __atomic_load_n(&row->timestamps[instance], __ATOMIC_RELAXED);
+                        platform_semaphore_give_shared(&private->semaphore);
+
+                        if (timestamp == UINT64_MAX)
+                        {
+                            *age_us = DATASTORE_INVALID_AGE;
+                        }
+                        else
+                        {
+                            *age_us = _now(private) - timestamp;
+                        }
+                        err = DATASTORE_STATUS_OK;
+                    }
+                    else
+                    {
+                        platform_error("instance %d is invalid", instance);
+                        err = DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
+                    }
+                }
+                else
+                {
+                    platform_error("id %d is invalid", resource_id);
+                    err = DATASTORE_STATUS_ERROR_INVALID_ID;
+                }
+            }
+            else
+            {
+                platform_error("private is NULL");
+                err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+            }
+        }
+        else
+        {
+            platform_error("datastore is NULL");
+            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+        }
+    }
+    else
+    {
+        platform_error("age_us is NULL");
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+    }
+    return err;
+}
+
+datastore_status_t datastore_set_clock(const datastore_t * datastore, datastore_clock_t clock)
+{
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    if (datastore != NULL)
+    {
+        private_t * private = (private_t *)datastore->private_data;
+        if (private != NULL)
+        {
+            if (clock >= 0 && clock < DATASTORE_CLOCK_LAST)
+            {
+                __atomic_store_n(&private->clock, clock, __ATOMIC_RELAXED);
+                err = DATASTORE_STATUS_OK;
+            }
+            else
+            {
+                platform_error("clock %d is invalid", clock);
+                err = DATASTORE_STATUS_ERROR_INVALID_ARGUMENT;
+            }
+        }
+        else
+        {
+            platform_error("private is NULL");
+            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+        }
+    }
+    else
+    {
+        platform_error("datastore is NULL");
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+    }
+    return err;
+}
+
+datastore_status_t datastore_find_stale(const datastore_t * datastore, datastore_age_t max_age_us, datastore_stale_t * stale, size_t max_stale, size_t * num_stale)
+{
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    if (datastore != NULL && num_stale != NULL && (stale != NULL || max_stale == 0))
+    {
+        private_t * private = (private_t *)datastore->private_data;
+        if (private != NULL)
+        {
+            // timestamps older than the cutoff are stale; never-set instances hold UINT64_MAX
+            uint64_t now = _now(private);
+            uint64_t cutoff = now > max_age_us ? now - max_age_us : 0;
+            size_t found = 0;
+            size_t cursor = 0;
+            index_row_t * row = NULL;
+            while ((row = _next_row(private, &cursor)) != NULL)
+            {
+                if (!(row->flags & DATASTORE_RESOURCE_FLAG_NO_TIMESTAMP))
+                {
+                    for (datastore_instance_id_t i = 0; i < row->num_instances; ++i)
+                    {
+                        uint64_t timestamp = __atomic_load_n(&row->timestamps[i], __ATOMIC_RELAXED);
+                        if (timestamp < cutoff || timestamp == UINT64_MAX)
+                        {
+                            if (found < max_stale)
+                            {
+                                stale[found].id = row->id;
+                                stale[found].instance = i;
+                                stale[found].age_us = timestamp == UINT64_MAX ? DATASTORE_INVALID_AGE : now - timestamp;
+                            }
+                            ++found;
+                        }
+                    }
+                }
+            }
+            *num_stale = found;
+            err = DATASTORE_STATUS_OK;
+        }
+        else
+        {
+            platform_error("private is NULL");
+            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+        }
+    }
+    else
+    {
+        platform_error("datastore, stale or num_stale is NULL");
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+    }
+    return err;
+}
+
+static void _set_handler(uint8_t * src, uint8_t * dest, size_t len)
+{
+    memcpy(dest, src, len);
+}
+
+// Seqlock write - caller must hold the exclusive lock, so writers are already serialised.
+// Readers see an odd sequence number while the write is in progress.
+static void _seqlock_set_handler(uint32_t * psequence, uint8_t * src, uint8_t * dest, size_t len)
+{
+    uint32_t sequence = *psequence;
+    __atomic_store_n(psequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (size_t i = 0; i < len; ++i)
+    {
+        __atomic_store_n(&dest[i], src[i], __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(psequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+// Seqlock read - retries until a copy is taken that no writer overlapped.
+static void _seqlock_get_handler(const uint32_t * psequence, const uint8_t * src, uint8_t * dest, size_t len)
+{
+    uint32_t before = 0;
+    uint32_t after = 0;
+    do
+    {
+        before = __atomic_load_n(psequence, __ATOMIC_ACQUIRE);
+        for (size_t i = 0; i < len; ++i)
+        {
+            dest[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        after = __atomic_load_n(psequence, __ATOMIC_RELAXED);
+    } while ((before & 1) || before != after);
+}
+
+// Atomic resources are always 1 or 4 byte naturally aligned values, see _is_atomic_compatible().
+static void _atomic_set_handler(uint8_t * src, uint8_t * dest, size_t len)
+{
+    if (len == sizeof(uint32_t))
+    {
+        uint32_t value = 0;
+        memcpy(&value, src, sizeof(value));
+        __atomic_store_n((uint32_t *)dest, value, __ATOMIC_RELEASE);
+    }
+    else
+    {
+        __atomic_store_n(dest, *src, __ATOMIC_RELEASE);
+    }
+}
+
+static void _atomic_get_handler(const uint8_t * src, uint8_t * dest, size_t len)
+{
+    if (len == sizeof(uint32_t))
+    {
+        uint32_t value = __atomic_load_n((const uint32_t *)src, __ATOMIC_ACQUIRE);
+        memcpy(dest, &value, sizeof(value));
+    }
+    else
+    {
+        *dest = __atomic_load_n(src, __ATOMIC_ACQUIRE);
+    }
+}
+
+// Callback lists are read without the lock, so a retired list is only freed once every dispatcher that
+// might have loaded it has finished. Dispatchers pin the current epoch while they walk a list. The epoch
+// only advances when nobody is pinned to the previous one, so two advances after a list is retired,
+// no dispatcher can still hold it. Writers never wait - retired lists are freed by later modifications,
+// or with the datastore.
+static uint32_t _callbacks_enter(private_t * private)
+{
+    uint32_t epoch = 0;
+    for (;;)
+    {
+        epoch = __atomic_load_n(&private->epoch, __ATOMIC_SEQ_CST);
+        __atomic_fetch_add(&private->readers[epoch & 1], 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&private->epoch, __ATOMIC_SEQ_CST) == epoch)
+        {
+            break;
+        }
+        // the epoch moved on before the pin was visible - try again with the new one
+        __atomic_fetch_sub(&private->readers[epoch & 1], 1, __ATOMIC_SEQ_CST);
+    }
+    return epoch;
+}
+
+static void _callbacks_exit(private_t * private, uint32_t epoch)
+{
+    __atomic_fetch_sub(&private->readers[epoch & 1], 1, __ATOMIC_SEQ_CST);
+}
+
+// Publish a new callback list and retire the old one - caller must hold the exclusive lock.
+static void _callbacks_replace(private_t * private, callback_list_t ** slot, callback_list_t * list)
+{
+    callback_list_t * old = *slot;
+    __atomic_store_n(slot, list, __ATOMIC_SEQ_CST);
+    if (old != NULL)
+    {
+        old->retire_epoch = __atomic_load_n(&private->epoch, __ATOMIC_SEQ_CST);
+        old->retired = private->retired_callbacks;
+        private->retired_callbacks = old;
+    }
+
+    // advance the epoch as far as possible, then free what nobody can be reading
+    for (int i = 0; i < 2; ++i)
+    {
+        uint32_t epoch = __atomic_load_n(&private->epoch, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&private->readers[(epoch + 1) & 1], __ATOMIC_SEQ_CST) == 0)
+        {
+            __atomic_store_n(&private->epoch, epoch + 1, __ATOMIC_SEQ_CST);
+        }
+    }
+    uint32_t epoch = __atomic_load_n(&private->epoch, __ATOMIC_SEQ_CST);
+    callback_list_t ** link = &private->retired_callbacks;
+    while (*link != NULL)
+    {
+        callback_list_t * retired = *link;
+        if ((int32_t)(epoch - retired->retire_epoch) >= 2)
+        {
+            *link = retired->retired;
+            _free_callback_list(private, retired);
+        }
+        else
+        {
+            link = &retired->retired;
+        }
+    }
+}
+
+// True if an instance has any callbacks, including resource-wide and store-wide ones. Safe to call without the lock.
+static bool _has_callbacks(const private_t * private, const index_row_t * row, datastore_instance_id_t instance)
+{
+    return __atomic_load_n(&row->instance_callbacks[instance], __ATOMIC_RELAXED) != NULL
+        || __atomic_load_n(&row->callbacks, __ATOMIC_RELAXED) != NULL
+        || __atomic_load_n(&private->callbacks, __ATOMIC_RELAXED) != NULL;
+}
+
+// Load the lists that apply to an instance, broadest first - caller must be in an epoch.
+#define NUM_CALLBACK_LISTS 3
+static void _load_callbacks(const private_t * private, const index_row_t * row, datastore_instance_id_t instance, const callback_list_t * lists[NUM_CALLBACK_LISTS])
+{
+    lists[0] = __atomic_load_n(&private->callbacks, __ATOMIC_SEQ_CST);
+    lists[1] = __atomic_load_n(&row->callbacks, __ATOMIC_SEQ_CST);
+    lists[2] = __atomic_load_n(&row->instance_callbacks[instance], __ATOMIC_SEQ_CST);
+}
+
+// Add an instance to the pending set, unless it is already there. Returns false if it could not be added.
+static bool _mark_pending(private_t * private, index_row_t * row, datastore_resource_id_t id, datastore_instance_id_t instance)
+{
+    bool marked = true;
+    if (!__atomic_exchange_n(&row->dirty[instance], 1, __ATOMIC_ACQ_REL))
+    {
+        platform_mutex_take(&private->pending_lock);
+        // a static datastore doesn't grow the set past max_coalesced, so it stays within the size it was given
+        if (private->num_pending == private->pending_capacity
+            && (!private->is_static || private->pending_capacity < private->limits.max_coalesced))
+        {
+            size_t capacity = private->pending_capacity ? private->pending_capacity * 2 : PENDING_MIN_CAPACITY;
+            pending_t * pending = _alloc(private, capacity * sizeof(*pending), ALLOC_ALIGNMENT);
+            if (pending != NULL)
+            {
+                if (private->num_pending > 0)
+                {
+                    memcpy(pending, private->pending, private->num_pending * sizeof(*pending));
+                }
+                _free(private, private->pending, private->pending_capacity * sizeof(*pending), ALLOC_ALIGNMENT);
+                private->pending = pending;
+                private->pending_capacity = capacity;
+            }
+        }
+        if (private->num_pending < private->pending_capacity)
+        {
+            private->pending[private->num_pending].id = id;
+            private->pending[private->num_pending].instance = instance;
+            ++private->num_pending;
+        }
+        else
+        {
+            platform_error("pending set is full");
+            __atomic_store_n(&row->dirty[instance], 0, __ATOMIC_RELEASE);
+            marked = false;
+        }
+        platform_mutex_give(&private->pending_lock);
+    }
+    return marked;
+}
+
+// Invoke the callbacks for an instance. Coalesced callbacks are deferred to datastore_dispatch_pending(),
+// or called now if the instance cannot be added to the pending set.
+static void _invoke_callbacks(const datastore_t * datastore, index_row_t * row, datastore_resource_id_t id, datastore_instance_id_t instance)
+{
+    private_t * private = (private_t *)datastore->private_data;
+    bool deferred = false;
+    uint32_t epoch = _callbacks_enter(private);
+    const callback_list_t * lists[NUM_CALLBACK_LISTS];
+    _load_callbacks(private, row, instance, lists);
+    for (size_t l = 0; l < NUM_CALLBACK_LISTS; ++l)
+    {
+        for (uint32_t i = 0; lists[l] != NULL && i < lists[l]->count; ++i)
+        {
+            const callback_entry_t * entry = &lists[l]->entries[i];
+            bool invoke = true;
+            if (entry->flags & DATASTORE_CALLBACK_FLAG_COALESCE)
+            {
+                deferred = deferred || _mark_pending(private, row, id, instance);
+                invoke = !deferred;
+            }
+            if (invoke)
+            {
+                platform_debug("invoke callback function %p for id %d, instance %d", entry->func, id, instance);
+                entry->func(datastore, id, instance, entry->context);
+            }
+        }
+    }
+    _callbacks_exit(private, epoch);
+}
+
+static bool _notifier_enqueue(notifier_t * notifier, datastore_resource_id_t id, datastore_instance_id_t instance)
+{
+    uint32_t pos = __atomic_load_n(&notifier->enqueue_pos, __ATOMIC_RELAXED);
+    notification_t * slot = NULL;
+    for (;;)
+    {
+        slot = &notifier->ring[pos & notifier->mask];
+        int32_t diff = (int32_t)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - pos);
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&notifier->enqueue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            return false;  // full
+        }
+        else
+        {
+            pos = __atomic_load_n(&notifier->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+    slot->id = id;
+    slot->instance = instance;
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+static bool _notifier_dequeue(notifier_t * notifier, datastore_resource_id_t * id, datastore_instance_id_t * instance)
+{
+    uint32_t pos = __atomic_load_n(&notifier->dequeue_pos, __ATOMIC_RELAXED);
+    notification_t * slot = NULL;
+    for (;;)
+    {
+        slot = &notifier->ring[pos & notifier->mask];
+        int32_t diff = (int32_t)(__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) - (pos + 1));
+        if (diff == 0)
+        {
+            if (__atomic_compare_exchange_n(&notifier->dequeue_pos, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            return false;  // empty, or the oldest notification is not yet completely written
+        }
+        else
+        {
+            pos = __atomic_load_n(&notifier->dequeue_pos, __ATOMIC_RELAXED);
+        }
+    }
+    *id = slot->id;
+    *instance = slot->instance;
+    __atomic_store_n(&slot->sequence, pos + notifier->mask + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// Take the notification that a count of notifier->items was given for. Returns false only when
+// stopping, which is the only time counts are given without a notification.
+static bool _notifier_take(notifier_t * notifier, datastore_resource_id_t * id, datastore_instance_id_t * instance)
+{
+    bool taken = false;
+    while (!(taken = _notifier_dequeue(notifier, id, instance)) && !__atomic_load_n(&notifier->stopping, __ATOMIC_ACQUIRE))
+    {
+        // a writer has claimed the oldest slot but not yet filled it
+        platform_yield();
+    }
+    if (taken && notifier->backpressure != DATASTORE_BACKPRESSURE_DROP_OLDEST)
+    {
+        platform_counting_semaphore_give(&notifier->slots);
+    }
+    return taken;
+}
+
+static void _notifier_worker(void * arg)
+{
+    notifier_t * notifier = (notifier_t *)arg;
+    const private_t * private = (const private_t *)notifier->datastore->private_data;
+    bool running = true;
+    while (running)
+    {
+        datastore_resource_id_t id = 0;
+        datastore_instance_id_t instance = 0;
+        platform_counting_semaphore_take(&notifier->items);
+        if ((running = _notifier_take(notifier, &id, &instance)))
+        {
+            index_row_t * row = _get_row(private, id);
+            // cleared before the callbacks read the value, so a later write is posted again
+            __atomic_exchange_n(&row->queued[instance], 0, __ATOMIC_ACQ_REL);
+            _invoke_callbacks(notifier->datastore, row, id, instance);
+            __atomic_fetch_sub(&notifier->pending, 1, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+static void _notifier_post(notifier_t * notifier, index_row_t * row, datastore_resource_id_t id, datastore_instance_id_t instance)
+{
+    if (notifier->backpressure == DATASTORE_BACKPRESSURE_COALESCE && __atomic_exchange_n(&row->queued[instance], 1, __ATOMIC_ACQ_REL))
+    {
+        // the worker has not yet picked up the previous notification, and will see the new value
+        __atomic_fetch_add(&notifier->coalesced, 1, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        __atomic_fetch_add(&notifier->pending, 1, __ATOMIC_RELAXED);
+        if (notifier->backpressure == DATASTORE_BACKPRESSURE_DROP_OLDEST)
+        {
+            while (!_notifier_enqueue(notifier, id, instance))
+            {
+                datastore_resource_id_t dropped_id = 0;
+                datastore_instance_id_t dropped_instance = 0;
+                if (platform_counting_semaphore_try_take(&notifier->items) && _notifier_take(notifier, &dropped_id, &dropped_instance))
+                {
+                    __atomic_fetch_add(&notifier->dropped, 1, __ATOMIC_RELAXED);
+                    __atomic_fetch_sub(&notifier->pending, 1, __ATOMIC_RELEASE);
+                }
+                else
+                {
+                    // workers are taking notifications already
+                    platform_yield();
+                }
+            }
+        }
+        else
+        {
+            platform_counting_semaphore_take(&notifier->slots);
+            while (!_notifier_enqueue(notifier, id, instance))
+            {
+                // a worker has claimed a slot but not yet released it
+                platform_yield();
+            }
+        }
+
+        uint32_t depth = __atomic_load_n(&notifier->enqueue_pos, __ATOMIC_RELAXED) - __atomic_load_n(&notifier->dequeue_pos, __ATOMIC_RELAXED);
+        uint32_t high_water = __atomic_load_n(&notifier->high_water, __ATOMIC_RELAXED);
+        while (depth <= notifier->mask + 1 && depth > high_water
+               && !__atomic_compare_exchange_n(&notifier->high_water, &high_water, depth, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+        platform_counting_semaphore_give(&notifier->items);
+    }
+}
+
+// Deliver a set notification for an instance - directly, or via the notifier if one is running.
+static void _notify(const datastore_t * datastore, private_t * private, index_row_t * row, datastore_resource_id_t id, datastore_instance_id_t instance)
+{
+    if (_has_callbacks(private, row, instance))
+    {
+        notifier_t * notifier = __atomic_load_n(&private->notifier, __ATOMIC_ACQUIRE);
+        if (notifier != NULL)
+        {
+            _notifier_post(notifier, row, id, instance);
+        }
+        else
+        {
+            _invoke_callbacks(datastore, row, id, instance);
+        }
+    }
+}
+
+// True if the stored value already equals the first value_size bytes of value - caller must hold the exclusive lock.
+static bool _is_unchanged(const index_row_t * row, const uint8_t * pdest, const void * value, size_t value_size)
+{
+    bool unchanged = false;
+    if (row->flags & DATASTORE_RESOURCE_FLAG_ATOMIC)
+    {
+        // may be concurrently added to without the lock
+        uint8_t current[sizeof(uint32_t)];
+        _atomic_get_handler(pdest, current, row->size);
+        unchanged = memcmp(current, value, row->size) == 0;
+    }
+    else if (row->type == DATASTORE_TYPE_STRING && value_size > 0)
+    {
+        // the stored string is terminated even if the value was truncated to fit
+        unchanged = memcmp(pdest, value, value_size - 1) == 0 && pdest[value_size - 1] == '\0';
+    }
+    else
+    {
+        unchanged = memcmp(pdest, value, value_size) == 0;
+    }
+    return unchanged;
+}
+
+// Store a new timestamp for an instance, and re-arm its expiry if it has been reported stale.
+static void _set_timestamp(private_t * private, index_row_t * row, datastore_instance_id_t instance, uint64_t timestamp)
+{
+    uint64_t ttl_us = __atomic_load_n(&row->ttl_us, __ATOMIC_RELAXED);
+    if (ttl_us == 0)
+    {
+        __atomic_store_n(&row->timestamps[instance], timestamp, __ATOMIC_RELAXED);
+    }
+    else
+    {
+        // ordered against the expiry thread marking the instance stale - at least one of us sees the other
+        __atomic_store_n(&row->timestamps[instance], timestamp, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&row->expired[instance], __ATOMIC_SEQ_CST)
+            && __atomic_exchange_n(&row->expired[instance], 0, __ATOMIC_SEQ_CST))
+        {
+            _expiry_arm(__atomic_load_n(&private->expiry, __ATOMIC_ACQUIRE), timestamp + ttl_us, row->id, instance);
+        }
+    }
+}
+
+// Write a single instance value and its timestamp - caller must hold the exclusive lock.
+// Only value_size bytes are copied, so a short string does not read beyond its terminator.
+// Returns false if the resource suppresses unchanged writes and the value was already stored -
+// the timestamp is still refreshed, but callbacks should not be invoked.
+static bool _store_value(private_t * private, index_row_t * row, datastore_instance_id_t instance, const void * value, size_t value_size, uint64_t timestamp)
+{
+    uint8_t * pdest = (uint8_t *)row->data + instance * row->stride;
+    bool changed = true;
+    if ((row->flags & DATASTORE_RESOURCE_FLAG_SUPPRESS_UNCHANGED) && _is_unchanged(row, pdest, value, value_size))
+    {
+        __atomic_fetch_add(&private->suppressed_writes, 1, __ATOMIC_RELAXED);
+        changed = false;
+    }
+    else if (row->flags & DATASTORE_RESOURCE_FLAG_ATOMIC)
+    {
+        _atomic_set_handler((uint8_t *)value, pdest, row->size);
+    }
+    else if (row->flags & DATASTORE_RESOURCE_FLAG_LOCK_FREE_READS)
+    {
+        _seqlock_set_handler(&row->sequences[instance], (uint8_t *)value, pdest, row->size);
+    }
+    else
+    {
+        _set_handler((uint8_t *)value, pdest, value_size);
+    }
+    _set_timestamp(private, row, instance, timestamp);
+    return changed;
+}
+
+// Per-write flags for batched operations, on the stack unless the batch is large.
+#define LOCAL_FLAGS 64
+
+static bool * _alloc_flags(const private_t * private, bool * local, size_t num_flags)
+{
+    return num_flags <= LOCAL_FLAGS ? local : _alloc(private, num_flags * sizeof(bool), ALLOC_ALIGNMENT);
+}
+
+static void _free_flags(const private_t * private, bool * flags, bool * local, size_t num_flags)
+{
+    if (flags != local)
+    {
+        _free(private, flags, num_flags * sizeof(bool), ALLOC_ALIGNMENT);
+    }
+}
+
+// Set a validated instance and invoke its callbacks
+static void _write_value(const datastore_t * datastore, private_t * private, index_row_t * row, datastore_resource_id_t id, datastore_instance_id_t instance, const void * value, size_t value_size)
+{
+    platform_semaphore_take(&private->semaphore);
+    bool changed = _store_value(private, row, instance, value, value_size, _timestamp(private, row));
+    platform_hexdump((uint8_t *)row->data + instance * row->stride, row->size);
+    platform_semaphore_give(&private->semaphore);
+
+    // call any registered callbacks with new value
+    if (changed)
+    {
+        _notify(datastore, private, row, id, instance);
+    }
+}
+
+// Set a validated variable-length string instance and invoke its callbacks
+static datastore_status_t _write_string(const datastore_t * datastore, private_t * private, index_row_t * row, datastore_resource_id_t id, datastore_instance_id_t instance, const char * value, size_t length)
+{
+    platform_semaphore_take(&private->semaphore);
+    datastore_status_t err = _string_heap_store(private, row, instance, value, length);
+    if (err == DATASTORE_STATUS_OK)
+    {
+        _set_timestamp(private, row, instance, _timestamp(private, row));
+    }
+    platform_semaphore_give(&private->semaphore);
+
+    if (err == DATASTORE_STATUS_OK)
+    {
+        _notify(datastore, private, row, id, instance);
+    }
+    return err;
+}
+
+static datastore_status_t _set_value(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, const void * value, size_t value_size, datastore_type_t expected_type)
+{
+    platform_debug("_set_value: id %d, instance %d, value %p, value_size %zu, expected_type %d", id, instance, value, value_size, expected_type);
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    if (datastore != NULL)
+    {
+        private_t * private = (private_t *)datastore->private_data;
+        if (private != NULL)
+        {
+            index_row_t * row = _get_row(private, id);
+            if (row != NULL)
+            {
+                // check type
+                if (row->type == expected_type)
+                {
+                    // check instance
+                    if (instance >= 0 && instance < row->num_instances)
+                    {
+                        if (value_size <= row->size)
+                        {
+                            if (value != NULL)
+                            {
+                                // finally, set the value
+                                platform_debug("_set_value: id %d, instance %d, value %p, type %d, data %p, size 0x%zx",
+                                       id, instance, value, row->type, row->data, row->size);
+                                if (row->variable_length)
+                                {
+                                    err = _write_string(datastore, private, row, id, instance, (const char *)value, value_size - 1);
+                                }
+                                else
+                                {
+                                    _write_value(datastore, private, row, id, instance, value, value_size);
+                                    err = DATASTORE_STATUS_OK;
+                                }
+                            }
+                            else
+                            {
+                                platform_error("_set_value: value is NULL");
+                                err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+                            }
+                        }
+                        else
+                        {
+                            platform_error("_set_value: value size %zu exceeds allocated size %zu", value_size, row->size);
+                            err = DATASTORE_STATUS_ERROR_TOO_LARGE;
+                        }
+                    }
+                    else
+                    {
+                        platform_error("_set_value: instance %d is invalid", instance);
+                        err = DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
+                    }
+                }
+                else
+                {
+                    platform_error("_set_value: bad type %d (expected %d)", row->type, expected_type);
+                    err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
+                }
+            }
+            else
+            {
+                platform_error("_set_value: id %d is invalid", id);
+                err = DATASTORE_STATUS_ERROR_INVALID_ID;
+            }
+        }
+        else
+        {
+            platform_error("_set_value: private is NULL");
+            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+        }
+    }
+    else
+    {
+        platform_error("_set_value: datastore is NULL");
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+    }
+    return err;
+}
+
+datastore_status_t datastore_set_bool(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, bool value)
+{
+    return _set_value(datastore, id, instance, &value, sizeof(bool), DATASTORE_TYPE_BOOL);
+}
+
+datastore_status_t datastore_set_uint8(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, uint8_t value)
+{
+    return _set_value(datastore, id, instance, &value, sizeof(uint8_t), DATASTORE_TYPE_UINT8);
+}
+
+datastore_status_t datastore_set_uint32(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, uint32_t value)
+{
+    return _set_value(datastore, id, instance, &value, sizeof(uint32_t), DATASTORE_TYPE_UINT32);
+}
+
+datastore_status_t datastore_set_int8(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, int8_t value)
+{
+    return _set_value(datastore, id, instance, &value, sizeof(int8_t), DATASTORE_TYPE_INT8);
+}
+
+datastore_status_t datastore_set_int32(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, int32_t value)
+{
+    return _set_value(datastore, id, instance, &value, sizeof(int32_t), DATASTORE_TYPE_INT32);
+}
+
+datastore_status_t datastore_set_float(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, float value)
+{
+    return _set_value(datastore, id, instance, &value, sizeof(float), DATASTORE_TYPE_FLOAT);
+}
+
+datastore_status_t datastore_set_double(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, double value)
+{
+    return _set_value(datastore, id, instance, &value, sizeof(double), DATASTORE_TYPE_DOUBLE);
+}
+
+datastore_status_t datastore_set_string(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, const char * value)
+{
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    if (value != NULL)
+    {
+        err = _set_value(datastore, id, instance, value, strlen(value) + 1, DATASTORE_TYPE_STRING);
+    }
+    else
+    {
+        platform_error("value is NULL");
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+    }
+    return err;
+}
+
+// Check a single batched write against its resource without modifying anything.
+static datastore_status_t _check_write(const private_t * private, const datastore_write_t * write)
+{
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    index_row_t * row = _get_row(private, write->id);
+    if (row != NULL)
+    {
+        if (row->variable_length)
+        {
+            platform_error("id %d holds variable-length strings", write->id);
+            err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
+        }
+        else if (row->type == write->type)
+        {
+            if (write->instance >= 0 && write->instance < row->num_instances)
+            {
+                if (write->value != NULL)
+                {
+                    if (write->value_size <= row->size && (write->type == DATASTORE_TYPE_STRING || write->value_size == row->size))
+                    {
+                        err = DATASTORE_STATUS_OK;
+                    }
+                    else
+                    {
+                        platform_error("value size %zu does not match allocated size %zu", write->value_size, row->size);
+                        err = DATASTORE_STATUS_ERROR_TOO_LARGE;
+                    }
+                }
+                else
+                {
+                    platform_error("value is NULL");
+                    err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+                }
+            }
+            else
+            {
+                platform_error("instance %d is invalid", write->instance);
+                err = DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
+            }
+        }
+        else
+        {
+            platform_error("bad type %d (expected %d)", row->type, write->type);
+            err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
+        }
+    }
+    else
+    {
+        platform_error("id %d is invalid", write->id);
+        err = DATASTORE_STATUS_ERROR_INVALID_ID;
+    }
+    return err;
+}
+
+// Leave changed set only for the last write in the batch to each instance, and only if it or an earlier
+// write to the same instance changed the stored value. Each instance remembers its latest write so far,
+// which is cleared again afterwards - the caller must hold the exclusive lock.
+static void _changed_instances(const private_t * private, const datastore_write_t * writes, bool * changed, size_t num_writes)
+{
+    for (size_t i = 0; i < num_writes; ++i)
+    {
+        index_row_t * row = _get_row(private, writes[i].id);
+        uint32_t * latest = &row->batch_writes[writes[i].instance];
+        if (*latest != 0)
+        {
+            changed[i] = changed[i] || changed[*latest - 1];
+            changed[*latest - 1] = false;
+        }
+        *latest = (uint32_t)(i + 1);
+    }
+    for (size_t i = 0; i < num_writes; ++i)
+    {
+        _get_row(private, writes[i].id)->batch_writes[writes[i].instance] = 0;
+    }
+}
+
+datastore_status_t datastore_set_batch(const datastore_t * datastore, const datastore_write_t * writes, size_t num_writes)
+{
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    if (datastore != NULL)
+    {
+        private_t * private = (private_t *)datastore->private_data;
+        if (private != NULL)
+        {
+            if (writes != NULL || num_writes == 0)
+            {
+                // validate everything first, so the batch is applied completely or not at all
+                err = DATASTORE_STATUS_OK;
+                for (size_t i = 0; i < num_writes && err == DATASTORE_STATUS_OK; ++i)
+                {
+                    err = _check_write(private, &writes[i]);
+                    if (err != DATASTORE_STATUS_OK)
+                    {
+                        platform_error("write %zu rejected", i);
+                    }
+                }
+
+                if (err == DATASTORE_STATUS_OK && (uint64_t)num_writes > UINT32_MAX)
+                {
+                    platform_error("%zu writes is too many", num_writes);
+                    err = DATASTORE_STATUS_ERROR_TOO_LARGE;
+                }
+
+                bool local[LOCAL_FLAGS];
+                bool * changed = NULL;
+                if (err == DATASTORE_STATUS_OK && num_writes > 0 && (changed = _alloc_flags(private, local, num_writes)) == NULL)
+                {
+                    platform_error("malloc failed");
+                    err = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
+                }
+
+                if (err == DATASTORE_STATUS_OK && num_writes > 0)
+                {
+                    uint64_t now = _now(private);
+                    platform_semaphore_take(&private->semaphore);
+                    for (size_t i = 0; i < num_writes; ++i)
+                    {
+                        index_row_t * row = _get_row(private, writes[i].id);
+                        uint64_t timestamp = (row->flags & DATASTORE_RESOURCE_FLAG_NO_TIMESTAMP) ? UINT64_MAX : now;
+                        changed[i] = _store_value(private, row, writes[i].instance, writes[i].value, writes[i].value_size, timestamp);
+                    }
+                    _changed_instances(private, writes, changed, num_writes);
+                    platform_semaphore_give(&private->semaphore);
+
+                    // callbacks for each changed instance run once, after all values are visible
+                    for (size_t i = 0; i < num_writes; ++i)
+                    {
+                        index_row_t * row = _get_row(private, writes[i].id);
+                        if (changed[i] && _has_callbacks(private, row, writes[i].instance))
+                        {
+                            _notify(datastore, private, row, writes[i].id, writes[i].instance);
+                        }
+                    }
+                    _free_flags(private, changed, local, num_writes);
+                }
+            }
+            else
+            {
+                platform_error("writes is NULL");
+                err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+            }
+        }
+        else
+        {
+            platform_error("private is NULL");
+            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+        }
+    }
+    else
+    {
+        platform_error("datastore is NULL");
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+    }
+    return err;
+}
+
+// Check a contiguous span of instances against its resource, and the buffer that holds them.
+static datastore_status_t _check_range(const private_t * private, datastore_resource_id_t id, datastore_type_t type, datastore_instance_id_t first, uint32_t count, const void * values, size_t values_size, index_row_t ** prow)
+{
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    index_row_t * row = _get_row(private, id);
+    if (row != NULL)
+    {
+        if (row->variable_length)
+        {
+            platform_error("id %d holds variable-length strings", id);
+            err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
+        }
+        else if (row->type == type)
         {
-            for (size_t i = 0; i < private->index_size / sizeof(index_row_t); ++i)
+            if (first >= 0 && first <= row->num_instances && count <= (uint32_t)(row->num_instances - first))
             {
-                // rely on null initialisation of index rows
-                if (private->index_rows[i].managed)
-                {
-                    free(private->index_rows[i].data);
-                }
-                private->index_rows[i].data = NULL;
-
-                for (size_t j = 0; j < private->index_rows[i].num_instances; ++j)
+                if (values != NULL)
                 {
-                    if (private->index_rows[i].instances[j].callbacks != NULL)
+                    if (values_size >= count * row->size)
                     {
-                        callback_entry_t * entry = private->index_rows[i].instances[j].callbacks;
-                        while (entry != NULL)
-                        {
-                            callback_entry_t * next = entry->next;
-                            free(entry);
-                            entry = next;
-                        }
+                        *prow = row;
+                        err = DATASTORE_STATUS_OK;
+                    }
+                    else
+                    {
+                        platform_error("buffer size %zu is too small for %u instances of size %zu", values_size, count, row->size);
+                        err = DATASTORE_STATUS_ERROR_TOO_LARGE;
                     }
                 }
-
-                free((void *)private->index_rows[i].name);
-                private->index_rows[i].name = NULL;
-
-                free(private->index_rows[i].instances);
-                private->index_rows[i].instances = NULL;
+                else
+                {
+                    platform_error("values is NULL");
+                    err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+                }
+            }
+            else
+            {
+                platform_error("%u instances from %d are invalid", count, first);
+                err = DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
             }
-            free(private->index_rows);
-            private->index_rows = NULL;
-            private->index_size = 0;
-            platform_semaphore_delete(private->semaphore);
         }
-
-        platform_debug("free private %p", private);
-        free(private);
-        (*datastore)->private_data = NULL;
-        free(*datastore);
-        *datastore = NULL;
+        else
+        {
+            platform_error("bad type %d (expected %d)", row->type, type);
+            err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
+        }
     }
     else
     {
-        platform_error("invalid pointer");
+        platform_error("id %d is invalid", id);
+        err = DATASTORE_STATUS_ERROR_INVALID_ID;
     }
+    return err;
 }
 
-static datastore_status_t _add_resource(const datastore_t * datastore, datastore_resource_id_t resource_id, datastore_type_t type, uint32_t num_instances, void * data, size_t size, bool managed)
+datastore_status_t datastore_set_range(const datastore_t * datastore, datastore_resource_id_t id, datastore_type_t type, datastore_instance_id_t first, uint32_t count, const void * values, size_t values_size)
 {
     datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
     if (datastore != NULL)
@@ -186,110 +2773,68 @@ static datastore_status_t _add_resource(const datastore_t * datastore, datastore
         private_t * private = (private_t *)datastore->private_data;
         if (private != NULL)
         {
-            if (resource_id >= 0)
+            index_row_t * row = NULL;
+            if ((err = _check_range(private, id, type, first, count, values, values_size, &row)) == DATASTORE_STATUS_OK)
             {
-                if (type >= 0 && type < DATASTORE_TYPE_LAST)
+                uint8_t * pdest = (uint8_t *)row->data + first * row->stride;
+                bool suppress = (row->flags & DATASTORE_RESOURCE_FLAG_SUPPRESS_UNCHANGED) != 0;
+                bool local[LOCAL_FLAGS];
+                bool * changed = suppress ? _alloc_flags(private, local, count) : NULL;
+                if (!suppress || changed != NULL)
                 {
-                    if (num_instances > 0)
+                    uint64_t timestamp = _timestamp(private, row);
+                    platform_semaphore_take(&private->semaphore);
+                    if ((row->flags & (DATASTORE_RESOURCE_FLAG_ATOMIC | DATASTORE_RESOURCE_FLAG_LOCK_FREE_READS | DATASTORE_RESOURCE_FLAG_SUPPRESS_UNCHANGED))
+                        || row->stride != row->size)
                     {
-                        if (data != NULL)
+                        // lock-free readers need each instance written in the way they expect,
+                        // unchanged instances are found one at a time, and padded instances are not contiguous
+                        for (uint32_t i = 0; i < count; ++i)
                         {
-                            platform_semaphore_take(private->semaphore);
-
-                            size_t rows_in_index = private->index_size / sizeof(index_row_t);
-                            if (resource_id >= rows_in_index)
-                            {
-                                // must extend index
-                                size_t new_rows_in_index = resource_id + 1;
-                                size_t old_size = private->index_size;
-                                size_t new_size = new_rows_in_index * sizeof(index_row_t);
-                                platform_debug("extend from %zu to %zu rows, 0x%zx to 0x%zx bytes", rows_in_index, new_rows_in_index, old_size, new_size);
-
-                                index_row_t * tmp = realloc(private->index_rows, new_size);
-                                if (tmp != NULL)
-                                {
-                                    // zero new memory
-                                    if (private->index_rows != NULL)
-                                    {
-                                        memset(tmp + rows_in_index, 0, new_size - old_size);
-                                    }
-                                    else
-                                    {
-                                        memset(tmp, 0, new_size);
-                                    }
-
-                                    private->index_rows = tmp;
-                                    private->index_size = new_size;
-                                }
-                                else
-                                {
-                                    platform_error("realloc failed");
-                                    err = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
-                                    free(data);
-                                    goto out;
-                                }
-                            }
-
-                            // check for overwrite of existing resource
-                            if (private->index_rows[resource_id].data == NULL)
+                            // strings are compared and copied up to their terminator, as for datastore_set_string()
+                            const uint8_t * value = (const uint8_t *)values + i * row->size;
+                            size_t value_size = type == DATASTORE_TYPE_STRING ? strnlen((const char *)value, row->size - 1) + 1 : row->size;
+                            bool stored = _store_value(private, row, first + i, value, value_size, timestamp);
+                            if (changed != NULL)
                             {
-                                platform_debug("register id %d, data %p", resource_id, data);
-                                private->index_rows[resource_id].id = resource_id;
-                                private->index_rows[resource_id].data = data;
-                                private->index_rows[resource_id].name = NULL;
-                                private->index_rows[resource_id].num_instances = num_instances;
-                                private->index_rows[resource_id].size = size;
-                                private->index_rows[resource_id].type = type;
-                                private->index_rows[resource_id].managed = managed;
-
-                                private->index_rows[resource_id].instances = malloc(sizeof(instance_entry_t) * num_instances);
-                                if (private->index_rows[resource_id].instances)
-                                {
-                                    for (size_t i = 0; i < num_instances; ++i)
-                                    {
-                                        private->index_rows[resource_id].instances[i].callbacks = NULL;
-                                        private->index_rows[resource_id].instances[i].timestamp = UINT64_MAX;
-                                    }
-                                }
-                                else
-                                {
-                                    platform_error("malloc failed");
-                                    err = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
-                                }
-                                err = DATASTORE_STATUS_OK;
+                                changed[i] = stored;
                             }
-                            else
+                            if (type == DATASTORE_TYPE_STRING)
                             {
-                                err = DATASTORE_STATUS_ERROR_INVALID_ID;
-                                platform_error("resource already defined");
+                                pdest[i * row->stride + row->size - 1] = '\0';
                             }
-
-                          out:
-                            platform_semaphore_give(private->semaphore);
                         }
-                        else
+                    }
+                    else
+                    {
+                        _set_handler((uint8_t *)values, pdest, count * row->size);
+                        for (uint32_t i = 0; i < count; ++i)
                         {
-                            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
-                            platform_error("data is NULL");
+                            if (type == DATASTORE_TYPE_STRING)
+                            {
+                                // ensure strings are always null-terminated
+                                pdest[(i + 1) * row->size - 1] = '\0';
+                            }
+                            _set_timestamp(private, row, first + i, timestamp);
                         }
                     }
-                    else
+                    platform_semaphore_give(&private->semaphore);
+
+                    for (uint32_t i = 0; i < count; ++i)
                     {
-                        err = DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
-                        platform_error("%d instances is invalid", num_instances);
+                        if (_has_callbacks(private, row, first + i) && (changed == NULL || changed[i]))
+                        {
+                            _notify(datastore, private, row, id, first + i);
+                        }
                     }
+                    _free_flags(private, changed, local, count);
                 }
                 else
                 {
-                    err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
-                    platform_error("resource type %d is invalid", type);
+                    platform_error("malloc failed");
+                    err = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
                 }
             }
-            else
-            {
-                err = DATASTORE_STATUS_ERROR_INVALID_ID;
-                platform_error("resource ID %d is invalid", resource_id);
-            }
         }
         else
         {
@@ -299,519 +2844,520 @@ static datastore_status_t _add_resource(const datastore_t * datastore, datastore
     }
     else
     {
-        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
         platform_error("datastore is NULL");
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
     }
     return err;
 }
 
-datastore_resource_t datastore_create_resource(datastore_type_t type, uint32_t num_instances)
+static void _get_handler(uint8_t * src, uint8_t * dest, size_t len)
 {
-    datastore_resource_t resource = { 0 };
-    if (type >= 0 && type < DATASTORE_TYPE_LAST && type != DATASTORE_TYPE_STRING)
-    {
-        size_t size = TYPE_SIZES[type];
-        void * data = malloc(size * num_instances);
-        if (data != NULL)
-        {
-            memset(data, 0, size * num_instances);
-            resource.data = data;
-            resource.size = size;  // per instance size
-            resource.num_instances = num_instances;
-            resource.type = type;
-            resource._managed = true;
-        }
-        else
-        {
-            platform_error("malloc returned NULL");
-        }
-    }
-    else
-    {
-        platform_error("resource type %d is invalid", type);
-    }
-    return resource;
+    memcpy(dest, src, len);
 }
 
-datastore_resource_t datastore_create_string_resource(size_t length, uint32_t num_instances)
+// Copy out a validated instance, size bytes at most
+static void _read_value(private_t * private, index_row_t * row, datastore_instance_id_t instance, void * value, size_t size)
 {
-    datastore_resource_t resource = { 0 };
-    size_t size = length;
-    void * data = malloc(size * num_instances);
-    if (data != NULL)
+    uint8_t * psrc = (uint8_t *)row->data + instance * row->stride;
+    if (row->variable_length)
     {
-        memset(data, 0, size * num_instances);
-        resource.data = data;
-        resource.size = size;  // per instance size
-        resource.num_instances = num_instances;
-        resource.type = DATASTORE_TYPE_STRING;
-        resource._managed = true;
+        platform_semaphore_take_shared(&private->semaphore);
+        _string_heap_read(row, instance, (char *)value, size);
+        platform_semaphore_give_shared(&private->semaphore);
     }
-    else
+    else if (row->flags & DATASTORE_RESOURCE_FLAG_ATOMIC)
     {
-        platform_error("malloc returned NULL");
+        _atomic_get_handler(psrc, (uint8_t *)value, size);
     }
-    return resource;
-}
-
-datastore_status_t datastore_add_resource(const datastore_t * datastore, datastore_resource_id_t resource_id, const datastore_resource_t resource)
-{
-    return _add_resource(datastore, resource_id, resource.type, resource.num_instances, resource.data, resource.size, resource._managed);
-}
-
-datastore_status_t datastore_add_fixed_length_resource(const datastore_t * datastore, datastore_resource_id_t resource_id, datastore_type_t type, uint32_t num_instances)
-{
-    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
-    size_t size = TYPE_SIZES[type];
-    if (type != DATASTORE_TYPE_STRING)
+    else if (row->flags & DATASTORE_RESOURCE_FLAG_LOCK_FREE_READS)
     {
-        void * data = malloc(size * num_instances);
-        if (data != NULL)
-        {
-            memset(data, 0, size * num_instances);
-            err = _add_resource(datastore, resource_id, type, num_instances, data, size, true);
-            if (err != DATASTORE_STATUS_OK)
-            {
-                free(data);
-                data = NULL;
-            }
-        }
-        else
-        {
-            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
-            platform_error("malloc returned NULL");
-        }
+        _seqlock_get_handler(&row->sequences[instance], psrc, (uint8_t *)value, size);
     }
     else
     {
-        err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
-        platform_error("resource type %d is invalid", type);
-    }
-    return err;
-}
-
-datastore_status_t datastore_add_string_resource(const datastore_t * datastore, datastore_resource_id_t resource_id, uint32_t num_instances, size_t length)
-{
-    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
-    size_t size = length;
-    void * data = malloc(size * num_instances);
-    if (data != NULL)
-    {
-        memset(data, 0, size * num_instances);
-        err = _add_resource(datastore, resource_id, DATASTORE_TYPE_STRING, num_instances, data, size, true);
-        if (err != DATASTORE_STATUS_OK)
+        platform_semaphore_take_shared(&private->semaphore);
+        platform_hexdump(psrc, row->size);
+        _get_handler(psrc, (uint8_t *)value, size);
+        if (row->type == DATASTORE_TYPE_STRING)
         {
-            free(data);
-            data = NULL;
+            // ensure strings are always null-terminated even if truncated
+            ((uint8_t *)value)[size - 1] = '\0';
         }
+        platform_semaphore_give_shared(&private->semaphore);
     }
-    else
-    {
-        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
-        platform_error("malloc returned NULL");
-    }
-    return err;
 }
 
-datastore_status_t datastore_set_name(const datastore_t * datastore, datastore_resource_id_t resource_id, const char * name)
+static datastore_status_t _get_value(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, void * value, size_t value_size, datastore_type_t expected_type)
 {
+    platform_debug("_get_value: id %d, instance %d, value %p, value_size %zu, expected_type %d", id, instance, value, value_size, expected_type);
     datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
     if (datastore != NULL)
     {
         private_t * private = (private_t *)datastore->private_data;
         if (private != NULL)
         {
-            if (resource_id >= 0 && resource_id < private->index_size / sizeof(index_row_t))
+            index_row_t * row = _get_row(private, id);
+            if (row != NULL)
             {
-                platform_semaphore_take(private->semaphore);
-                if (private->index_rows[resource_id].name != NULL)
-                {
-                    free((void *)private->index_rows[resource_id].name);
-                }
-                if (name != NULL)
+                // check type
+                if (row->type == expected_type)
                 {
-                    private->index_rows[resource_id].name = strdup(name);
+                    // check instance
+                    if (instance >= 0 && instance < row->num_instances)
+                    {
+                        if (value)
+                        {
+                            // finally, get the value
+                            platform_debug("_get_value: id %d, instance %d, value %p, type %d, data %p, size 0x%zx",
+                                   id, instance, value, row->type, row->data, row->size);
+                            _read_value(private, row, instance, value, value_size <= row->size ? value_size : row->size);
+                            err = DATASTORE_STATUS_OK;
+                        }
+                        else
+                        {
+                            platform_error("_get_value: value is NULL");
+                            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+                        }
+                    }
+                    else
+                    {
+                        platform_error("_get_value: instance %d is invalid", instance);
+                        err = DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
+                    }
                 }
                 else
                 {
-                    private->index_rows[resource_id].name = NULL;
+                    platform_error("_get_value: bad type %d (expected %d)", row->type, expected_type);
+                    err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
                 }
-                platform_semaphore_give(private->semaphore);
-                err = DATASTORE_STATUS_OK;
             }
             else
             {
-                platform_error("id %d is invalid", resource_id);
+                platform_error("_get_value: id %d is invalid", id);
                 err = DATASTORE_STATUS_ERROR_INVALID_ID;
             }
         }
         else
         {
-            platform_error("private is NULL");
+            platform_error("_get_value: private is NULL");
             err = DATASTORE_STATUS_ERROR_NULL_POINTER;
         }
     }
     else
     {
-        platform_error("datastore is NULL");
+        platform_error("_get_value: datastore is NULL");
         err = DATASTORE_STATUS_ERROR_NULL_POINTER;
     }
     return err;
 }
 
-const char * datastore_get_name(const datastore_t * datastore, datastore_resource_id_t resource_id)
+// Check a single batched read against its resource.
+static datastore_status_t _check_read(const private_t * private, const datastore_read_t * read)
 {
-    const char * name = NULL;
-    if (datastore != NULL)
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    index_row_t * row = _get_row(private, read->id);
+    if (row != NULL)
     {
-        private_t * private = (private_t *)datastore->private_data;
-        if (private != NULL)
+        if (row->type == read->type)
         {
-            if (resource_id >= 0 && resource_id < private->index_size / sizeof(index_row_t))
+            if (read->instance >= 0 && read->instance < row->num_instances)
             {
-                platform_semaphore_take(private->semaphore);
-                name = private->index_rows[resource_id].name;
-                platform_semaphore_give(private->semaphore);
+                if (read->value != NULL)
+                {
+                    if (read->type == DATASTORE_TYPE_STRING ? read->value_size > 0 : read->value_size == row->size)
+                    {
+                        err = DATASTORE_STATUS_OK;
+                    }
+                    else
+                    {
+                        platform_error("value size %zu does not match allocated size %zu", read->value_size, row->size);
+                        err = DATASTORE_STATUS_ERROR_TOO_LARGE;
+                    }
+                }
+                else
+                {
+                    platform_error("value is NULL");
+                    err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+                }
             }
             else
             {
-                platform_error("id %d is invalid", resource_id);
+                platform_error("instance %d is invalid", read->instance);
+                err = DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
             }
         }
         else
         {
-            platform_error("private is NULL");
+            platform_error("bad type %d (expected %d)", row->type, read->type);
+            err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
         }
     }
     else
     {
-        platform_error("datastore is NULL");
+        platform_error("id %d is invalid", read->id);
+        err = DATASTORE_STATUS_ERROR_INVALID_ID;
     }
-    return name;
+    return err;
 }
 
-datastore_status_t datastore_get_age(const datastore_t * datastore, datastore_resource_id_t resource_id, datastore_instance_id_t instance, datastore_age_t * age_us)
+datastore_status_t datastore_get_batch(const datastore_t * datastore, datastore_read_t * reads, size_t num_reads)
 {
     datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
-    if (age_us != NULL)
+    if (datastore != NULL)
     {
-        if (datastore != NULL)
+        private_t * private = (private_t *)datastore->private_data;
+        if (private != NULL)
         {
-            private_t * private = (private_t *)datastore->private_data;
-            if (private != NULL)
+            if (reads != NULL || num_reads == 0)
             {
-                if (resource_id >= 0 && resource_id < private->index_size / sizeof(index_row_t))
+                err = DATASTORE_STATUS_OK;
+                for (size_t i = 0; i < num_reads; ++i)
+                {
+                    reads[i].status = _check_read(private, &reads[i]);
+                    reads[i].age_us = DATASTORE_INVALID_AGE;
+                    if (reads[i].status != DATASTORE_STATUS_OK && err == DATASTORE_STATUS_OK)
+                    {
+                        err = reads[i].status;
+                    }
+                }
+
+                // copy every value and timestamp under one lock, so the reads are a consistent snapshot -
+                // age_us holds the raw timestamp until the lock is released
+                platform_semaphore_take_shared(&private->semaphore);
+                for (size_t i = 0; i < num_reads; ++i)
                 {
-                    if (instance >= 0 && instance < private->index_rows[resource_id].num_instances)
+                    if (reads[i].status == DATASTORE_STATUS_OK)
                     {
-                        if (private->index_rows[resource_id].instances[instance].timestamp == UINT64_MAX)
+                        index_row_t * row = _get_row(private, reads[i].id);
+                        uint8_t * psrc = (uint8_t *)row->data + reads[i].instance * row->stride;
+                        size_t size = reads[i].value_size <= row->size ? reads[i].value_size : row->size;
+                        if (row->variable_length)
                         {
-                            *age_us = DATASTORE_INVALID_AGE;
+                            _string_heap_read(row, reads[i].instance, (char *)reads[i].value, size);
+                        }
+                        else if (row->flags & DATASTORE_RESOURCE_FLAG_ATOMIC)
+                        {
+                            _atomic_get_handler(psrc, (uint8_t *)reads[i].value, size);
                         }
                         else
                         {
-                            *age_us = platform_get_time() - private->index_rows[resource_id].instances[instance].timestamp;
+                            _get_handler(psrc, (uint8_t *)reads[i].value, size);
                         }
-                        err = DATASTORE_STATUS_OK;
-                    }
-                    else
-                    {
-                        platform_error("instance %d is invalid", instance);
-                        err = DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
+                        if (reads[i].type == DATASTORE_TYPE_STRING)
+                        {
+                            ((uint8_t *)reads[i].value)[size - 1] = '\0';
+                        }
+                        reads[i].age_us = __atomic_load_n(&row->timestamps[reads[i].instance], __ATOMIC_RELAXED);
                     }
                 }
-                else
+                platform_semaphore_give_shared(&private->semaphore);
+
+                uint64_t now = _now(private);
+                for (size_t i = 0; i < num_reads; ++i)
                 {
-                    platform_error("id %d is invalid", resource_id);
-                    err = DATASTORE_STATUS_ERROR_INVALID_ID;
+                    if (reads[i].status == DATASTORE_STATUS_OK && reads[i].age_us != UINT64_MAX)
+                    {
+                        reads[i].age_us = now - reads[i].age_us;
+                    }
                 }
             }
             else
             {
-                platform_error("private is NULL");
+                platform_error("reads is NULL");
                 err = DATASTORE_STATUS_ERROR_NULL_POINTER;
             }
         }
         else
         {
-            platform_error("datastore is NULL");
+            platform_error("private is NULL");
             err = DATASTORE_STATUS_ERROR_NULL_POINTER;
         }
     }
     else
     {
-        platform_error("age_us is NULL");
+        platform_error("datastore is NULL");
         err = DATASTORE_STATUS_ERROR_NULL_POINTER;
     }
     return err;
 }
 
-static void _set_handler(uint8_t * src, uint8_t * dest, size_t len)
-{
-    memcpy(dest, src, len);
-}
-
-static datastore_status_t _set_value(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, const void * value, size_t value_size, datastore_type_t expected_type)
+datastore_status_t datastore_get_range(const datastore_t * datastore, datastore_resource_id_t id, datastore_type_t type, datastore_instance_id_t first, uint32_t count, void * values, size_t values_size)
 {
-    platform_debug("_set_value: id %d, instance %d, value %p, value_size %zu, expected_type %d", id, instance, value, value_size, expected_type);
     datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
     if (datastore != NULL)
     {
         private_t * private = (private_t *)datastore->private_data;
         if (private != NULL)
         {
-            if (id >= 0 && id < private->index_size / sizeof(index_row_t))
+            index_row_t * row = NULL;
+            if ((err = _check_range(private, id, type, first, count, values, values_size, &row)) == DATASTORE_STATUS_OK)
             {
-                // check type
-                if (private->index_rows[id].type == expected_type)
+                uint8_t * psrc = (uint8_t *)row->data + first * row->stride;
+                platform_semaphore_take_shared(&private->semaphore);
+                if (row->flags & DATASTORE_RESOURCE_FLAG_ATOMIC)
                 {
-                    // check instance
-                    if (instance >= 0 && instance < private->index_rows[id].num_instances)
+                    for (uint32_t i = 0; i < count; ++i)
                     {
-                        if (value_size <= private->index_rows[id].size)
-                        {
-                            if (value != NULL)
-                            {
-                                // finally, set the value
-                                uint8_t * pdest = (uint8_t *)private->index_rows[id].data + instance * private->index_rows[id].size;
-                                platform_debug("_set_value: id %d, instance %d, value %p, type %d, data %p, size 0x%zx, pdest %p",
-                                       id, instance, value, private->index_rows[id].type, private->index_rows[id].data, private->index_rows[id].size, pdest);
-
-                                platform_semaphore_take(private->semaphore);
-                                _set_handler((uint8_t *)value, pdest, private->index_rows[id].size);
-                                private->index_rows[id].instances[instance].timestamp = platform_get_time();
-                                platform_hexdump(pdest, private->index_rows[id].size);
-                                platform_semaphore_give(private->semaphore);
-
-                                // call any registered callbacks with new value
-                                if (private->index_rows[id].instances[instance].callbacks != NULL)
-                                {
-                                    callback_entry_t * entry = private->index_rows[id].instances[instance].callbacks;
-                                    while (entry != NULL)
-                                    {
-                                        platform_debug("_set_value: invoke callback function %p for id %d, instance %d", entry->func, id, instance);
-                                        entry->func(datastore, id, instance, entry->context);
-                                        entry = entry->next;
-                                    }
-                                }
-
-                                err = DATASTORE_STATUS_OK;
-                            }
-                            else
-                            {
-                                platform_error("_set_value: value is NULL");
-                                err = DATASTORE_STATUS_ERROR_NULL_POINTER;
-                            }
-                        }
-                        else
-                        {
-                            platform_error("_set_value: value size %zu exceeds allocated size %zu", value_size, private->index_rows[id].size);
-                            err = DATASTORE_STATUS_ERROR_TOO_LARGE;
-                        }
+                        _atomic_get_handler(psrc + i * row->stride, (uint8_t *)values + i * row->size, row->size);
                     }
-                    else
+                }
+                else if (row->stride != row->size)
+                {
+                    for (uint32_t i = 0; i < count; ++i)
                     {
-                        platform_error("_set_value: instance %d is invalid", instance);
-                        err = DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
+                        _get_handler(psrc + i * row->stride, (uint8_t *)values + i * row->size, row->size);
                     }
                 }
                 else
                 {
-                    platform_error("_set_value: bad type %d (expected %d)", private->index_rows[id].type, expected_type);
-                    err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
+                    _get_handler(psrc, (uint8_t *)values, count * row->size);
                 }
-            }
-            else
-            {
-                platform_error("_set_value: id %d is invalid", id);
-                err = DATASTORE_STATUS_ERROR_INVALID_ID;
+                platform_semaphore_give_shared(&private->semaphore);
             }
         }
         else
         {
-            platform_error("_set_value: private is NULL");
+            platform_error("private is NULL");
             err = DATASTORE_STATUS_ERROR_NULL_POINTER;
         }
     }
     else
     {
-        platform_error("_set_value: datastore is NULL");
+        platform_error("datastore is NULL");
         err = DATASTORE_STATUS_ERROR_NULL_POINTER;
     }
     return err;
 }
 
-datastore_status_t datastore_set_bool(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, bool value)
-{
-    return _set_value(datastore, id, instance, &value, sizeof(bool), DATASTORE_TYPE_BOOL);
-}
-
-datastore_status_t datastore_set_uint8(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, uint8_t value)
+datastore_status_t datastore_get_bool(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, bool * value)
 {
-    return _set_value(datastore, id, instance, &value, sizeof(uint8_t), DATASTORE_TYPE_UINT8);
+    return _get_value(datastore, id, instance, value, sizeof(*value), DATASTORE_TYPE_BOOL);
 }
 
-datastore_status_t datastore_set_uint32(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, uint32_t value)
+datastore_status_t datastore_get_uint8(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, uint8_t * value)
 {
-    return _set_value(datastore, id, instance, &value, sizeof(uint32_t), DATASTORE_TYPE_UINT32);
+    return _get_value(datastore, id, instance, value, sizeof(*value), DATASTORE_TYPE_UINT8);
 }
 
-datastore_status_t datastore_set_int8(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, int8_t value)
+datastore_status_t datastore_get_uint32(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, uint32_t * value)
 {
-    return _set_value(datastore, id, instance, &value, sizeof(int8_t), DATASTORE_TYPE_INT8);
+    return _get_value(datastore, id, instance, value, sizeof(*value), DATASTORE_TYPE_UINT32);
 }
 
-datastore_status_t datastore_set_int32(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, int32_t value)
+datastore_status_t datastore_get_int8(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, int8_t * value)
 {
-    return _set_value(datastore, id, instance, &value, sizeof(int32_t), DATASTORE_TYPE_INT32);
+    return _get_value(datastore, id, instance, value, sizeof(*value), DATASTORE_TYPE_INT8);
 }
 
-datastore_status_t datastore_set_float(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, float value)
+datastore_status_t datastore_get_int32(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, int32_t * value)
 {
-    return _set_value(datastore, id, instance, &value, sizeof(float), DATASTORE_TYPE_FLOAT);
+    return _get_value(datastore, id, instance, value, sizeof(*value), DATASTORE_TYPE_INT32);
 }
 
-datastore_status_t datastore_set_double(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, double value)
+datastore_status_t datastore_get_float(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, float * value)
 {
-    return _set_value(datastore, id, instance, &value, sizeof(double), DATASTORE_TYPE_DOUBLE);
+    return _get_value(datastore, id, instance, value, sizeof(*value), DATASTORE_TYPE_FLOAT);
 }
 
-datastore_status_t datastore_set_string(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, const char * value)
+datastore_status_t datastore_get_double(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, double * value)
 {
-    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
-    if (value != NULL)
-    {
-        err = _set_value(datastore, id, instance, value, strlen(value) + 1, DATASTORE_TYPE_STRING);
-    }
-    else
-    {
-        platform_error("value is NULL");
-        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
-    }
-    return err;
+    return _get_value(datastore, id, instance, value, sizeof(*value), DATASTORE_TYPE_DOUBLE);
 }
 
-static void _get_handler(uint8_t * src, uint8_t * dest, size_t len)
+datastore_status_t datastore_get_string(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, char * value, size_t value_size)
 {
-    memcpy(dest, src, len);
+    return _get_value(datastore, id, instance, value, value_size, DATASTORE_TYPE_STRING);
 }
 
-static datastore_status_t _get_value(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, void * value, size_t value_size, datastore_type_t expected_type)
+datastore_status_t datastore_resolve(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, datastore_type_t type, datastore_handle_t * handle)
 {
-    platform_debug("_get_value: id %d, instance %d, value %p, value_size %zu, expected_type %d", id, instance, value, value_size, expected_type);
     datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
-    if (datastore != NULL)
+    if (datastore != NULL && handle != NULL)
     {
         private_t * private = (private_t *)datastore->private_data;
         if (private != NULL)
         {
-            if (id >= 0 && id < private->index_size / sizeof(index_row_t))
+            index_row_t * row = _get_row(private, id);
+            if (row != NULL)
             {
-                // check type
-                if (private->index_rows[id].type == expected_type)
+                if (row->variable_length)
                 {
-                    // check instance
-                    if (instance >= 0 && instance < private->index_rows[id].num_instances)
+                    platform_error("id %d holds variable-length strings", id);
+                    err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
+                }
+                else if (row->type == type)
+                {
+                    if (instance >= 0 && instance < row->num_instances)
                     {
-                        if (value)
-                        {
-                            // finally, get the value
-                            uint8_t * psrc = (uint8_t *)private->index_rows[id].data + instance * private->index_rows[id].size;
-                            platform_debug("_get_value: id %d, instance %d, value %p, type %d, data %p, size 0x%zx, psrc %p",
-                                   id, instance, value, private->index_rows[id].type, private->index_rows[id].data, private->index_rows[id].size, psrc);
-                            platform_hexdump(psrc, private->index_rows[id].size);
-
-                            platform_semaphore_take(private->semaphore);
-                            size_t size = value_size <= private->index_rows[id].size ? value_size : private->index_rows[id].size;
-                            _get_handler(psrc, (uint8_t *)value, size);
-                            if (expected_type == DATASTORE_TYPE_STRING)
-                            {
-                                // ensure strings are always null-terminated even if truncated
-                                ((uint8_t *)value)[size - 1] = '\0';
-                            }
-                            platform_semaphore_give(private->semaphore);
-
-                            err = DATASTORE_STATUS_OK;
-                        }
-                        else
-                        {
-                            platform_error("_get_value: value is NULL");
-                            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
-                        }
+                        handle->datastore = datastore;
+                        handle->row = row;
+                        handle->id = id;
+                        handle->instance = instance;
+                        handle->size = row->size;
+                        err = DATASTORE_STATUS_OK;
                     }
                     else
                     {
-                        platform_error("_get_value: instance %d is invalid", instance);
+                        platform_error("instance %d is invalid", instance);
                         err = DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
                     }
                 }
                 else
                 {
-                    platform_error("_get_value: bad type %d (expected %d)", private->index_rows[id].type, expected_type);
+                    platform_error("bad type %d (expected %d)", row->type, type);
                     err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
                 }
             }
             else
             {
-                platform_error("_get_value: id %d is invalid", id);
+                platform_error("id %d is invalid", id);
                 err = DATASTORE_STATUS_ERROR_INVALID_ID;
             }
         }
         else
         {
-            platform_error("_get_value: private is NULL");
+            platform_error("private is NULL");
             err = DATASTORE_STATUS_ERROR_NULL_POINTER;
         }
     }
     else
     {
-        platform_error("_get_value: datastore is NULL");
+        platform_error("datastore or handle is NULL");
         err = DATASTORE_STATUS_ERROR_NULL_POINTER;
     }
     return err;
 }
 
-datastore_status_t datastore_get_bool(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, bool * value)
-{
-    return _get_value(datastore, id, instance, value, sizeof(*value), DATASTORE_TYPE_BOOL);
-}
-
-datastore_status_t datastore_get_uint8(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, uint8_t * value)
+void datastore_handle_get(const datastore_handle_t * handle, void * value)
 {
-    return _get_value(datastore, id, instance, value, sizeof(*value), DATASTORE_TYPE_UINT8);
+    datastore_handle_get_instance(handle, handle->instance, value);
 }
 
-datastore_status_t datastore_get_uint32(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, uint32_t * value)
+void datastore_handle_set(const datastore_handle_t * handle, const void * value)
 {
-    return _get_value(datastore, id, instance, value, sizeof(*value), DATASTORE_TYPE_UINT32);
+    datastore_handle_set_instance(handle, handle->instance, value);
 }
 
-datastore_status_t datastore_get_int8(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, int8_t * value)
+void datastore_handle_get_instance(const datastore_handle_t * handle, datastore_instance_id_t instance, void * value)
 {
-    return _get_value(datastore, id, instance, value, sizeof(*value), DATASTORE_TYPE_INT8);
+    _read_value((private_t *)handle->datastore->private_data, (index_row_t *)handle->row, instance, value, handle->size);
 }
 
-datastore_status_t datastore_get_int32(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, int32_t * value)
+void datastore_handle_set_instance(const datastore_handle_t * handle, datastore_instance_id_t instance, const void * value)
 {
-    return _get_value(datastore, id, instance, value, sizeof(*value), DATASTORE_TYPE_INT32);
+    _write_value(handle->datastore, (private_t *)handle->datastore->private_data, (index_row_t *)handle->row, handle->id, instance, value, handle->size);
 }
 
-datastore_status_t datastore_get_float(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, float * value)
+datastore_status_t datastore_add_set_callback(const datastore_t * datastore, datastore_resource_id_t resource_id, datastore_instance_id_t instance_id, datastore_set_callback callback, void * context)
 {
-    return _get_value(datastore, id, instance, value, sizeof(*value), DATASTORE_TYPE_FLOAT);
+    return datastore_add_set_callback_ex(datastore, resource_id, instance_id, callback, context, 0);
 }
 
-datastore_status_t datastore_get_double(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, double * value)
+// Find the callback list a subscription belongs to: an instance, every instance of a resource, or every resource.
+static datastore_status_t _find_callbacks(private_t * private, datastore_resource_id_t resource_id, datastore_instance_id_t instance_id, callback_list_t *** slot)
 {
-    return _get_value(datastore, id, instance, value, sizeof(*value), DATASTORE_TYPE_DOUBLE);
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    if (resource_id == DATASTORE_RESOURCE_ALL)
+    {
+        if (instance_id == DATASTORE_INSTANCE_ALL)
+        {
+            *slot = &private->callbacks;
+            err = DATASTORE_STATUS_OK;
+        }
+        else
+        {
+            platform_error("instance %d is invalid for all resources", instance_id);
+            err = DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
+        }
+    }
+    else
+    {
+        index_row_t * row = _get_row(private, resource_id);
+        if (row != NULL)
+        {
+            if (instance_id == DATASTORE_INSTANCE_ALL)
+            {
+                *slot = &row->callbacks;
+                err = DATASTORE_STATUS_OK;
+            }
+            else if (instance_id >= 0 && instance_id < row->num_instances)
+            {
+                *slot = &row->instance_callbacks[instance_id];
+                err = DATASTORE_STATUS_OK;
+            }
+            else
+            {
+                platform_error("instance %d is invalid", instance_id);
+                err = DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
+            }
+        }
+        else
+        {
+            platform_error("resource_id %d is invalid", resource_id);
+            err = DATASTORE_STATUS_ERROR_INVALID_ID;
+        }
+    }
+    return err;
 }
 
-datastore_status_t datastore_get_string(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, char * value, size_t value_size)
+datastore_status_t datastore_add_set_callback_ex(const datastore_t * datastore, datastore_resource_id_t resource_id, datastore_instance_id_t instance_id, datastore_set_callback callback, void * context, uint32_t flags)
 {
-    return _get_value(datastore, id, instance, value, value_size, DATASTORE_TYPE_STRING);
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    if (datastore != NULL)
+    {
+        private_t * private = (private_t *)datastore->private_data;
+        if (private != NULL)
+        {
+            callback_list_t ** slot = NULL;
+            if ((flags & DATASTORE_CALLBACK_FLAG_COALESCE) && private->is_static && private->limits.max_coalesced == 0)
+            {
+                platform_error("coalesced callbacks need max_coalesced in the static configuration");
+                err = DATASTORE_STATUS_ERROR_INVALID_ARGUMENT;
+            }
+            else if ((err = _find_callbacks(private, resource_id, instance_id, &slot)) == DATASTORE_STATUS_OK)
+            {
+                platform_semaphore_take(&private->semaphore);
+                uint32_t count = *slot != NULL ? (*slot)->count : 0;
+                callback_list_t * list = _alloc(private, _callback_list_size(count + 1), ALLOC_ALIGNMENT);
+                if (list != NULL)
+                {
+                    // new callbacks go at the end
+                    list->retired = NULL;
+                    list->retire_epoch = 0;
+                    list->count = count + 1;
+                    if (count > 0)
+                    {
+                        memcpy(list->entries, (*slot)->entries, count * sizeof(callback_entry_t));
+                    }
+                    list->entries[count].func = callback;
+                    list->entries[count].context = context;
+                    list->entries[count].flags = flags;
+                    _callbacks_replace(private, slot, list);
+                    err = DATASTORE_STATUS_OK;
+                }
+                else
+                {
+                    platform_error("malloc failed");
+                    err = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
+                }
+                platform_semaphore_give(&private->semaphore);
+            }
+        }
+        else
+        {
+            platform_error("private is NULL");
+            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+        }
+    }
+    else
+    {
+        platform_error("datastore is NULL");
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+    }
+    return err;
 }
 
-datastore_status_t datastore_add_set_callback(const datastore_t * datastore, datastore_resource_id_t resource_id, datastore_instance_id_t instance_id, datastore_set_callback callback, void * context)
+datastore_status_t datastore_remove_set_callback(const datastore_t * datastore, datastore_resource_id_t resource_id, datastore_instance_id_t instance_id, datastore_set_callback callback, void * context)
 {
     datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
     if (datastore != NULL)
@@ -819,54 +3365,128 @@ datastore_status_t datastore_add_set_callback(const datastore_t * datastore, dat
         private_t * private = (private_t *)datastore->private_data;
         if (private != NULL)
         {
-            if (resource_id >= 0 && resource_id < private->index_size / sizeof(index_row_t))
+            callback_list_t ** slot = NULL;
+            if ((err = _find_callbacks(private, resource_id, instance_id, &slot)) == DATASTORE_STATUS_OK)
             {
-                if (instance_id >= 0 && instance_id < private->index_rows[resource_id].num_instances)
+                platform_semaphore_take(&private->semaphore);
+                callback_list_t * old = *slot;
+                uint32_t count = old != NULL ? old->count : 0;
+                uint32_t index = 0;
+                while (index < count && (old->entries[index].func != callback || old->entries[index].context != context))
+                {
+                    ++index;
+                }
+
+                if (index == count)
+                {
+                    platform_error("callback %p, context %p is not registered for id %d, instance %d", callback, context, resource_id, instance_id);
+                    err = DATASTORE_STATUS_ERROR_INVALID_ARGUMENT;
+                }
+                else if (count == 1)
                 {
-                    if (private->index_rows[resource_id].instances[instance_id].callbacks == NULL)
+                    _callbacks_replace(private, slot, NULL);
+                    err = DATASTORE_STATUS_OK;
+                }
+                else
+                {
+                    callback_list_t * list = _alloc(private, _callback_list_size(count - 1), ALLOC_ALIGNMENT);
+                    if (list != NULL)
                     {
-                        private->index_rows[resource_id].instances[instance_id].callbacks = malloc(sizeof(*private->index_rows[resource_id].instances[instance_id].callbacks));
-                        private->index_rows[resource_id].instances[instance_id].callbacks->next = NULL;
-                        private->index_rows[resource_id].instances[instance_id].callbacks->func = callback;
-                        private->index_rows[resource_id].instances[instance_id].callbacks->context = context;
+                        list->retired = NULL;
+                        list->retire_epoch = 0;
+                        list->count = count - 1;
+                        memcpy(list->entries, old->entries, index * sizeof(callback_entry_t));
+                        memcpy(&list->entries[index], &old->entries[index + 1], (count - index - 1) * sizeof(callback_entry_t));
+                        _callbacks_replace(private, slot, list);
+                        err = DATASTORE_STATUS_OK;
                     }
                     else
                     {
-                        // find end of list
-                        callback_entry_t * entry = private->index_rows[resource_id].instances[instance_id].callbacks;
-                        while (entry->next != NULL)
-                        {
-                            entry = entry->next;
-                        }
-
-                        entry->next = malloc(sizeof(*private->index_rows[resource_id].instances[instance_id].callbacks));
-                        entry->next->next = NULL;
-                        entry->next->func = callback;
-                        entry->next->context = context;
+                        platform_error("malloc failed");
+                        err = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
                     }
-                    err = DATASTORE_STATUS_OK;
                 }
-                else
+                platform_semaphore_give(&private->semaphore);
+            }
+        }
+        else
+        {
+            platform_error("private is NULL");
+            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+        }
+    }
+    else
+    {
+        platform_error("datastore is NULL");
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+    }
+    return err;
+}
+
+datastore_status_t datastore_dispatch_pending(const datastore_t * datastore)
+{
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    if (datastore != NULL)
+    {
+        private_t * private = (private_t *)datastore->private_data;
+        if (private != NULL)
+        {
+            // take the whole set, so callbacks that write to the datastore start the next one
+            platform_mutex_take(&private->pending_lock);
+            pending_t * pending = private->pending;
+            size_t num_pending = private->num_pending;
+            size_t capacity = private->pending_capacity;
+            private->pending = NULL;
+            private->num_pending = 0;
+            private->pending_capacity = 0;
+            platform_mutex_give(&private->pending_lock);
+
+            for (size_t i = 0; i < num_pending; ++i)
+            {
+                index_row_t * row = _get_row(private, pending[i].id);
+                datastore_instance_id_t instance = pending[i].instance;
+                // cleared before the callbacks read the value, so a later write marks it again
+                __atomic_exchange_n(&row->dirty[instance], 0, __ATOMIC_ACQ_REL);
+                uint32_t epoch = _callbacks_enter(private);
+                const callback_list_t * lists[NUM_CALLBACK_LISTS];
+                _load_callbacks(private, row, instance, lists);
+                for (size_t l = 0; l < NUM_CALLBACK_LISTS; ++l)
                 {
-                    platform_error("_get_value: instance %d is invalid", instance_id);
-                    err = DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
+                    for (uint32_t j = 0; lists[l] != NULL && j < lists[l]->count; ++j)
+                    {
+                        const callback_entry_t * entry = &lists[l]->entries[j];
+                        if (entry->flags & DATASTORE_CALLBACK_FLAG_COALESCE)
+                        {
+                            platform_debug("invoke coalesced callback function %p for id %d, instance %d", entry->func, pending[i].id, instance);
+                            entry->func(datastore, pending[i].id, instance, entry->context);
+                        }
+                    }
                 }
+                _callbacks_exit(private, epoch);
             }
-            else
+
+            // keep the allocation for next time, unless the set has already been started again
+            platform_mutex_take(&private->pending_lock);
+            if (private->pending == NULL)
             {
-                platform_error("_get_value: resource_id %d is invalid", resource_id);
-                err = DATASTORE_STATUS_ERROR_INVALID_ID;
+                private->pending = pending;
+                private->pending_capacity = capacity;
+                pending = NULL;
             }
+            platform_mutex_give(&private->pending_lock);
+            _free(private, pending, capacity * sizeof(*pending), ALLOC_ALIGNMENT);
+
+            err = DATASTORE_STATUS_OK;
         }
         else
         {
-            platform_error("_get_value: private is NULL");
+            platform_error("private is NULL");
             err = DATASTORE_STATUS_ERROR_NULL_POINTER;
         }
     }
     else
     {
-        platform_error("_get_value: datastore is NULL");
+        platform_error("datastore is NULL");
         err = DATASTORE_STATUS_ERROR_NULL_POINTER;
     }
     return err;
@@ -880,9 +3500,10 @@ uint32_t datastore_num_instances(const datastore_t * datastore, datastore_resour
         private_t * private = (private_t *)datastore->private_data;
         if (private != NULL)
         {
-            if (resource_id >= 0 && resource_id < private->index_size / sizeof(index_row_t))
+            index_row_t * row = _get_row(private, resource_id);
+            if (row != NULL)
             {
-                num_instances = private->index_rows[resource_id].num_instances;
+                num_instances = row->num_instances;
             }
             else
             {
@@ -911,76 +3532,89 @@ datastore_status_t _to_string(const datastore_t * datastore, datastore_resource_
         {
             if (buffer != NULL)
             {
-                if (id >= 0 && id < private->index_size / sizeof(index_row_t))
+                index_row_t * row = _get_row(private, id);
+                if (row != NULL)
                 {
-                    switch (private->index_rows[id].type)
-                    {
-                    case DATASTORE_TYPE_BOOL:
-                    {
-                        bool value = 0;
-                        datastore_get_bool(datastore, id, instance, &value);
-                        snprintf(buffer, buffer_size, "%s", value ? "true" : "false");
-                        err = DATASTORE_STATUS_OK;
-                        break;
-                    }
-                    case DATASTORE_TYPE_UINT8:
-                    {
-                        uint8_t value = 0;
-                        datastore_get_uint8(datastore, id, instance, &value);
-                        snprintf(buffer, buffer_size, "%u", value);
-                        err = DATASTORE_STATUS_OK;
-                        break;
-                    }
-                    case DATASTORE_TYPE_UINT32:
-                    {
-                        uint32_t value = 0;
-                        datastore_get_uint32(datastore, id, instance, &value);
-                        snprintf(buffer, buffer_size, "%u", value);
-                        err = DATASTORE_STATUS_OK;
-                        break;
-                    }
-                    case DATASTORE_TYPE_INT8:
-                    {
-                        int8_t value = 0;
-                        datastore_get_int8(datastore, id, instance, &value);
-                        snprintf(buffer, buffer_size, "%d", value);
-                        err = DATASTORE_STATUS_OK;
-                        break;
-                    }
-                    case DATASTORE_TYPE_INT32:
-                    {
-                        int32_t value = 0;
-                        datastore_get_int32(datastore, id, instance, &value);
-                        snprintf(buffer, buffer_size, "%d", value);
-                        err = DATASTORE_STATUS_OK;
-                        break;
-                    }
-                    case DATASTORE_TYPE_FLOAT:
+                    if (instance >= 0 && instance < row->num_instances)
                     {
-                        float value = 0.0f;
-                        datastore_get_float(datastore, id, instance, &value);
-                        snprintf(buffer, buffer_size, "%g", value);
-                        err = DATASTORE_STATUS_OK;
-                        break;
-                    }
-                    case DATASTORE_TYPE_DOUBLE:
-                    {
-                        double value = 0.0;
-                        datastore_get_double(datastore, id, instance, &value);
-                        snprintf(buffer, buffer_size, "%g", value);
+                        // take a copy of the value under a single shared lock, then format it outside the lock
+                        union
+                        {
+                            bool b;
+                            uint8_t u8;
+                            uint32_t u32;
+                            int8_t i8;
+                            int32_t i32;
+                            float f;
+                            double d;
+                        } value = { 0 };
+
+                        platform_semaphore_take_shared(&private->semaphore);
+                        const uint8_t * psrc = (const uint8_t *)row->data + instance * row->stride;
+                        if (row->type == DATASTORE_TYPE_STRING)
+                        {
+                            if (buffer_size > 0)
+                            {
+                                size_t size = buffer_size <= row->size ? buffer_size : row->size;
+                                if (row->variable_length)
+                                {
+                                    _string_heap_read(row, instance, buffer, size);
+                                }
+                                else
+                                {
+                                    memcpy(buffer, psrc, size);
+                                    buffer[size - 1] = '\0';
+                                }
+                            }
+                        }
+                        else if (row->flags & DATASTORE_RESOURCE_FLAG_ATOMIC)
+                        {
+                            // may be concurrently modified by datastore_add() without the lock
+                            _atomic_get_handler(psrc, (uint8_t *)&value, row->size);
+                        }
+                        else if (row->size <= sizeof(value))
+                        {
+                            memcpy(&value, psrc, row->size);
+                        }
+                        platform_semaphore_give_shared(&private->semaphore);
+
                         err = DATASTORE_STATUS_OK;
-                        break;
+                        switch (row->type)
+                        {
+                        case DATASTORE_TYPE_BOOL:
+                            snprintf(buffer, buffer_size, "%s", value.b ? "true" : "false");
+                            break;
+                        case DATASTORE_TYPE_UINT8:
+                            snprintf(buffer, buffer_size, "%u", value.u8);
+                            break;
+                        case DATASTORE_TYPE_UINT32:
+                            snprintf(buffer, buffer_size, "%u", value.u32);
+                            break;
+                        case DATASTORE_TYPE_INT8:
+                            snprintf(buffer, buffer_size, "%d", value.i8);
+                            break;
+                        case DATASTORE_TYPE_INT32:
+                            snprintf(buffer, buffer_size, "%d", value.i32);
+                            break;
+                        case DATASTORE_TYPE_FLOAT:
+                            snprintf(buffer, buffer_size, "%g", value.f);
+                            break;
+                        case DATASTORE_TYPE_DOUBLE:
+                            snprintf(buffer, buffer_size, "%g", value.d);
+                            break;
+                        case DATASTORE_TYPE_STRING:
+                            // already copied
+                            break;
+                        default:
+                            platform_error("unhandled type %d", row->type);
+                            err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
+                            break;
+                        }
                     }
-                    case DATASTORE_TYPE_STRING:
+                    else
                     {
-                        datastore_get_string(datastore, id, instance, buffer, buffer_size);
-                        err = DATASTORE_STATUS_OK;
-                        break;
-                    }
-                    default:
-                        platform_error("unhandled type %d", private->index_rows[id].type);
-                        err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
-                        break;
+                        platform_error("instance %d is invalid", instance);
+                        err = DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
                     }
                 }
                 else
@@ -1017,9 +3651,10 @@ datastore_status_t datastore_get_as_string(const datastore_t * datastore, datast
         private_t * private = (private_t *)datastore->private_data;
         if (private != NULL)
         {
-            if (id >= 0 && id < private->index_size / sizeof(index_row_t))
+            index_row_t * row = _get_row(private, id);
+            if (row != NULL)
             {
-                if (instance >= 0 && instance < private->index_rows[id].num_instances)
+                if (instance >= 0 && instance < row->num_instances)
                 {
                     err = _to_string(datastore, id, instance, buffer, buffer_size);
                     if (err != DATASTORE_STATUS_OK)
@@ -1066,9 +3701,10 @@ datastore_status_t _from_string(const datastore_t * datastore, datastore_resourc
         {
             if (buffer != NULL)
             {
-                if (id >= 0 && id < private->index_size / sizeof(index_row_t))
+                index_row_t * row = _get_row(private, id);
+                if (row != NULL)
                 {
-                    switch (private->index_rows[id].type)
+                    switch (row->type)
                     {
                     case DATASTORE_TYPE_BOOL:
                     {
@@ -1174,7 +3810,7 @@ datastore_status_t _from_string(const datastore_t * datastore, datastore_resourc
                         break;
                     }
                     default:
-                        platform_error("unhandled type %d", private->index_rows[id].type);
+                        platform_error("unhandled type %d", row->type);
                         err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
                         break;
                     }
@@ -1187,53 +3823,431 @@ datastore_status_t _from_string(const datastore_t * datastore, datastore_resourc
             }
             else
             {
-                platform_error("buffer is NULL");
-                err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+                platform_error("buffer is NULL");
+                err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+            }
+        }
+        else
+        {
+            platform_error("private is NULL");
+            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+        }
+    }
+    else
+    {
+        platform_error("datastore is NULL");
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+    }
+    return err;
+}
+
+datastore_status_t datastore_set_as_string(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, const char * buffer)
+{
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    if (datastore != NULL)
+    {
+        private_t * private = (private_t *)datastore->private_data;
+        if (private != NULL)
+        {
+            index_row_t * row = _get_row(private, id);
+            if (row != NULL)
+            {
+                if (instance >= 0 && instance < row->num_instances)
+                {
+                    err = _from_string(datastore, id, instance, buffer);
+                    if (err != DATASTORE_STATUS_OK)
+                    {
+                        platform_error("Error %d", err);
+                    }
+
+                }
+                else
+                {
+                    platform_error("instance %d is invalid", instance);
+                    err = DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
+                }
+            }
+            else
+            {
+                platform_error("id %d is invalid", id);
+                err = DATASTORE_STATUS_ERROR_INVALID_ID;
+            }
+        }
+        else
+        {
+            platform_error("private is NULL");
+            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+        }
+    }
+    else
+    {
+        platform_error("datastore is NULL");
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+    }
+    return err;
+}
+
+datastore_status_t datastore_dump(const datastore_t * datastore)
+{
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    if (datastore != NULL)
+    {
+        private_t * private = (private_t *)datastore->private_data;
+        if (private != NULL)
+        {
+            err = DATASTORE_STATUS_OK;
+            platform_info("ID NAME                                INSTANCE SIZE [VALUE] (AGE)");
+            size_t cursor = 0;
+            index_row_t * row = NULL;
+            while (err == DATASTORE_STATUS_OK && (row = _next_row(private, &cursor)) != NULL)
+            {
+                datastore_resource_id_t id = row->id;
+                for (datastore_instance_id_t instance = 0; err == DATASTORE_STATUS_OK && instance < row->num_instances; ++instance)
+                {
+                    char value[256] = "";
+                    err = _to_string(datastore, id, instance, value, 256);
+                    datastore_age_t age = 0;
+                    datastore_get_age(datastore, id, instance, &age);
+                    if (age == DATASTORE_INVALID_AGE)
+                    {
+                        platform_info("%2d %-40s %3d %4zu []", id, row->name, instance, row->size);
+                    }
+                    else
+                    {
+                        platform_info("%2d %-40s %3d %4zu [%s] (%0.2fs)", id, row->name, instance, row->size, value, age / 1000000.0);
+                    }
+                }
+                if (err != DATASTORE_STATUS_OK)
+                {
+                    platform_error("Error %d", err);
+                }
+            }
+        }
+        else
+        {
+            platform_error("private is NULL");
+            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+        }
+    }
+    else
+    {
+        platform_error("datastore is NULL");
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+    }
+    return err;
+}
+
+// Integers and bools can be added to, see _add_handler()
+static bool _is_addable(datastore_type_t type)
+{
+    bool addable = false;
+    switch (type)
+    {
+    case DATASTORE_TYPE_BOOL:
+    case DATASTORE_TYPE_UINT8:
+    case DATASTORE_TYPE_INT8:
+    case DATASTORE_TYPE_UINT32:
+    case DATASTORE_TYPE_INT32:
+        addable = true;
+        break;
+    default:
+        break;
+    }
+    return addable;
+}
+
+// Add to a value in place. Integers wrap, and a bool is toggled by any non-zero addend.
+static datastore_status_t _add_handler(datastore_type_t type, uint8_t * pvalue, int64_t addend)
+{
+    datastore_status_t err = DATASTORE_STATUS_OK;
+    switch (type)
+    {
+        case DATASTORE_TYPE_UINT8:
+        case DATASTORE_TYPE_INT8:
+        {
+            uint8_t value = 0;
+            memcpy(&value, pvalue, sizeof(value));
+            value += addend;
+            memcpy(pvalue, &value, sizeof(value));
+            break;
+        }
+        case DATASTORE_TYPE_UINT32:
+        case DATASTORE_TYPE_INT32:
+        {
+            uint32_t value = 0;
+            memcpy(&value, pvalue, sizeof(value));
+            value += addend;
+            memcpy(pvalue, &value, sizeof(value));
+            break;
+        }
+        case DATASTORE_TYPE_BOOL:
+        {
+            bool value = false;
+            memcpy(&value, pvalue, sizeof(value));
+            value = !value;
+            memcpy(pvalue, &value, sizeof(value));
+            break;
+        }
+        default:
+            platform_error("Cannot increment type %d", type);
+            err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
+            break;
+    }
+    return err;
+}
+
+// Lock-free add using hardware atomics, see _is_atomic_compatible().
+static void _atomic_add_handler(datastore_type_t type, uint8_t * pvalue, int64_t addend)
+{
+    switch (type)
+    {
+        case DATASTORE_TYPE_UINT8:
+        case DATASTORE_TYPE_INT8:
+            __atomic_fetch_add(pvalue, (uint8_t)addend, __ATOMIC_ACQ_REL);
+            break;
+        case DATASTORE_TYPE_UINT32:
+        case DATASTORE_TYPE_INT32:
+            __atomic_fetch_add((uint32_t *)pvalue, (uint32_t)addend, __ATOMIC_ACQ_REL);
+            break;
+        case DATASTORE_TYPE_BOOL:
+            __atomic_fetch_xor(pvalue, 1, __ATOMIC_ACQ_REL);
+            break;
+        default:
+            break;
+    }
+}
+
+datastore_status_t _add(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, int64_t addend)
+{
+    platform_debug("_add: id %d, instance %d", id, instance);
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    if (datastore != NULL)
+    {
+        private_t * private = (private_t *)datastore->private_data;
+        if (private != NULL)
+        {
+            index_row_t * row = _get_row(private, id);
+            if (row != NULL)
+            {
+                if (instance >= 0 && instance < row->num_instances)
+                {
+                    // a zero doesn't change anything - no callbacks are invoked
+                    err = DATASTORE_STATUS_OK;
+                    if (addend != 0)
+                    {
+                        // check the type before touching the value - strings may be shorter than the copy below,
+                        // and variable-length strings are not stored at their instance's offset at all
+                        uint8_t * pdata = (uint8_t *)row->data + instance * row->stride;
+                        if (!_is_addable(row->type))
+                        {
+                            platform_error("Cannot increment type %d", row->type);
+                            err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
+                        }
+                        else if (row->flags & DATASTORE_RESOURCE_FLAG_ATOMIC)
+                        {
+                            // no lock required - concurrent adds are never lost
+                            _atomic_add_handler(row->type, pdata, addend);
+                            _set_timestamp(private, row, instance, _timestamp(private, row));
+                        }
+                        else
+                        {
+                            // read-modify-write under a single exclusive lock so that concurrent adds are not lost
+                            uint8_t value[sizeof(uint64_t)];
+                            platform_semaphore_take(&private->semaphore);
+                            memcpy(value, pdata, row->size);
+                            err = _add_handler(row->type, value, addend);
+                            if (err == DATASTORE_STATUS_OK)
+                            {
+                                if (row->flags & DATASTORE_RESOURCE_FLAG_LOCK_FREE_READS)
+                                {
+                                    _seqlock_set_handler(&row->sequences[instance], value, pdata, row->size);
+                                }
+                                else
+                                {
+                                    _set_handler(value, pdata, row->size);
+                                }
+                                _set_timestamp(private, row, instance, _timestamp(private, row));
+                            }
+                            platform_semaphore_give(&private->semaphore);
+                        }
+
+                        if (err == DATASTORE_STATUS_OK)
+                        {
+                            _notify(datastore, private, row, id, instance);
+                        }
+                    }
+                }
+                else
+                {
+                    platform_error("increment: instance %d is invalid", instance);
+                    err = DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
+                }
+            }
+            else
+            {
+                platform_error("increment: id %d is invalid", id);
+                err = DATASTORE_STATUS_ERROR_INVALID_ID;
+            }
+        }
+        else
+        {
+            platform_error("increment: private is NULL");
+            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+        }
+    }
+    else
+    {
+        platform_error("increment: datastore is NULL");
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+    }
+    return err;
+}
+
+datastore_status_t datastore_add(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, int64_t addend)
+{
+    platform_debug("datastore_increment: id %d, instance %d", id, instance);
+    return _add(datastore, id, instance, addend);
+}
+
+datastore_status_t datastore_increment(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance)
+{
+    platform_debug("datastore_increment: id %d, instance %d", id, instance);
+    return _add(datastore, id, instance, 1);
+}
+
+size_t datastore_get_ram_usage(const datastore_t * datastore)
+{
+    // only stored data, not including overhead
+    uint32_t usage = 0;
+    if (datastore != NULL)
+    {
+        private_t * private = (private_t *)datastore->private_data;
+        if (private != NULL)
+        {
+            size_t cursor = 0;
+            index_row_t * row = NULL;
+            while ((row = _next_row(private, &cursor)) != NULL)
+            {
+                usage += row->variable_length ? _string_heap_usage(row) : row->stride * row->num_instances;
             }
         }
         else
         {
             platform_error("private is NULL");
-            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
         }
     }
     else
     {
         platform_error("datastore is NULL");
-        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
     }
-    return err;
+    return usage;
 }
 
-datastore_status_t datastore_set_as_string(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, const char * buffer)
+static void _notifier_flush(notifier_t * notifier)
+{
+    while (__atomic_load_n(&notifier->pending, __ATOMIC_ACQUIRE) != 0)
+    {
+        platform_yield();
+    }
+}
+
+// Stops and frees a notifier, with or without its workers having been started.
+static void _notifier_stop_workers(const private_t * private, notifier_t * notifier, uint32_t num_started)
+{
+    __atomic_store_n(&notifier->stopping, true, __ATOMIC_RELEASE);
+    for (uint32_t i = 0; i < num_started; ++i)
+    {
+        platform_counting_semaphore_give(&notifier->items);
+    }
+    for (uint32_t i = 0; i < num_started; ++i)
+    {
+        platform_thread_join(&notifier->workers[i]);
+    }
+    platform_counting_semaphore_delete(&notifier->items);
+    platform_counting_semaphore_delete(&notifier->slots);
+    _free(private, notifier->ring, (notifier->mask + 1) * sizeof(*notifier->ring), ALLOC_ALIGNMENT);
+    _free(private, notifier, sizeof(*notifier) + notifier->num_workers * sizeof(platform_thread_t), ALLOC_ALIGNMENT);
+}
+
+static void _notifier_stop(const private_t * private, notifier_t * notifier)
+{
+    _notifier_flush(notifier);
+    _notifier_stop_workers(private, notifier, notifier->num_workers);
+}
+
+datastore_status_t datastore_start_notifier(const datastore_t * datastore, const datastore_notifier_config_t * config)
 {
     datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
-    if (datastore != NULL)
+    if (datastore != NULL && config != NULL)
     {
         private_t * private = (private_t *)datastore->private_data;
         if (private != NULL)
         {
-            if (id >= 0 && id < private->index_size / sizeof(index_row_t))
+            if (config->queue_length > 0 && config->queue_length <= NOTIFIER_MAX_QUEUE_LENGTH
+                && config->num_workers > 0 && config->num_workers <= NOTIFIER_MAX_WORKERS
+                && config->backpressure >= 0 && config->backpressure < DATASTORE_BACKPRESSURE_LAST)
             {
-                if (instance >= 0 && instance < private->index_rows[id].num_instances)
+                uint32_t length = 2;
+                while (length < config->queue_length)
                 {
-                    err = _from_string(datastore, id, instance, buffer);
-                    if (err != DATASTORE_STATUS_OK)
+                    length <<= 1;
+                }
+
+                notifier_t * notifier = _alloc(private, sizeof(*notifier) + config->num_workers * sizeof(platform_thread_t), ALLOC_ALIGNMENT);
+                notification_t * ring = _alloc(private, length * sizeof(*ring), ALLOC_ALIGNMENT);
+                if (notifier != NULL && ring != NULL)
+                {
+                    memset(notifier, 0, sizeof(*notifier));
+                    for (uint32_t i = 0; i < length; ++i)
                     {
-                        platform_error("Error %d", err);
+                        ring[i].sequence = i;
+                    }
+                    notifier->datastore = datastore;
+                    notifier->backpressure = config->backpressure;
+                    notifier->ring = ring;
+                    notifier->mask = length - 1;
+                    notifier->num_workers = config->num_workers;
+                    platform_counting_semaphore_create(&notifier->items, 0);
+                    platform_counting_semaphore_create(&notifier->slots, length);
+
+                    uint32_t num_started = 0;
+                    while (num_started < notifier->num_workers
+                           && platform_thread_create(&notifier->workers[num_started], "datastore_notify", _notifier_worker, notifier))
+                    {
+                        ++num_started;
                     }
 
+                    notifier_t * expected = NULL;
+                    if (num_started < notifier->num_workers)
+                    {
+                        platform_error("failed to start notifier worker %u", num_started);
+                        _notifier_stop_workers(private, notifier, num_started);
+                        err = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
+                    }
+                    else if (__atomic_compare_exchange_n(&private->notifier, &expected, notifier, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                    {
+                        err = DATASTORE_STATUS_OK;
+                    }
+                    else
+                    {
+                        platform_error("notifier is already running");
+                        _notifier_stop_workers(private, notifier, num_started);
+                        err = DATASTORE_STATUS_ERROR_INVALID_ARGUMENT;
+                    }
                 }
                 else
                 {
-                    platform_error("instance %d is invalid", instance);
-                    err = DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
+                    platform_error("malloc failed");
+                    _free(private, notifier, sizeof(*notifier) + config->num_workers * sizeof(platform_thread_t), ALLOC_ALIGNMENT);
+                    _free(private, ring, length * sizeof(*ring), ALLOC_ALIGNMENT);
+                    err = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
                 }
             }
             else
             {
-                platform_error("id %d is invalid", id);
-                err = DATASTORE_STATUS_ERROR_INVALID_ID;
+                platform_error("invalid notifier configuration: queue_length %u, num_workers %u, backpressure %d",
+                               config->queue_length, config->num_workers, config->backpressure);
+                err = DATASTORE_STATUS_ERROR_INVALID_ARGUMENT;
             }
         }
         else
@@ -1244,13 +4258,13 @@ datastore_status_t datastore_set_as_string(const datastore_t * datastore, datast
     }
     else
     {
-        platform_error("datastore is NULL");
+        platform_error("datastore or config is NULL");
         err = DATASTORE_STATUS_ERROR_NULL_POINTER;
     }
     return err;
 }
 
-datastore_status_t datastore_dump(const datastore_t * datastore)
+datastore_status_t datastore_flush_notifier(const datastore_t * datastore)
 {
     datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
     if (datastore != NULL)
@@ -1258,30 +4272,12 @@ datastore_status_t datastore_dump(const datastore_t * datastore)
         private_t * private = (private_t *)datastore->private_data;
         if (private != NULL)
         {
-            err = DATASTORE_STATUS_OK;
-            platform_info("ID NAME                                INSTANCE SIZE [VALUE] (AGE)");
-            for (datastore_resource_id_t id = 0; err == DATASTORE_STATUS_OK && id < private->index_size / sizeof(index_row_t); ++id)
+            notifier_t * notifier = __atomic_load_n(&private->notifier, __ATOMIC_ACQUIRE);
+            if (notifier != NULL)
             {
-                for (datastore_instance_id_t instance = 0; err == DATASTORE_STATUS_OK && instance < private->index_rows[id].num_instances; ++instance)
-                {
-                    char value[256] = "";
-                    err = _to_string(datastore, id, instance, value, 256);
-                    datastore_age_t age = 0;
-                    datastore_get_age(datastore, id, instance, &age);
-                    if (age == DATASTORE_INVALID_AGE)
-                    {
-                        platform_info("%2d %-40s %3d %4zu []", id, private->index_rows[id].name, instance, private->index_rows[id].size);
-                    }
-                    else
-                    {
-                        platform_info("%2d %-40s %3d %4zu [%s] (%0.2fs)", id, private->index_rows[id].name, instance, private->index_rows[id].size, value, age / 1000000.0);
-                    }
-                }
-                if (err != DATASTORE_STATUS_OK)
-                {
-                    platform_error("Error %d", err);
-                }
+                _notifier_flush(notifier);
             }
+            err = DATASTORE_STATUS_OK;
         }
         else
         {
@@ -1297,150 +4293,375 @@ datastore_status_t datastore_dump(const datastore_t * datastore)
     return err;
 }
 
-datastore_status_t _add(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, int64_t addend)
+// Make room for count more entries, so that pushing them cannot fail
+static bool _expiry_reserve(expiry_t * expiry, size_t count)
+{
+    bool ok = true;
+    if (expiry->num_entries + count > expiry->capacity)
+    {
+        size_t capacity = expiry->capacity > 0 ? expiry->capacity * 2 : 64;
+        while (capacity < expiry->num_entries + count)
+        {
+            capacity *= 2;
+        }
+        const private_t * private = (const private_t *)expiry->datastore->private_data;
+        expiry_entry_t * heap = _alloc(private, capacity * sizeof(*heap), ALLOC_ALIGNMENT);
+        if (heap != NULL)
+        {
+            if (expiry->num_entries > 0)
+            {
+                memcpy(heap, expiry->heap, expiry->num_entries * sizeof(*heap));
+            }
+            _free(private, expiry->heap, expiry->capacity * sizeof(*heap), ALLOC_ALIGNMENT);
+            expiry->heap = heap;
+            expiry->capacity = capacity;
+        }
+        else
+        {
+            platform_error("malloc failed");
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static bool _expiry_push(expiry_t * expiry, uint64_t deadline, datastore_resource_id_t id, datastore_instance_id_t instance)
+{
+    bool ok = _expiry_reserve(expiry, 1);
+    if (ok)
+    {
+        // sift up
+        size_t child = expiry->num_entries++;
+        while (child > 0 && expiry->heap[(child - 1) / 2].deadline > deadline)
+        {
+            expiry->heap[child] = expiry->heap[(child - 1) / 2];
+            child = (child - 1) / 2;
+        }
+        expiry->heap[child].deadline = deadline;
+        expiry->heap[child].id = id;
+        expiry->heap[child].instance = instance;
+    }
+    else
+    {
+        platform_error("id %d, instance %d will not expire", id, instance);
+    }
+    return ok;
+}
+
+// Remove every entry for a resource, keeping the rest in heap order
+static void _expiry_remove(expiry_t * expiry, datastore_resource_id_t id)
+{
+    size_t num_entries = expiry->num_entries;
+    expiry->num_entries = 0;
+    for (size_t i = 0; i < num_entries; ++i)
+    {
+        // pushing only writes at or below i, so later entries are still intact
+        expiry_entry_t entry = expiry->heap[i];
+        if (entry.id != id)
+        {
+            _expiry_push(expiry, entry.deadline, entry.id, entry.instance);
+        }
+    }
+}
+
+static expiry_entry_t _expiry_pop(expiry_t * expiry)
+{
+    expiry_entry_t top = expiry->heap[0];
+    expiry_entry_t last = expiry->heap[--expiry->num_entries];
+
+    // sift down
+    size_t parent = 0;
+    for (;;)
+    {
+        size_t child = 2 * parent + 1;
+        if (child >= expiry->num_entries)
+        {
+            break;
+        }
+        if (child + 1 < expiry->num_entries && expiry->heap[child + 1].deadline < expiry->heap[child].deadline)
+        {
+            ++child;
+        }
+        if (expiry->heap[child].deadline >= last.deadline)
+        {
+            break;
+        }
+        expiry->heap[parent] = expiry->heap[child];
+        parent = child;
+    }
+    if (expiry->num_entries > 0)
+    {
+        expiry->heap[parent] = last;
+    }
+    return top;
+}
+
+// Watch an instance again after it was reported stale. Called by writers, possibly with the datastore lock held.
+static void _expiry_arm(expiry_t * expiry, uint64_t deadline, datastore_resource_id_t id, datastore_instance_id_t instance)
+{
+    platform_mutex_take(&expiry->lock);
+    bool earliest = _expiry_push(expiry, deadline, id, instance) && expiry->heap[0].instance == instance && expiry->heap[0].id == id;
+    platform_mutex_give(&expiry->lock);
+    if (earliest)
+    {
+        platform_counting_semaphore_give(&expiry->wake);
+    }
+}
+
+static void _expiry_thread(void * arg)
+{
+    expiry_t * expiry = (expiry_t *)arg;
+    const datastore_t * datastore = expiry->datastore;
+    private_t * private = (private_t *)datastore->private_data;
+
+    platform_mutex_take(&expiry->lock);
+    while (!expiry->stopping)
+    {
+        uint64_t now = _now(private);
+        if (expiry->num_entries == 0 || expiry->heap[0].deadline > now)
+        {
+            uint64_t wait_us = expiry->num_entries > 0 ? expiry->heap[0].deadline - now : EXPIRY_MAX_WAIT_US;
+            platform_mutex_give(&expiry->lock);
+            platform_counting_semaphore_take_timeout(&expiry->wake, wait_us < EXPIRY_MAX_WAIT_US ? wait_us : EXPIRY_MAX_WAIT_US);
+            platform_mutex_take(&expiry->lock);
+        }
+        else
+        {
+            expiry_entry_t entry = _expiry_pop(expiry);
+            index_row_t * row = _get_row(private, entry.id);
+            uint64_t timestamp = row != NULL ? __atomic_load_n(&row->timestamps[entry.instance], __ATOMIC_SEQ_CST) : UINT64_MAX;
+            if (row == NULL || row->ttl_us == 0 || row->stale_callback == NULL)
+            {
+                // the resource's TTL was never completely set - nothing to report
+                platform_error("dropping expiry of id %d, instance %d", entry.id, entry.instance);
+            }
+            else if (timestamp != UINT64_MAX && timestamp + row->ttl_us > now)
+            {
+                // set since this entry was armed - check again at the new deadline
+                _expiry_push(expiry, timestamp + row->ttl_us, entry.id, entry.instance);
+            }
+            else
+            {
+                // a writer that misses this flag is seen by the second load below
+                bool reported = __atomic_exchange_n(&row->expired[entry.instance], 1, __ATOMIC_SEQ_CST);
+                uint64_t latest = __atomic_load_n(&row->timestamps[entry.instance], __ATOMIC_SEQ_CST);
+                if (latest == timestamp && reported)
+                {
+                    // a second entry for an instance that has already been reported
+                    platform_debug("dropping duplicate expiry of id %d, instance %d", entry.id, entry.instance);
+                }
+                else if (latest == timestamp)
+                {
+                    datastore_stale_callback callback = row->stale_callback;
+                    void * context = row->stale_context;
+                    platform_mutex_give(&expiry->lock);
+                    platform_debug("invoke stale callback function %p for id %d, instance %d", callback, entry.id, entry.instance);
+                    callback(datastore, entry.id, entry.instance, context);
+                    platform_mutex_take(&expiry->lock);
+                }
+                else if (__atomic_exchange_n(&row->expired[entry.instance], 0, __ATOMIC_SEQ_CST))
+                {
+                    // set just now, by a writer that did not see the flag
+                    _expiry_push(expiry, latest + row->ttl_us, entry.id, entry.instance);
+                }
+            }
+        }
+    }
+    platform_mutex_give(&expiry->lock);
+}
+
+static void _expiry_stop(const private_t * private, expiry_t * expiry)
+{
+    platform_mutex_take(&expiry->lock);
+    expiry->stopping = true;
+    platform_mutex_give(&expiry->lock);
+    platform_counting_semaphore_give(&expiry->wake);
+    platform_thread_join(&expiry->thread);
+
+    platform_counting_semaphore_delete(&expiry->wake);
+    platform_mutex_delete(&expiry->lock);
+    _free(private, expiry->heap, expiry->capacity * sizeof(*expiry->heap), ALLOC_ALIGNMENT);
+    _free(private, expiry, sizeof(*expiry), ALLOC_ALIGNMENT);
+}
+
+// Start the expiry thread, if it isn't already running.
+static expiry_t * _expiry_start(const datastore_t * datastore, private_t * private)
+{
+    expiry_t * expiry = __atomic_load_n(&private->expiry, __ATOMIC_ACQUIRE);
+    if (expiry == NULL)
+    {
+        expiry_t * created = _alloc(private, sizeof(*created), ALLOC_ALIGNMENT);
+        if (created != NULL)
+        {
+            memset(created, 0, sizeof(*created));
+            created->datastore = datastore;
+            platform_mutex_create(&created->lock);
+            platform_counting_semaphore_create(&created->wake, 0);
+            if (platform_thread_create(&created->thread, "datastore_expiry", _expiry_thread, created))
+            {
+                if (__atomic_compare_exchange_n(&private->expiry, &expiry, created, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                {
+                    expiry = created;
+                }
+                else
+                {
+                    // started concurrently - use that one
+                    _expiry_stop(private, created);
+                }
+            }
+            else
+            {
+                platform_error("failed to start expiry thread");
+                platform_counting_semaphore_delete(&created->wake);
+                platform_mutex_delete(&created->lock);
+                _free(private, created, sizeof(*created), ALLOC_ALIGNMENT);
+            }
+        }
+        else
+        {
+            platform_error("malloc failed");
+        }
+    }
+    return expiry;
+}
+
+datastore_status_t datastore_set_ttl(const datastore_t * datastore, datastore_resource_id_t resource_id, datastore_age_t ttl_us, datastore_stale_callback callback, void * context)
 {
-    platform_debug("_add: id %d, instance %d", id, instance);
     datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
-    if (datastore != NULL)
+    if (datastore != NULL && callback != NULL)
     {
         private_t * private = (private_t *)datastore->private_data;
         if (private != NULL)
         {
-            if (id >= 0 && id < private->index_size / sizeof(index_row_t))
+            index_row_t * row = _get_row(private, resource_id);
+            if (row != NULL)
             {
-                if (/*instance >= 0 &&*/ instance < private->index_rows[id].num_instances)
+                if (ttl_us > 0 && ttl_us < UINT64_MAX / 2 && !(row->flags & DATASTORE_RESOURCE_FLAG_NO_TIMESTAMP))
                 {
-                    // a zero doesn't change anything - no callbacks are invoked
-                    err = DATASTORE_STATUS_OK;
-                    if (addend != 0)
+                    expiry_t * expiry = _expiry_start(datastore, private);
+                    if (expiry != NULL)
                     {
-                        switch (private->index_rows[id].type)
+                        platform_mutex_take(&expiry->lock);
+                        err = DATASTORE_STATUS_OK;
+                        if (row->ttl_us == 0)
                         {
-                            case DATASTORE_TYPE_UINT8:
+                            // first TTL for this resource - watch every instance, never-set ones from now.
+                            // Room for all of them is made first, so that none are armed if any can't be.
+                            if (_expiry_reserve(expiry, row->num_instances))
                             {
-                                uint8_t value = 0;
-                                err = _get_value(datastore, id, instance, &value, sizeof(value), DATASTORE_TYPE_UINT8);
-                                if (err == DATASTORE_STATUS_OK)
+                                uint64_t now = _now(private);
+                                for (datastore_instance_id_t i = 0; i < row->num_instances; ++i)
                                 {
-                                    value += addend;
-                                    err = _set_value(datastore, id, instance, &value, sizeof(uint8_t), DATASTORE_TYPE_UINT8);
+                                    uint64_t timestamp = __atomic_load_n(&row->timestamps[i], __ATOMIC_SEQ_CST);
+                                    _expiry_push(expiry, (timestamp != UINT64_MAX ? timestamp : now) + ttl_us, resource_id, i);
                                 }
-                                break;
                             }
-                            case DATASTORE_TYPE_UINT32:
-                            {
-                                uint32_t value = 0;
-                                err = _get_value(datastore, id, instance, &value, sizeof(value), DATASTORE_TYPE_UINT32);
-                                if (err == DATASTORE_STATUS_OK)
-                                {
-                                    value += addend;
-                                    err = _set_value(datastore, id, instance, &value, sizeof(uint32_t), DATASTORE_TYPE_UINT32);
-                                }
-                                break;
-                            }
-
-                            case DATASTORE_TYPE_INT8:
+                            else
                             {
-                                uint8_t value = 0;
-                                err = _get_value(datastore, id, instance, &value, sizeof(value), DATASTORE_TYPE_INT8);
-                                if (err == DATASTORE_STATUS_OK)
-                                {
-                                    value += addend;
-                                    err = _set_value(datastore, id, instance, &value, sizeof(int8_t), DATASTORE_TYPE_INT8);
-                                }
-                                break;
+                                err = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
                             }
-                            case DATASTORE_TYPE_INT32:
+                        }
+                        else if (ttl_us < row->ttl_us)
+                        {
+                            // shorter TTL - re-arm the instances not yet reported from their timestamps,
+                            // rather than leaving them to the old, later deadlines
+                            if (_expiry_reserve(expiry, row->num_instances))
                             {
-                                uint32_t value = 0;
-                                err = _get_value(datastore, id, instance, &value, sizeof(value), DATASTORE_TYPE_INT32);
-                                if (err == DATASTORE_STATUS_OK)
+                                _expiry_remove(expiry, resource_id);
+                                uint64_t now = _now(private);
+                                for (datastore_instance_id_t i = 0; i < row->num_instances; ++i)
                                 {
-                                    value += addend;
-                                    err = _set_value(datastore, id, instance, &value, sizeof(int32_t), DATASTORE_TYPE_INT32);
+                                    if (!__atomic_load_n(&row->expired[i], __ATOMIC_SEQ_CST))
+                                    {
+                                        uint64_t timestamp = __atomic_load_n(&row->timestamps[i], __ATOMIC_SEQ_CST);
+                                        _expiry_push(expiry, (timestamp != UINT64_MAX ? timestamp : now) + ttl_us, resource_id, i);
+                                    }
                                 }
-                                break;
                             }
-
-                            case DATASTORE_TYPE_BOOL:
+                            else
                             {
-                                bool value = false;
-                                err = _get_value(datastore, id, instance, &value, sizeof(value), DATASTORE_TYPE_BOOL);
-                                if (err == DATASTORE_STATUS_OK)
-                                {
-                                    value = !value;
-                                    err = _set_value(datastore, id, instance, &value, sizeof(bool), DATASTORE_TYPE_BOOL);
-                                }
-                                break;
+                                err = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
                             }
+                        }
 
-                            default:
-                                platform_error("Cannot increment type %d", private->index_rows[id].type);
-                                err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
-                                break;
+                        if (err == DATASTORE_STATUS_OK)
+                        {
+                            row->stale_callback = callback;
+                            row->stale_context = context;
+                            __atomic_store_n(&row->ttl_us, ttl_us, __ATOMIC_SEQ_CST);
                         }
+                        platform_mutex_give(&expiry->lock);
+                        platform_counting_semaphore_give(&expiry->wake);
+                    }
+                    else
+                    {
+                        err = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
                     }
                 }
                 else
                 {
-                    platform_error("increment: instance %d is invalid", instance);
-                    err = DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
+                    platform_error("ttl %llu is invalid for resource_id %d", (unsigned long long)ttl_us, resource_id);
+                    err = DATASTORE_STATUS_ERROR_INVALID_ARGUMENT;
                 }
             }
             else
             {
-                platform_error("increment: id %d is invalid", id);
+                platform_error("resource_id %d is invalid", resource_id);
                 err = DATASTORE_STATUS_ERROR_INVALID_ID;
             }
         }
         else
         {
-            platform_error("increment: private is NULL");
+            platform_error("private is NULL");
             err = DATASTORE_STATUS_ERROR_NULL_POINTER;
         }
     }
     else
     {
-        platform_error("increment: datastore is NULL");
+        platform_error("datastore or callback is NULL");
         err = DATASTORE_STATUS_ERROR_NULL_POINTER;
     }
     return err;
 }
 
-datastore_status_t datastore_add(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, int64_t addend)
-{
-    platform_debug("datastore_increment: id %d, instance %d", id, instance);
-    return _add(datastore, id, instance, addend);
-}
-
-datastore_status_t datastore_increment(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance)
-{
-    platform_debug("datastore_increment: id %d, instance %d", id, instance);
-    return _add(datastore, id, instance, 1);
-}
-
-size_t datastore_get_ram_usage(const datastore_t * datastore)
+datastore_status_t datastore_get_stats(const datastore_t * datastore, datastore_stats_t * stats)
 {
-    // only stored data, not including overhead
-    uint32_t usage = 0;
-    if (datastore != NULL)
+    datastore_status_t err = DATASTORE_STATUS_UNKNOWN;
+    if (stats != NULL)
     {
-        private_t * private = (private_t *)datastore->private_data;
-        if (private != NULL)
+        if (datastore != NULL)
         {
-            for (datastore_resource_id_t id = 0; id < private->index_size / sizeof(index_row_t); ++id)
+            private_t * private = (private_t *)datastore->private_data;
+            if (private != NULL)
+            {
+                memset(stats, 0, sizeof(*stats));
+                stats->suppressed_writes = __atomic_load_n(&private->suppressed_writes, __ATOMIC_RELAXED);
+                notifier_t * notifier = __atomic_load_n(&private->notifier, __ATOMIC_ACQUIRE);
+                if (notifier != NULL)
+                {
+                    stats->notifications_queued = __atomic_load_n(&notifier->pending, __ATOMIC_RELAXED);
+                    stats->notifications_high_water = __atomic_load_n(&notifier->high_water, __ATOMIC_RELAXED);
+                    stats->notifications_dropped = __atomic_load_n(&notifier->dropped, __ATOMIC_RELAXED);
+                    stats->notifications_coalesced = __atomic_load_n(&notifier->coalesced, __ATOMIC_RELAXED);
+                }
+                err = DATASTORE_STATUS_OK;
+            }
+            else
             {
-                usage += private->index_rows[id].size * private->index_rows[id].num_instances;
+                platform_error("private is NULL");
+                err = DATASTORE_STATUS_ERROR_NULL_POINTER;
             }
         }
         else
         {
-            platform_error("private is NULL");
+            platform_error("datastore is NULL");
+            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
         }
     }
     else
     {
-        platform_error("datastore is NULL");
+        platform_error("stats is NULL");
+        err = DATASTORE_STATUS_ERROR_NULL_POINTER;
     }
-    return usage;
+    return err;
 }
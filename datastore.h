@@ -44,6 +44,7 @@ typedef enum
     DATASTORE_STATUS_ERROR_INVALID_INSTANCE, // an instance, or number of instances is invalid
     DATASTORE_STATUS_ERROR_TOO_LARGE,        // data is too large for allocated space
     DATASTORE_STATUS_ERROR_INVALID_REPRESENTATION,  // string representation is invalid for expected type
+    DATASTORE_STATUS_ERROR_INVALID_ARGUMENT, // a parameter is out of range, or not valid in the current state
 } datastore_status_t;
 
 typedef enum
@@ -71,14 +72,74 @@ typedef struct
 datastore_t * datastore_create(void);
 void datastore_free(datastore_t ** datastore);
 
+// Source of memory for the datastore's own structures: index, per-instance metadata, names, callback lists,
+// queues, and the values of managed resources (which are moved into it when added). alloc returns NULL on
+// failure, and free is passed the same size and alignment as the allocation. If release is not NULL,
+// datastore_free() calls it once instead of freeing each allocation individually.
+typedef struct
+{
+    void * (*alloc)(void * context, size_t size, size_t alignment);
+    void (*free)(void * context, void * ptr, size_t size, size_t alignment);
+    void (*release)(void * context);   // optional
+    void * context;
+} datastore_allocator_t;
+
+// As datastore_create(), with all internal allocations from the given allocator (copied). NULL for the heap.
+datastore_t * datastore_create_with_allocator(const datastore_allocator_t * allocator);
+
+// The built-in arena: allocations are carved from blocks of block_size bytes, freed allocations of up to
+// DATASTORE_ARENA_MAX_SLAB bytes are reused through per-size-class free lists, and larger ones are
+// allocated separately. release frees the whole arena - if it isn't passed to a datastore, call it directly.
+#define DATASTORE_ARENA_MIN_BLOCK_SIZE  4096
+#define DATASTORE_ARENA_MAX_SLAB        2048
+datastore_status_t datastore_arena_allocator(datastore_allocator_t * allocator, size_t block_size);
+
+// Limits for a datastore that lives entirely in caller-supplied memory
+typedef struct
+{
+    uint32_t max_resources;     // resource IDs are less than this
+    uint32_t max_instances;     // in total, over all resources
+    uint32_t max_callbacks;     // registered at any one time, in total over all resources, instances and the store
+    uint32_t max_name_length;   // longest resource name, excluding the terminator - 0 if names aren't used
+    uint32_t max_coalesced;     // instances waiting for datastore_dispatch_pending() - 0 if coalesced callbacks aren't used
+    uint32_t max_retired;       // callback lists replaced while callbacks are running, see below
+} datastore_static_config_t;
+
+// Bytes required by datastore_create_static() for a configuration. This covers the datastore, its index,
+// per-instance metadata, callbacks, names and the pending set for any resources, callbacks and names within
+// the limits, added and removed in any order. Within a static datastore:
+// - datastore_set_name() fails with DATASTORE_STATUS_ERROR_INVALID_ARGUMENT for names longer than max_name_length.
+// - Registering a DATASTORE_CALLBACK_FLAG_COALESCE callback fails with DATASTORE_STATUS_ERROR_INVALID_ARGUMENT
+//   if max_coalesced is 0. Beyond max_coalesced dirty instances, coalesced callbacks are invoked immediately.
+//   This assumes datastore_dispatch_pending() is called from one thread at a time.
+// - Adding or removing a callback replaces the list that holds it. If callbacks are running on another thread,
+//   or the change is made from within a callback, the old list is kept until they return. max_retired of
+//   those can be waiting at once; if callbacks are only ever changed when none are running, it can be 0.
+// Resource values should be unmanaged (caller-supplied) - managed values, TTLs, the notifier and
+// DATASTORE_BACKPRESSURE_COALESCE also use the region, so add their sizes.
+size_t datastore_static_size(const datastore_static_config_t * config);
+
+// Create a datastore that makes no heap allocations: everything comes from the buffer, which must be
+// at least datastore_static_size() bytes, aligned to 8 bytes, and outlive the datastore. Returns NULL
+// if it is too small. Allocations beyond the limits fail with DATASTORE_STATUS_ERROR_OUT_OF_MEMORY.
+datastore_t * datastore_create_static(void * buffer, size_t size, const datastore_static_config_t * config);
+
 typedef void (*datastore_set_callback)(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, void * context);
 
+// Optional per-resource behaviour, combined into datastore_resource_t.flags
+#define DATASTORE_RESOURCE_FLAG_LOCK_FREE_READS     (1u << 0)   // scalar reads retry optimistically (seqlock) instead of taking the lock
+#define DATASTORE_RESOURCE_FLAG_ATOMIC              (1u << 1)   // integer/bool values are read and added to with hardware atomics
+#define DATASTORE_RESOURCE_FLAG_SUPPRESS_UNCHANGED  (1u << 2)   // writing the stored value again refreshes its age but invokes no callbacks
+#define DATASTORE_RESOURCE_FLAG_NO_TIMESTAMP        (1u << 3)   // writes do not read the clock; the age is always DATASTORE_INVALID_AGE
+#define DATASTORE_RESOURCE_FLAG_CACHE_ALIGNED       (1u << 4)   // each instance gets its own 64-byte cache line, so hot values written from different cores do not share one
+
 typedef struct
 {
     void * data;
     size_t size;
     datastore_type_t type;
     uint32_t num_instances;
+    uint32_t flags;  // DATASTORE_RESOURCE_FLAG_*
     bool _managed;   // indicates memory is managed by this resource and will be freed along with it
 } datastore_resource_t;
 
@@ -89,10 +150,20 @@ datastore_status_t datastore_add_resource(const datastore_t * datastore, datasto
 datastore_status_t datastore_set_name(const datastore_t * datastore, datastore_resource_id_t resource_id, const char * name);
 const char * datastore_get_name(const datastore_t * datastore, datastore_resource_id_t resource_id);
 
+// Resolve a name previously assigned with datastore_set_name() to a resource ID.
+// If several resources share a name, any one of them may be returned.
+datastore_status_t datastore_find_by_name(const datastore_t * datastore, const char * name, datastore_resource_id_t * resource_id);
+
 // TODO: consider deprecating these
 datastore_status_t datastore_add_fixed_length_resource(const datastore_t * datastore, datastore_resource_id_t resource_id, datastore_type_t type, uint32_t num_instances);
 datastore_status_t datastore_add_string_resource(const datastore_t * datastore, datastore_resource_id_t resource_id, uint32_t num_instances, size_t length);
 
+// Add a string resource whose instances take only the space of their current values, up to length - 1
+// characters each, rather than length bytes each. Values share one buffer that is compacted as they change,
+// so a set that needs more room may fail with DATASTORE_STATUS_ERROR_OUT_OF_MEMORY. Ranges, batched writes
+// and handles are not supported, and fail with DATASTORE_STATUS_ERROR_INVALID_TYPE.
+datastore_status_t datastore_add_variable_string_resource(const datastore_t * datastore, datastore_resource_id_t resource_id, uint32_t num_instances, size_t length);
+
 datastore_status_t datastore_set_bool(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, bool value);
 datastore_status_t datastore_set_uint8(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, uint8_t value);
 datastore_status_t datastore_set_uint32(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, uint32_t value);
@@ -102,6 +173,21 @@ datastore_status_t datastore_set_float(const datastore_t * datastore, datastore_
 datastore_status_t datastore_set_double(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, double value);
 datastore_status_t datastore_set_string(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, const char * value);
 
+// One write in a batch. value_size is the size of the value in bytes - for strings, strlen(value) + 1.
+typedef struct
+{
+    datastore_resource_id_t id;
+    datastore_instance_id_t instance;
+    datastore_type_t type;   // must match the resource type
+    const void * value;
+    size_t value_size;
+} datastore_write_t;
+
+// Apply several writes under a single lock, all with the same timestamp. Every write is validated
+// before any is applied, so on error the datastore is unchanged. Callbacks run after the lock is
+// released, once per distinct instance written.
+datastore_status_t datastore_set_batch(const datastore_t * datastore, const datastore_write_t * writes, size_t num_writes);
+
 datastore_status_t datastore_get_bool(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, bool * value);
 datastore_status_t datastore_get_uint8(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, uint8_t * value);
 datastore_status_t datastore_get_uint32(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, uint32_t * value);
@@ -111,11 +197,90 @@ datastore_status_t datastore_get_float(const datastore_t * datastore, datastore_
 datastore_status_t datastore_get_double(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, double * value);
 datastore_status_t datastore_get_string(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, char * value, size_t value_size);
 
+// Copy count consecutive instances, starting at first, to or from an array of values.
+// values_size must be at least count times the resource size (for strings, the allocated length).
+// The whole span is copied under a single lock; a set gives every instance the same timestamp.
+datastore_status_t datastore_get_range(const datastore_t * datastore, datastore_resource_id_t id, datastore_type_t type, datastore_instance_id_t first, uint32_t count, void * values, size_t values_size);
+datastore_status_t datastore_set_range(const datastore_t * datastore, datastore_resource_id_t id, datastore_type_t type, datastore_instance_id_t first, uint32_t count, const void * values, size_t values_size);
+
 datastore_status_t datastore_get_as_string(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, char * buffer, size_t buffer_size);
 datastore_status_t datastore_set_as_string(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, const char * buffer);
 
+// An instance resolved once, for repeated reads and writes without the per-call validation and index
+// lookup of datastore_get_*() and datastore_set_*(). Resources are never removed, so a handle remains
+// valid until the datastore is freed. Other than size, the fields are private.
+typedef struct
+{
+    const datastore_t * datastore;
+    void * row;
+    datastore_resource_id_t id;
+    datastore_instance_id_t instance;
+    size_t size;   // bytes read and written through the handle
+} datastore_handle_t;
+
+datastore_status_t datastore_resolve(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, datastore_type_t type, datastore_handle_t * handle);
+
+// value must hold handle->size bytes - a whole slot for strings. Callbacks, ages and resource flags
+// behave as for the typed functions.
+void datastore_handle_get(const datastore_handle_t * handle, void * value);
+void datastore_handle_set(const datastore_handle_t * handle, const void * value);
+
+// As above, for any instance of the handle's resource - one handle can serve them all. The instance
+// is not checked: it must be less than the resource's number of instances.
+void datastore_handle_get_instance(const datastore_handle_t * handle, datastore_instance_id_t instance, void * value);
+void datastore_handle_set_instance(const datastore_handle_t * handle, datastore_instance_id_t instance, const void * value);
+
+// Callbacks may be added and removed at any time, including from a callback, and concurrently with
+// sets that are invoking them. A callback removed while it is being invoked may still complete that call.
+//
+// Pass DATASTORE_INSTANCE_ALL to subscribe to every instance of a resource, or DATASTORE_RESOURCE_ALL
+// with DATASTORE_INSTANCE_ALL to subscribe to every resource. Store-wide callbacks are invoked first,
+// then resource-wide, then per-instance.
+#define DATASTORE_RESOURCE_ALL  ((datastore_resource_id_t)-1)
+#define DATASTORE_INSTANCE_ALL  ((datastore_instance_id_t)-1)
+
 datastore_status_t datastore_add_set_callback(const datastore_t * datastore, datastore_resource_id_t resource_id, datastore_instance_id_t instance_id, datastore_set_callback callback, void * context);
 
+// Remove the first registration of callback with context for the instance.
+datastore_status_t datastore_remove_set_callback(const datastore_t * datastore, datastore_resource_id_t resource_id, datastore_instance_id_t instance_id, datastore_set_callback callback, void * context);
+
+// Optional callback behaviour, for datastore_add_set_callback_ex()
+#define DATASTORE_CALLBACK_FLAG_COALESCE  (1u << 0)   // sets only mark the instance dirty; datastore_dispatch_pending() calls back once per dirty instance
+
+datastore_status_t datastore_add_set_callback_ex(const datastore_t * datastore, datastore_resource_id_t resource_id, datastore_instance_id_t instance_id, datastore_set_callback callback, void * context, uint32_t flags);
+
+// Invoke coalesced callbacks for every instance set since the last dispatch, in the order they were
+// first set, on the calling thread. Each callback runs once however many sets there were, and
+// reads the latest value.
+datastore_status_t datastore_dispatch_pending(const datastore_t * datastore);
+
+// What a writer does when the notifier queue is full
+typedef enum
+{
+    DATASTORE_BACKPRESSURE_BLOCK,        // wait for a worker to free a slot
+    DATASTORE_BACKPRESSURE_DROP_OLDEST,  // discard the oldest queued notification
+    DATASTORE_BACKPRESSURE_COALESCE,     // never queue an instance twice - a pending notification delivers the latest value;
+                                         // wait if the queue is still full
+    DATASTORE_BACKPRESSURE_LAST,
+} datastore_backpressure_t;
+
+typedef struct
+{
+    uint32_t queue_length;   // rounded up to a power of two
+    uint32_t num_workers;
+    datastore_backpressure_t backpressure;
+} datastore_notifier_config_t;
+
+// Deliver set callbacks asynchronously from now on: writers post notifications to a lock-free queue,
+// and a pool of worker threads invokes the callbacks. With several workers, callbacks may run
+// concurrently. A callback that writes to the datastore must not rely on DATASTORE_BACKPRESSURE_BLOCK
+// with a queue that can fill up, as it may then wait for itself.
+// The notifier runs until the datastore is freed, which first delivers all queued notifications.
+datastore_status_t datastore_start_notifier(const datastore_t * datastore, const datastore_notifier_config_t * config);
+
+// Wait until every notification posted so far has been delivered or dropped.
+datastore_status_t datastore_flush_notifier(const datastore_t * datastore);
+
 uint32_t datastore_num_instances(const datastore_t * datastore, datastore_resource_id_t resource_id);
 datastore_status_t datastore_add(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, int64_t addend);
 datastore_status_t datastore_increment(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance);
@@ -125,8 +290,72 @@ typedef uint64_t datastore_age_t;
 #define DATASTORE_INVALID_AGE UINT64_MAX
 datastore_status_t datastore_get_age(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, datastore_age_t * age_us);
 
+// Ages are measured with a monotonic clock, so they do not jump when the wall clock is adjusted.
+// The coarse clock is cheaper to read but only advances every few milliseconds on most systems;
+// where the platform has no coarse clock it is the same as the default. Choose it before writing values.
+typedef enum
+{
+    DATASTORE_CLOCK_MONOTONIC = 0,
+    DATASTORE_CLOCK_COARSE,
+    DATASTORE_CLOCK_LAST,
+} datastore_clock_t;
+
+datastore_status_t datastore_set_clock(const datastore_t * datastore, datastore_clock_t clock);
+
+// An instance found by datastore_find_stale(). age_us is DATASTORE_INVALID_AGE if it has never been set.
+typedef struct
+{
+    datastore_resource_id_t id;
+    datastore_instance_id_t instance;
+    datastore_age_t age_us;
+} datastore_stale_t;
+
+// Find every instance not set within the last max_age_us, or never set, in resource ID then instance order.
+// Up to max_stale are written to stale, and num_stale receives the total found, which may be more.
+// Resources with DATASTORE_RESOURCE_FLAG_NO_TIMESTAMP are skipped. The scan takes no lock, so an
+// instance set while it runs may or may not be reported.
+datastore_status_t datastore_find_stale(const datastore_t * datastore, datastore_age_t max_age_us, datastore_stale_t * stale, size_t max_stale, size_t * num_stale);
+
+// Called from the expiry thread when an instance of a resource with a TTL has not been set for ttl_us.
+// Each instance is reported once, then again only after it has been set and has gone stale again.
+typedef void (*datastore_stale_callback)(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, void * context);
+
+// Watch every instance of a resource - instances never set go stale ttl_us after this call. The first TTL
+// starts a thread for the datastore. Calling again changes the TTL and callback; a TTL cannot be removed.
+// A shorter TTL applies at once to instances not yet reported, never-set ones going stale ttl_us after the call.
+datastore_status_t datastore_set_ttl(const datastore_t * datastore, datastore_resource_id_t resource_id, datastore_age_t ttl_us, datastore_stale_callback callback, void * context);
+
+// One read in a batch. value_size is the size of the buffer at value, which must match the
+// resource size for scalar types. status and age_us are filled in by datastore_get_batch().
+typedef struct
+{
+    datastore_resource_id_t id;
+    datastore_instance_id_t instance;
+    datastore_type_t type;   // must match the resource type
+    void * value;
+    size_t value_size;
+    datastore_status_t status;
+    datastore_age_t age_us;
+} datastore_read_t;
+
+// Copy several values under a single lock, giving a consistent snapshot with respect to other
+// writers that take the lock (values added with datastore_add() to atomic resources do not).
+// Returns the first per-entry error, if any - all valid entries are read regardless.
+datastore_status_t datastore_get_batch(const datastore_t * datastore, datastore_read_t * reads, size_t num_reads);
+
 size_t datastore_get_ram_usage(const datastore_t * datastore);
 
+typedef struct
+{
+    uint64_t suppressed_writes;         // writes skipped by DATASTORE_RESOURCE_FLAG_SUPPRESS_UNCHANGED
+    uint32_t notifications_queued;      // posted to the notifier but not yet delivered
+    uint32_t notifications_high_water;  // most notifications ever waiting in the queue
+    uint64_t notifications_dropped;     // discarded by DATASTORE_BACKPRESSURE_DROP_OLDEST
+    uint64_t notifications_coalesced;   // merged by DATASTORE_BACKPRESSURE_COALESCE
+} datastore_stats_t;
+
+datastore_status_t datastore_get_stats(const datastore_t * datastore, datastore_stats_t * stats);
+
 #ifdef __cplusplus
 }
 #endif
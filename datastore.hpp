@@ -0,0 +1,361 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2018 David Antliff
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// C++ schemas for the datastore: resources are declared as types, their layout is computed at
+// compile time into one block of storage, and accessors are checked against the schema by the compiler.
+//
+//     struct Temperature : datastore::Resource<0, float, 4> {};
+//     struct Label : datastore::Resource<1, char[16]> {};
+//
+//     datastore::Store<Temperature, Label> store;
+//     store.set<Temperature>(2, 21.5f);
+//     float t = store.get<Temperature>(2);
+
+#ifndef DATASTORE_HPP
+#define DATASTORE_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "datastore.h"
+
+namespace datastore {
+
+// The datastore type that holds values of a C++ type - strings are fixed-length char arrays
+template <typename T> struct Type;
+template <> struct Type<bool>     { static constexpr datastore_type_t value = DATASTORE_TYPE_BOOL; };
+template <> struct Type<uint8_t>  { static constexpr datastore_type_t value = DATASTORE_TYPE_UINT8; };
+template <> struct Type<uint32_t> { static constexpr datastore_type_t value = DATASTORE_TYPE_UINT32; };
+template <> struct Type<int8_t>   { static constexpr datastore_type_t value = DATASTORE_TYPE_INT8; };
+template <> struct Type<int32_t>  { static constexpr datastore_type_t value = DATASTORE_TYPE_INT32; };
+template <> struct Type<float>    { static constexpr datastore_type_t value = DATASTORE_TYPE_FLOAT; };
+template <> struct Type<double>   { static constexpr datastore_type_t value = DATASTORE_TYPE_DOUBLE; };
+template <size_t L> struct Type<char[L]> { static constexpr datastore_type_t value = DATASTORE_TYPE_STRING; };
+
+// A resource in a schema - derive a named type from it
+template <datastore_resource_id_t ID, typename T, uint32_t N = 1, uint32_t Flags = 0>
+struct Resource
+{
+    static_assert(ID >= 0, "resource IDs must not be negative");
+    static_assert(N > 0, "a resource must have at least one instance");
+    static_assert((Flags & DATASTORE_RESOURCE_FLAG_CACHE_ALIGNED) == 0, "schema storage is packed");
+
+    typedef T value_type;
+    static constexpr datastore_resource_id_t id = ID;
+    static constexpr datastore_type_t type = Type<T>::value;
+    static constexpr uint32_t num_instances = N;
+    static constexpr uint32_t flags = Flags;
+};
+
+template <datastore_resource_id_t ID, typename T, uint32_t N, uint32_t Flags> constexpr datastore_resource_id_t Resource<ID, T, N, Flags>::id;
+template <datastore_resource_id_t ID, typename T, uint32_t N, uint32_t Flags> constexpr datastore_type_t Resource<ID, T, N, Flags>::type;
+template <datastore_resource_id_t ID, typename T, uint32_t N, uint32_t Flags> constexpr uint32_t Resource<ID, T, N, Flags>::num_instances;
+template <datastore_resource_id_t ID, typename T, uint32_t N, uint32_t Flags> constexpr uint32_t Resource<ID, T, N, Flags>::flags;
+
+namespace detail {
+
+constexpr size_t align_up(size_t offset, size_t alignment)
+{
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+// Resources are laid out in schema order, each aligned for its type
+template <typename R>
+constexpr size_t end_of(size_t offset)
+{
+    return align_up(offset, alignof(typename R::value_type)) + sizeof(typename R::value_type) * R::num_instances;
+}
+
+template <size_t Offset, typename... Rs> struct Layout;
+
+template <size_t Offset>
+struct Layout<Offset>
+{
+    static constexpr size_t size = Offset;
+    static constexpr size_t alignment = 1;
+};
+
+template <size_t Offset, typename R, typename... Rs>
+struct Layout<Offset, R, Rs...>
+{
+    typedef Layout<end_of<R>(Offset), Rs...> Rest;
+    static constexpr size_t size = Rest::size;
+    static constexpr size_t alignment = alignof(typename R::value_type) > Rest::alignment ? alignof(typename R::value_type) : Rest::alignment;
+};
+
+template <typename Q, size_t Offset, typename... Rs> struct OffsetOf;
+
+template <typename Q, size_t Offset>
+struct OffsetOf<Q, Offset>
+{
+    static_assert(sizeof(Q) == 0, "resource is not in the schema");
+    static constexpr size_t value = 0;
+};
+
+template <typename Q, size_t Offset, typename R, typename... Rs>
+struct OffsetOf<Q, Offset, R, Rs...>
+{
+    static constexpr size_t value = std::conditional<std::is_same<Q, R>::value,
+                                                     std::integral_constant<size_t, align_up(Offset, alignof(typename R::value_type))>,
+                                                     OffsetOf<Q, end_of<R>(Offset), Rs...>>::type::value;
+};
+
+template <typename Q, typename... Rs> struct Contains : std::false_type {};
+
+template <typename Q, typename R, typename... Rs>
+struct Contains<Q, R, Rs...> : std::integral_constant<bool, std::is_same<Q, R>::value || Contains<Q, Rs...>::value> {};
+
+template <datastore_resource_id_t ID, typename... Rs> struct HasId : std::false_type {};
+
+template <datastore_resource_id_t ID, typename R, typename... Rs>
+struct HasId<ID, R, Rs...> : std::integral_constant<bool, R::id == ID || HasId<ID, Rs...>::value> {};
+
+template <typename... Rs> struct DistinctIds : std::true_type {};
+
+template <typename R, typename... Rs>
+struct DistinctIds<R, Rs...> : std::integral_constant<bool, !HasId<R::id, Rs...>::value && DistinctIds<Rs...>::value> {};
+
+// Position of a resource in the schema
+template <typename Q, typename... Rs> struct IndexOf : std::integral_constant<size_t, 0> {};
+
+template <typename Q, typename R, typename... Rs>
+struct IndexOf<Q, R, Rs...> : std::integral_constant<size_t, std::is_same<Q, R>::value ? 0 : 1 + IndexOf<Q, Rs...>::value> {};
+
+// Strings are set from a pointer, everything else by value
+template <typename T> struct Argument { typedef T type; };
+template <size_t L> struct Argument<char[L]> { typedef const char * type; };
+
+// Write a whole value to an instance through its resource's handle - strings are copied into a zeroed slot first
+template <typename T>
+struct Write
+{
+    static datastore_status_t apply(const datastore_handle_t & handle, datastore_instance_id_t instance, T value)
+    {
+        datastore_handle_set_instance(&handle, instance, &value);
+        return DATASTORE_STATUS_OK;
+    }
+};
+
+template <size_t L>
+struct Write<char[L]>
+{
+    static datastore_status_t apply(const datastore_handle_t & handle, datastore_instance_id_t instance, const char * value)
+    {
+        datastore_status_t err = DATASTORE_STATUS_OK;
+        if (value == NULL)
+        {
+            err = DATASTORE_STATUS_ERROR_NULL_POINTER;
+        }
+        else if (std::strlen(value) >= L)
+        {
+            err = DATASTORE_STATUS_ERROR_TOO_LARGE;
+        }
+        else
+        {
+            char slot[L] = {};
+            std::strcpy(slot, value);
+            datastore_handle_set_instance(&handle, instance, slot);
+        }
+        return err;
+    }
+};
+
+} // namespace detail
+
+// A typed datastore_handle_t: resolve once, then read and write without per-call validation
+template <typename T>
+class Handle
+{
+public:
+    Handle() : handle_() {}
+
+    datastore_status_t resolve(const datastore_t * ds, datastore_resource_id_t id, datastore_instance_id_t instance)
+    {
+        datastore_handle_t handle;
+        datastore_status_t err = datastore_resolve(ds, id, instance, Type<T>::value, &handle);
+        if (err == DATASTORE_STATUS_OK && handle.size != sizeof(T))
+        {
+            // only possible for strings of another length
+            err = DATASTORE_STATUS_ERROR_INVALID_TYPE;
+        }
+        if (err == DATASTORE_STATUS_OK)
+        {
+            handle_ = handle;
+        }
+        return err;
+    }
+
+    bool valid() const { return handle_.row != NULL; }
+
+    void get(T & value) const { datastore_handle_get(&handle_, &value); }
+
+    template <typename U = T>
+    typename std::enable_if<!std::is_array<U>::value, T>::type get() const
+    {
+        T value;
+        datastore_handle_get(&handle_, &value);
+        return value;
+    }
+
+    void set(const T & value) const { datastore_handle_set(&handle_, &value); }
+
+private:
+    datastore_handle_t handle_;
+};
+
+// A datastore holding the resources of a schema. The values of all resources live in one block inside
+// the Store, laid out at compile time; the datastore is created and the resources added on construction,
+// with one handle resolved per resource - the Store's size is that of its values, plus a handle per resource.
+template <typename... Rs>
+class Store
+{
+    static_assert(detail::DistinctIds<Rs...>::value, "resource IDs in a schema must be distinct");
+    typedef detail::Layout<0, Rs...> Layout;
+
+public:
+    static constexpr size_t storage_size = Layout::size;
+
+    // Offset of a resource's first value in the storage block
+    template <typename R>
+    static constexpr size_t offset_of()
+    {
+        return detail::OffsetOf<R, 0, Rs...>::value;
+    }
+
+    Store() : datastore_(datastore_create()), status_(DATASTORE_STATUS_OK), handles_()
+    {
+        std::memset(storage_, 0, sizeof(storage_));
+        if (datastore_ != NULL)
+        {
+            int expand[] = { 0, (add<Rs>(), 0)... };
+            (void)expand;
+        }
+        else
+        {
+            status_ = DATASTORE_STATUS_ERROR_OUT_OF_MEMORY;
+        }
+    }
+
+    ~Store()
+    {
+        if (datastore_ != NULL)
+        {
+            datastore_free(&datastore_);
+        }
+    }
+
+    Store(const Store &) = delete;
+    Store & operator=(const Store &) = delete;
+
+    // DATASTORE_STATUS_OK, or the first error from construction
+    datastore_status_t status() const { return status_; }
+
+    // For the rest of the C API - callbacks, names, TTLs and so on
+    const datastore_t * c_datastore() const { return datastore_; }
+
+    // The resource, type and layout are checked at compile time - only the instance is checked here
+    template <typename R>
+    datastore_status_t get(datastore_instance_id_t instance, typename R::value_type & value) const
+    {
+        const datastore_handle_t * handle = find<R>(instance);
+        datastore_status_t err = handle != NULL ? DATASTORE_STATUS_OK : failure();
+        if (err == DATASTORE_STATUS_OK)
+        {
+            datastore_handle_get_instance(handle, instance, &value);
+        }
+        return err;
+    }
+
+    // Returns a default value if the instance is invalid
+    template <typename R>
+    typename std::enable_if<!std::is_array<typename R::value_type>::value, typename R::value_type>::type get(datastore_instance_id_t instance = 0) const
+    {
+        typename R::value_type value = typename R::value_type();
+        get<R>(instance, value);
+        return value;
+    }
+
+    template <typename R>
+    datastore_status_t set(datastore_instance_id_t instance, typename detail::Argument<typename R::value_type>::type value) const
+    {
+        const datastore_handle_t * handle = find<R>(instance);
+        return handle != NULL ? detail::Write<typename R::value_type>::apply(*handle, instance, value) : failure();
+    }
+
+    // For repeated access to one instance
+    template <typename R>
+    datastore_status_t resolve(datastore_instance_id_t instance, Handle<typename R::value_type> & handle) const
+    {
+        check<R>();
+        return handle.resolve(datastore_, R::id, instance);
+    }
+
+private:
+    template <typename R>
+    static void check()
+    {
+        static_assert(detail::Contains<R, Rs...>::value, "resource is not in the schema");
+    }
+
+    // The resource's handle if the instance is in range, or NULL - also if the Store failed to construct
+    template <typename R>
+    const datastore_handle_t * find(datastore_instance_id_t instance) const
+    {
+        check<R>();
+        return (uint32_t)instance < R::num_instances && status_ == DATASTORE_STATUS_OK
+            ? &handles_[detail::IndexOf<R, Rs...>::value] : NULL;
+    }
+
+    datastore_status_t failure() const
+    {
+        return status_ != DATASTORE_STATUS_OK ? status_ : DATASTORE_STATUS_ERROR_INVALID_INSTANCE;
+    }
+
+    template <typename R>
+    void add()
+    {
+        datastore_resource_t resource = { storage_ + offset_of<R>(), sizeof(typename R::value_type), R::type, R::num_instances, R::flags, false };
+        datastore_status_t err = datastore_add_resource(datastore_, R::id, resource);
+        if (err == DATASTORE_STATUS_OK)
+        {
+            err = datastore_resolve(datastore_, R::id, 0, R::type, &handles_[detail::IndexOf<R, Rs...>::value]);
+        }
+        if (status_ == DATASTORE_STATUS_OK)
+        {
+            status_ = err;
+        }
+    }
+
+    datastore_t * datastore_;
+    datastore_status_t status_;
+    std::array<datastore_handle_t, sizeof...(Rs)> handles_;   // one per resource, in schema order - get and set supply the instance
+    alignas(Layout::alignment) uint8_t storage_[Layout::size > 0 ? Layout::size : 1];
+};
+
+} // namespace datastore
+
+#endif // DATASTORE_HPP
@@ -25,8 +25,12 @@
 #ifndef PLATFORM_ESP32_H
 #define PLATFORM_ESP32_H
 
+#include <stdbool.h>
+
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "esp_timer.h"
 
@@ -42,13 +46,80 @@ extern "C" {
 #define platform_debug(...)    ESP_LOGD(TAG, __VA_ARGS__)
 #define platform_hexdump(P, S) ESP_LOG_BUFFER_HEXDUMP(TAG, P, S, ESP_LOG_DEBUG)
 
-typedef SemaphoreHandle_t platform_semaphore_t;
-#define platform_semaphore_create()   xSemaphoreCreateMutex()
-#define platform_semaphore_delete(S)  vSemaphoreDelete(S)
-#define platform_semaphore_take(S)    xSemaphoreTake(S, portMAX_DELAY)
-#define platform_semaphore_give(S)    xSemaphoreGive(S)
+typedef struct
+{
+    SemaphoreHandle_t handle;
+    StaticSemaphore_t buffer;
+} platform_semaphore_t;
+#define platform_semaphore_create(S)  do { (S)->handle = xSemaphoreCreateMutexStatic(&(S)->buffer); } while (0)
+#define platform_semaphore_delete(S)  vSemaphoreDelete((S)->handle)
+#define platform_semaphore_take(S)    xSemaphoreTake((S)->handle, portMAX_DELAY)
+#define platform_semaphore_give(S)    xSemaphoreGive((S)->handle)
+
+// FreeRTOS has no reader/writer lock - shared access is exclusive
+#define platform_semaphore_take_shared(S)  platform_semaphore_take(S)
+#define platform_semaphore_give_shared(S)  platform_semaphore_give(S)
+
+typedef platform_semaphore_t platform_mutex_t;
+#define platform_mutex_create(M)  platform_semaphore_create(M)
+#define platform_mutex_delete(M)  platform_semaphore_delete(M)
+#define platform_mutex_take(M)    platform_semaphore_take(M)
+#define platform_mutex_give(M)    platform_semaphore_give(M)
+
+#define platform_aligned_alloc(A, S)  heap_caps_aligned_alloc((A), (S), MALLOC_CAP_DEFAULT)
+#define platform_aligned_free(P)      heap_caps_aligned_free(P)
 
 #define platform_get_time() esp_timer_get_time()
+#define platform_get_time_coarse() esp_timer_get_time()   // already cheap and monotonic
+
+typedef struct
+{
+    SemaphoreHandle_t handle;
+    StaticSemaphore_t buffer;
+} platform_counting_semaphore_t;
+#define platform_counting_semaphore_create(S, I)  do { (S)->handle = xSemaphoreCreateCountingStatic(0x7fffffff, (I), &(S)->buffer); } while (0)
+#define platform_counting_semaphore_delete(S)     vSemaphoreDelete((S)->handle)
+#define platform_counting_semaphore_take(S)       xSemaphoreTake((S)->handle, portMAX_DELAY)
+#define platform_counting_semaphore_try_take(S)   (xSemaphoreTake((S)->handle, 0) == pdTRUE)
+#define platform_counting_semaphore_take_timeout(S, US)  (xSemaphoreTake((S)->handle, pdMS_TO_TICKS(((US) + 999) / 1000)) == pdTRUE)
+#define platform_counting_semaphore_give(S)       xSemaphoreGive((S)->handle)
+
+// FreeRTOS tasks cannot be joined - the task signals a semaphore as it exits instead
+typedef struct
+{
+    TaskHandle_t handle;
+    SemaphoreHandle_t done;
+    StaticSemaphore_t done_buffer;
+    void (*func)(void * arg);
+    void * arg;
+} platform_thread_t;
+
+#define PLATFORM_THREAD_STACK_SIZE 4096
+#define PLATFORM_THREAD_PRIORITY   (tskIDLE_PRIORITY + 5)
+
+static inline void _platform_thread_main(void * arg)
+{
+    platform_thread_t * thread = (platform_thread_t *)arg;
+    thread->func(thread->arg);
+    xSemaphoreGive(thread->done);
+    vTaskDelete(NULL);
+}
+
+static inline bool platform_thread_create(platform_thread_t * thread, const char * name, void (*func)(void * arg), void * arg)
+{
+    thread->func = func;
+    thread->arg = arg;
+    thread->done = xSemaphoreCreateBinaryStatic(&thread->done_buffer);
+    return xTaskCreate(_platform_thread_main, name, PLATFORM_THREAD_STACK_SIZE, thread, PLATFORM_THREAD_PRIORITY, &thread->handle) == pdPASS;
+}
+
+static inline void platform_thread_join(platform_thread_t * thread)
+{
+    xSemaphoreTake(thread->done, portMAX_DELAY);
+    vSemaphoreDelete(thread->done);
+}
+
+#define platform_yield() vTaskDelay(1)
 
 #ifdef __cplusplus
 }
@@ -22,47 +22,257 @@
  * SOFTWARE.
  */
 
+#define _GNU_SOURCE  // For PTHREAD_MUTEX_ADAPTIVE_NP and pthread_rwlockattr_setkind_np()
+
+#include <errno.h>
+#include <sched.h>
 #include <stdio.h>
-#include <fcntl.h>   // For O_* constants
-#include <sys/time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include "platform-posix.h"
 
-sem_t * platform_semaphore_create(void)
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 30))
+#  define HAVE_SEM_CLOCKWAIT
+#endif
+
+void platform_semaphore_create(platform_semaphore_t * sem)
+{
+    pthread_rwlockattr_t attr;
+    pthread_rwlockattr_init(&attr);
+#ifdef __GLIBC__
+    // glibc prefers readers by default, so writers could wait indefinitely under a sustained read load
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    int err = pthread_rwlock_init(&sem->rwlock, &attr);
+    if (err != 0)
+    {
+        fprintf(stderr, "pthread_rwlock_init: %s\n", strerror(err));
+    }
+    pthread_rwlockattr_destroy(&attr);
+}
+
+void platform_semaphore_delete(platform_semaphore_t * sem)
+{
+    int err = pthread_rwlock_destroy(&sem->rwlock);
+    if (err != 0)
+    {
+        fprintf(stderr, "pthread_rwlock_destroy: %s\n", strerror(err));
+    }
+}
+
+void platform_semaphore_take(platform_semaphore_t * sem)
+{
+    int err = pthread_rwlock_wrlock(&sem->rwlock);
+    if (err != 0)
+    {
+        fprintf(stderr, "pthread_rwlock_wrlock: %s\n", strerror(err));
+    }
+}
+
+void platform_semaphore_give(platform_semaphore_t * sem)
+{
+    int err = pthread_rwlock_unlock(&sem->rwlock);
+    if (err != 0)
+    {
+        fprintf(stderr, "pthread_rwlock_unlock: %s\n", strerror(err));
+    }
+}
+
+void platform_semaphore_take_shared(platform_semaphore_t * sem)
+{
+    int err = pthread_rwlock_rdlock(&sem->rwlock);
+    if (err != 0)
+    {
+        fprintf(stderr, "pthread_rwlock_rdlock: %s\n", strerror(err));
+    }
+}
+
+void platform_semaphore_give_shared(platform_semaphore_t * sem)
+{
+    int err = pthread_rwlock_unlock(&sem->rwlock);
+    if (err != 0)
+    {
+        fprintf(stderr, "pthread_rwlock_unlock: %s\n", strerror(err));
+    }
+}
+
+void platform_mutex_create(platform_mutex_t * mutex)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+#ifdef PTHREAD_ADAPTIVE_MUTEX_INITIALIZER_NP
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_ADAPTIVE_NP);
+#endif
+    int err = pthread_mutex_init(&mutex->mutex, &attr);
+    if (err != 0)
+    {
+        fprintf(stderr, "pthread_mutex_init: %s\n", strerror(err));
+    }
+    pthread_mutexattr_destroy(&attr);
+}
+
+void platform_mutex_delete(platform_mutex_t * mutex)
+{
+    int err = pthread_mutex_destroy(&mutex->mutex);
+    if (err != 0)
+    {
+        fprintf(stderr, "pthread_mutex_destroy: %s\n", strerror(err));
+    }
+}
+
+void platform_mutex_take(platform_mutex_t * mutex)
+{
+    int err = pthread_mutex_lock(&mutex->mutex);
+    if (err != 0)
+    {
+        fprintf(stderr, "pthread_mutex_lock: %s\n", strerror(err));
+    }
+}
+
+void platform_mutex_give(platform_mutex_t * mutex)
+{
+    int err = pthread_mutex_unlock(&mutex->mutex);
+    if (err != 0)
+    {
+        fprintf(stderr, "pthread_mutex_unlock: %s\n", strerror(err));
+    }
+}
+
+void platform_counting_semaphore_create(platform_counting_semaphore_t * sem, uint32_t initial)
 {
-    sem_t * sem = sem_open("/datastore", O_CREAT /* | O_EXCL*/, 0644, 1);
-    if (sem == SEM_FAILED)
+    if (sem_init(&sem->sem, 0, initial) != 0)
     {
-        perror("sem_open");
+        perror("sem_init");
     }
-    return sem;
 }
 
-void platform_semaphore_delete(sem_t * sem)
+void platform_counting_semaphore_delete(platform_counting_semaphore_t * sem)
 {
-    sem_close(sem);
-    sem_unlink("/datastore");
+    if (sem_destroy(&sem->sem) != 0)
+    {
+        perror("sem_destroy");
+    }
 }
 
-void platform_semaphore_take(sem_t * sem)
+void platform_counting_semaphore_take(platform_counting_semaphore_t * sem)
 {
-    if (sem_wait(sem) != 0)
+    while (sem_wait(&sem->sem) != 0)
     {
-        perror("sem_wait");
+        if (errno != EINTR)
+        {
+            perror("sem_wait");
+            break;
+        }
     }
 }
 
-void platform_semaphore_give(sem_t * sem)
+bool platform_counting_semaphore_try_take(platform_counting_semaphore_t * sem)
+{
+    int err = 0;
+    while ((err = sem_trywait(&sem->sem)) != 0 && errno == EINTR);
+    return err == 0;
+}
+
+bool platform_counting_semaphore_take_timeout(platform_counting_semaphore_t * sem, uint64_t timeout_us)
 {
-    if (sem_post(sem) != 0)
+    // timed waits are measured against the monotonic clock where the C library can
+#ifdef HAVE_SEM_CLOCKWAIT
+    clockid_t clock = CLOCK_MONOTONIC;
+#else
+    clockid_t clock = CLOCK_REALTIME;
+#endif
+    struct timespec deadline;
+    clock_gettime(clock, &deadline);
+    deadline.tv_sec += timeout_us / 1000000;
+    deadline.tv_nsec += (timeout_us % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000)
+    {
+        ++deadline.tv_sec;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    int err = 0;
+#ifdef HAVE_SEM_CLOCKWAIT
+    while ((err = sem_clockwait(&sem->sem, clock, &deadline)) != 0 && errno == EINTR);
+#else
+    while ((err = sem_timedwait(&sem->sem, &deadline)) != 0 && errno == EINTR);
+#endif
+    return err == 0;
+}
+
+void platform_counting_semaphore_give(platform_counting_semaphore_t * sem)
+{
+    if (sem_post(&sem->sem) != 0)
     {
         perror("sem_post");
     }
 }
 
+static void * _thread_main(void * arg)
+{
+    platform_thread_t * thread = (platform_thread_t *)arg;
+    thread->func(thread->arg);
+    return NULL;
+}
+
+bool platform_thread_create(platform_thread_t * thread, const char * name, void (*func)(void * arg), void * arg)
+{
+    (void)name;
+    thread->func = func;
+    thread->arg = arg;
+    int err = pthread_create(&thread->handle, NULL, _thread_main, thread);
+    if (err != 0)
+    {
+        fprintf(stderr, "pthread_create: %s\n", strerror(err));
+    }
+    return err == 0;
+}
+
+void platform_thread_join(platform_thread_t * thread)
+{
+    int err = pthread_join(thread->handle, NULL);
+    if (err != 0)
+    {
+        fprintf(stderr, "pthread_join: %s\n", strerror(err));
+    }
+}
+
+void platform_yield(void)
+{
+    sched_yield();
+}
+
+void * platform_aligned_alloc(size_t alignment, size_t size)
+{
+    void * ptr = NULL;
+    if (posix_memalign(&ptr, alignment, size) != 0)
+    {
+        ptr = NULL;
+    }
+    return ptr;
+}
+
+void platform_aligned_free(void * ptr)
+{
+    free(ptr);
+}
+
 uint64_t platform_get_time(void)
 {
-    struct timeval now;
-    gettimeofday(&now, NULL);
-    return now.tv_sec * 1000000 + now.tv_usec;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+uint64_t platform_get_time_coarse(void)
+{
+#ifdef CLOCK_MONOTONIC_COARSE
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#else
+    return platform_get_time();
+#endif
 }
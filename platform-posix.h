@@ -25,7 +25,9 @@
 #ifndef PLATFORM_POSIX_H
 #define PLATFORM_POSIX_H
 
+#include <pthread.h>
 #include <semaphore.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 
@@ -39,14 +41,65 @@ extern "C" {
 #define platform_debug(f, ...)   do { /*fprintf(stdout, f"\n", ##__VA_ARGS__);*/ } while (0)
 #define platform_hexdump(P, S)
 
-typedef sem_t * platform_semaphore_t;
+// Each datastore embeds its own lock, so independent datastores never contend with each other.
+// The lock can be taken exclusively (writers) or shared (readers). Waiting writers hold back new
+// readers, so a steady stream of reads cannot starve them - a thread must not take it shared twice.
+typedef struct
+{
+    pthread_rwlock_t rwlock;
+} platform_semaphore_t;
 
-sem_t * platform_semaphore_create(void);
-void platform_semaphore_delete(sem_t * sem);
-void platform_semaphore_take(sem_t * sem);
-void platform_semaphore_give(sem_t * sem);
+void platform_semaphore_create(platform_semaphore_t * sem);
+void platform_semaphore_delete(platform_semaphore_t * sem);
+void platform_semaphore_take(platform_semaphore_t * sem);
+void platform_semaphore_give(platform_semaphore_t * sem);
+void platform_semaphore_take_shared(platform_semaphore_t * sem);
+void platform_semaphore_give_shared(platform_semaphore_t * sem);
 
+// Exclusive-only lock for the datastore's internal structures. Adaptive where supported -
+// it spins briefly before parking, as the critical sections are very short.
+typedef struct
+{
+    pthread_mutex_t mutex;
+} platform_mutex_t;
+
+void platform_mutex_create(platform_mutex_t * mutex);
+void platform_mutex_delete(platform_mutex_t * mutex);
+void platform_mutex_take(platform_mutex_t * mutex);
+void platform_mutex_give(platform_mutex_t * mutex);
+
+// Counting semaphore, used to wake notifier workers and to hold back writers when its queue is full.
+// Giving and taking an available count are atomic operations - only a thread that has to wait enters the kernel.
+typedef struct
+{
+    sem_t sem;
+} platform_counting_semaphore_t;
+
+void platform_counting_semaphore_create(platform_counting_semaphore_t * sem, uint32_t initial);
+void platform_counting_semaphore_delete(platform_counting_semaphore_t * sem);
+void platform_counting_semaphore_take(platform_counting_semaphore_t * sem);
+bool platform_counting_semaphore_try_take(platform_counting_semaphore_t * sem);
+bool platform_counting_semaphore_take_timeout(platform_counting_semaphore_t * sem, uint64_t timeout_us);
+void platform_counting_semaphore_give(platform_counting_semaphore_t * sem);
+
+typedef struct
+{
+    pthread_t handle;
+    void (*func)(void * arg);
+    void * arg;
+} platform_thread_t;
+
+// The thread structure must remain valid until platform_thread_join() returns.
+bool platform_thread_create(platform_thread_t * thread, const char * name, void (*func)(void * arg), void * arg);
+void platform_thread_join(platform_thread_t * thread);
+void platform_yield(void);
+
+void * platform_aligned_alloc(size_t alignment, size_t size);
+void platform_aligned_free(void * ptr);
+
+// Monotonic time in microseconds. The coarse variant is cheaper but has a resolution of a few milliseconds.
 uint64_t platform_get_time(void);
+uint64_t platform_get_time_coarse(void);
 
 #ifdef __cplusplus
 }
@@ -1,5 +1,12 @@
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 #include <gtest/gtest.h>
 #include "datastore.h"
+#include "datastore.hpp"
 
 typedef enum {
     RESOURCE_INVALID = -1,
@@ -27,6 +34,67 @@ TEST(DatastoreTest, free_invalid) {
     datastore_free(&ds);
 }
 
+TEST(DatastoreTest, independent_datastores) {
+    // freeing one datastore must not affect the lock of another
+    datastore_t * ds1 = datastore_create();
+    datastore_t * ds2 = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds1, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 1)));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds2, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 1)));
+    datastore_free(&ds1);
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([ds2]() {
+            uint32_t value = 0;
+            for (uint32_t i = 0; i < 1000; ++i)
+            {
+                EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds2, RESOURCE0, 0, i));
+                EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_uint32(ds2, RESOURCE0, 0, &value));
+            }
+        });
+    }
+    for (auto & thread : threads)
+    {
+        thread.join();
+    }
+    datastore_free(&ds2);
+}
+
+TEST(DatastoreTest, concurrent_readers_and_writer) {
+    // readers share the lock, but must never observe a partially written value
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_string_resource(32, 1)));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_string(ds, RESOURCE0, 0, "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"));
+
+    std::vector<std::thread> threads;
+    threads.emplace_back([ds]() {
+        for (int i = 0; i < 2000; ++i)
+        {
+            EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_string(ds, RESOURCE0, 0, (i % 2) ? "bbbbbbbbbbbbbbbbbbbbbbbbbbbbbbb" : "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa"));
+        }
+    });
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([ds]() {
+            char value[32] = "";
+            char as_string[32] = "";
+            for (int i = 0; i < 2000; ++i)
+            {
+                EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_string(ds, RESOURCE0, 0, value, sizeof(value)));
+                EXPECT_EQ(std::string(31, value[0]), std::string(value));
+                EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_as_string(ds, RESOURCE0, 0, as_string, sizeof(as_string)));
+                EXPECT_EQ(std::string(31, as_string[0]), std::string(as_string));
+            }
+        });
+    }
+    for (auto & thread : threads)
+    {
+        thread.join();
+    }
+    datastore_free(&ds);
+}
+
 TEST(DatastoreTest, add_managed_scalar_uint32) {
     datastore_t * ds = datastore_create();
     EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_fixed_length_resource(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 1));
@@ -97,6 +165,58 @@ TEST(DatastoreTest, add_duplicate_resource1) {
     datastore_free(&ds);
 }
 
+TEST(DatastoreTest, add_sparse_resource_ids) {
+    datastore_t * ds = datastore_create();
+    const datastore_resource_id_t IDS[] = { 5, 1000000, 64, 63, INT32_MAX, 70000 };
+    for (auto id : IDS)
+    {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, id, datastore_create_resource(DATASTORE_TYPE_UINT32, 2)));
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, id, 1, id));
+    }
+    for (auto id : IDS)
+    {
+        uint32_t value = 0;
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_uint32(ds, id, 1, &value));
+        EXPECT_EQ(id, value);
+        EXPECT_EQ(2, datastore_num_instances(ds, id));
+    }
+
+    // IDs between and beyond defined resources are not defined
+    uint32_t value = 0;
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ID, datastore_get_uint32(ds, 6, 0, &value));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ID, datastore_get_uint32(ds, 999999, 0, &value));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ID, datastore_get_uint32(ds, 1000001, 0, &value));
+    EXPECT_EQ(0, datastore_num_instances(ds, 65));
+    EXPECT_EQ(sizeof(IDS) / sizeof(IDS[0]) * 2 * sizeof(uint32_t), datastore_get_ram_usage(ds));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_dump(ds));
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, add_resources_while_reading) {
+    // existing resources remain readable while the index grows
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 1)));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, 42));
+
+    std::atomic<bool> done(false);
+    std::thread reader([ds, &done]() {
+        while (!done)
+        {
+            uint32_t value = 0;
+            EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_uint32(ds, RESOURCE0, 0, &value));
+            EXPECT_EQ(42, value);
+        }
+    });
+    for (datastore_resource_id_t id = 1; id < 100000; id += 97)
+    {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, id, datastore_create_resource(DATASTORE_TYPE_UINT8, 1)));
+    }
+    done = true;
+    reader.join();
+    datastore_free(&ds);
+}
+
 TEST(DatastoreTest, managed_scalar_uint32_defaults_to_zero) {
     datastore_t * ds = datastore_create();
     EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_fixed_length_resource(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 1));
@@ -933,6 +1053,86 @@ TEST(DatastoreTest, test_set_from_set_callback) {
     datastore_free(&ds);
 }
 
+TEST(DatastoreTest, test_set_batch) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 2)));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE1, datastore_create_resource(DATASTORE_TYPE_FLOAT, 1)));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE2, datastore_create_string_resource(16, 1)));
+
+    detail::CallbackRecord record;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 1, detail::callback, &record));
+
+    uint32_t u0 = 42, u1 = 17, u2 = 18;
+    float f = 3.5f;
+    const char * str = "hello";
+    datastore_write_t writes[] = {
+        { RESOURCE0, 0, DATASTORE_TYPE_UINT32, &u0, sizeof(u0) },
+        { RESOURCE0, 1, DATASTORE_TYPE_UINT32, &u1, sizeof(u1) },
+        { RESOURCE1, 0, DATASTORE_TYPE_FLOAT, &f, sizeof(f) },
+        { RESOURCE2, 0, DATASTORE_TYPE_STRING, str, strlen(str) + 1 },
+        { RESOURCE0, 1, DATASTORE_TYPE_UINT32, &u2, sizeof(u2) },
+    };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_batch(ds, writes, sizeof(writes) / sizeof(writes[0])));
+
+    uint32_t value = 0;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_uint32(ds, RESOURCE0, 0, &value)); EXPECT_EQ(42, value);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_uint32(ds, RESOURCE0, 1, &value)); EXPECT_EQ(18, value);
+    float fvalue = 0.0f;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_float(ds, RESOURCE1, 0, &fvalue)); EXPECT_EQ(3.5f, fvalue);
+    char svalue[16] = "";
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_string(ds, RESOURCE2, 0, svalue, sizeof(svalue))); EXPECT_STREQ("hello", svalue);
+
+    // instance written twice, callback invoked once after the batch is applied
+    EXPECT_EQ(1, record.counter);
+    EXPECT_EQ(RESOURCE0, record.last.resource_id);
+    EXPECT_EQ(1, record.last.instance_id);
+
+    datastore_age_t age_us = DATASTORE_INVALID_AGE;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_age(ds, RESOURCE2, 0, &age_us)); EXPECT_NE(DATASTORE_INVALID_AGE, age_us);
+
+    // empty batch is a no-op
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_batch(ds, NULL, 0));
+    EXPECT_EQ(1, record.counter);
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_set_batch_invalid) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 2)));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE1, datastore_create_string_resource(4, 1)));
+
+    uint32_t u = 42;
+    uint8_t u8 = 1;
+    const char * str = "too long";
+    datastore_write_t write = { RESOURCE0, 0, DATASTORE_TYPE_UINT32, &u, sizeof(u) };
+
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_set_batch(NULL, &write, 1));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_set_batch(ds, NULL, 1));
+
+    // one bad write rejects the whole batch
+    datastore_write_t writes[] = { write, write };
+    writes[1] = { RESOURCE2, 0, DATASTORE_TYPE_UINT32, &u, sizeof(u) };
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ID, datastore_set_batch(ds, writes, 2));
+    writes[1] = { RESOURCE0, 2, DATASTORE_TYPE_UINT32, &u, sizeof(u) };
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_INSTANCE, datastore_set_batch(ds, writes, 2));
+    writes[1] = { RESOURCE0, 1, DATASTORE_TYPE_INT32, &u, sizeof(u) };
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_TYPE, datastore_set_batch(ds, writes, 2));
+    writes[1] = { RESOURCE0, 1, DATASTORE_TYPE_UINT32, &u8, sizeof(u8) };
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_TOO_LARGE, datastore_set_batch(ds, writes, 2));
+    writes[1] = { RESOURCE0, 1, DATASTORE_TYPE_UINT32, NULL, sizeof(u) };
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_set_batch(ds, writes, 2));
+    writes[1] = { RESOURCE1, 0, DATASTORE_TYPE_STRING, str, strlen(str) + 1 };
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_TOO_LARGE, datastore_set_batch(ds, writes, 2));
+
+    uint32_t value = 0;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_uint32(ds, RESOURCE0, 0, &value)); EXPECT_EQ(0, value);
+    datastore_age_t age_us = 0;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_age(ds, RESOURCE0, 0, &age_us)); EXPECT_EQ(DATASTORE_INVALID_AGE, age_us);
+
+    datastore_free(&ds);
+}
+
 TEST(DatastoreTest, test_get_number_of_instances) {
     datastore_t * ds = datastore_create();
     EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 1)));
@@ -1167,6 +1367,101 @@ TEST(DatastoreTest, test_add_invalid) {
     datastore_free(&ds);
 }
 
+namespace detail {
+    static void counting_callback(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, void * context) {
+        static_cast<std::atomic<int> *>(context)->fetch_add(1);
+    }
+
+    static void concurrent_increments(datastore_t * ds, datastore_resource_id_t id, int num_threads, int num_increments) {
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; ++t)
+        {
+            threads.emplace_back([ds, id, num_increments]() {
+                for (int i = 0; i < num_increments; ++i)
+                {
+                    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_increment(ds, id, 0));
+                }
+            });
+        }
+        for (auto & thread : threads)
+        {
+            thread.join();
+        }
+    }
+}
+
+TEST(DatastoreTest, test_concurrent_increment_no_lost_updates) {
+    const int NUM_THREADS = 8;
+    const int NUM_INCREMENTS = 10000;
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 1)));
+
+    datastore_resource_t resource = datastore_create_resource(DATASTORE_TYPE_INT32, 1);
+    resource.flags = DATASTORE_RESOURCE_FLAG_ATOMIC;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE1, resource));
+
+    std::atomic<int> calls0(0);
+    std::atomic<int> calls1(0);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 0, detail::counting_callback, &calls0));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE1, 0, detail::counting_callback, &calls1));
+
+    detail::concurrent_increments(ds, RESOURCE0, NUM_THREADS, NUM_INCREMENTS);
+    detail::concurrent_increments(ds, RESOURCE1, NUM_THREADS, NUM_INCREMENTS);
+
+    uint32_t value0 = 0;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_uint32(ds, RESOURCE0, 0, &value0));
+    EXPECT_EQ(NUM_THREADS * NUM_INCREMENTS, value0);
+    EXPECT_EQ(NUM_THREADS * NUM_INCREMENTS, calls0.load());
+
+    int32_t value1 = 0;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_int32(ds, RESOURCE1, 0, &value1));
+    EXPECT_EQ(NUM_THREADS * NUM_INCREMENTS, value1);
+    EXPECT_EQ(NUM_THREADS * NUM_INCREMENTS, calls1.load());
+
+    datastore_age_t age_us = DATASTORE_INVALID_AGE;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_age(ds, RESOURCE1, 0, &age_us));
+    EXPECT_NE(DATASTORE_INVALID_AGE, age_us);
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_atomic_resource) {
+    datastore_t * ds = datastore_create();
+    datastore_resource_t resource = datastore_create_resource(DATASTORE_TYPE_INT8, 2);
+    resource.flags = DATASTORE_RESOURCE_FLAG_ATOMIC;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, resource));
+    resource = datastore_create_resource(DATASTORE_TYPE_BOOL, 1);
+    resource.flags = DATASTORE_RESOURCE_FLAG_ATOMIC;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE1, resource));
+
+    int8_t value = 0;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_int8(ds, RESOURCE0, 1, 126));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add(ds, RESOURCE0, 1, 3));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_int8(ds, RESOURCE0, 1, &value));
+    EXPECT_EQ(-127, value);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add(ds, RESOURCE0, 1, -10));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_int8(ds, RESOURCE0, 1, &value));
+    EXPECT_EQ(119, value);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_int8(ds, RESOURCE0, 0, &value));
+    EXPECT_EQ(0, value);
+
+    bool flag = false;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_increment(ds, RESOURCE1, 0));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_bool(ds, RESOURCE1, 0, &flag));
+    EXPECT_TRUE(flag);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add(ds, RESOURCE1, 0, 5));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_bool(ds, RESOURCE1, 0, &flag));
+    EXPECT_FALSE(flag);
+
+    // only integer and bool resources can be atomic
+    resource = datastore_create_resource(DATASTORE_TYPE_FLOAT, 1);
+    resource.flags = DATASTORE_RESOURCE_FLAG_ATOMIC;
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_TYPE, datastore_add_resource(ds, RESOURCE2, resource));
+    free(resource.data);
+
+    datastore_free(&ds);
+}
+
 TEST(DatastoreTest, test_set_and_get_name) {
     datastore_t * ds = datastore_create();
     EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 10)));
@@ -1191,6 +1486,64 @@ TEST(DatastoreTest, test_set_and_get_name) {
     datastore_free(&ds);
 }
 
+TEST(DatastoreTest, test_find_by_name) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 1)));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE1, datastore_create_resource(DATASTORE_TYPE_UINT32, 1)));
+
+    datastore_resource_id_t id = RESOURCE_INVALID;
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ID, datastore_find_by_name(ds, "name0", &id));
+
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_name(ds, RESOURCE0, "name0"));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_name(ds, RESOURCE1, "name1"));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_find_by_name(ds, "name0", &id)); EXPECT_EQ(RESOURCE0, id);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_find_by_name(ds, "name1", &id)); EXPECT_EQ(RESOURCE1, id);
+
+    // renaming removes the old name
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_name(ds, RESOURCE0, "renamed"));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ID, datastore_find_by_name(ds, "name0", &id));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_find_by_name(ds, "renamed", &id)); EXPECT_EQ(RESOURCE0, id);
+
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_name(ds, RESOURCE1, NULL));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ID, datastore_find_by_name(ds, "name1", &id));
+
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_find_by_name(NULL, "renamed", &id));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_find_by_name(ds, NULL, &id));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_find_by_name(ds, "renamed", NULL));
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_find_by_name_many) {
+    const int NUM_RESOURCES = 1000;
+    datastore_t * ds = datastore_create();
+    for (int i = 0; i < NUM_RESOURCES; ++i)
+    {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, i, datastore_create_resource(DATASTORE_TYPE_UINT8, 1)));
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_name(ds, i, ("resource" + std::to_string(i)).c_str()));
+    }
+    // rename half of them to exercise deleted slots
+    for (int i = 0; i < NUM_RESOURCES; i += 2)
+    {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_name(ds, i, ("even" + std::to_string(i)).c_str()));
+    }
+    for (int i = 0; i < NUM_RESOURCES; ++i)
+    {
+        datastore_resource_id_t id = RESOURCE_INVALID;
+        if (i % 2 == 0)
+        {
+            EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ID, datastore_find_by_name(ds, ("resource" + std::to_string(i)).c_str(), &id));
+            EXPECT_EQ(DATASTORE_STATUS_OK, datastore_find_by_name(ds, ("even" + std::to_string(i)).c_str(), &id));
+        }
+        else
+        {
+            EXPECT_EQ(DATASTORE_STATUS_OK, datastore_find_by_name(ds, ("resource" + std::to_string(i)).c_str(), &id));
+        }
+        EXPECT_EQ(i, id);
+    }
+    datastore_free(&ds);
+}
+
 TEST(DatastoreTest, test_get_as_string) {
     datastore_t * ds = datastore_create();
     EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_BOOL, 1)));
@@ -1559,6 +1912,56 @@ TEST(DatastoreTest, test_set_as_string_invalid) {
     datastore_free(&ds);
 }
 
+TEST(DatastoreTest, test_lock_free_reads) {
+    datastore_t * ds = datastore_create();
+    datastore_resource_t resource = datastore_create_resource(DATASTORE_TYPE_DOUBLE, 4);
+    resource.flags = DATASTORE_RESOURCE_FLAG_LOCK_FREE_READS;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, resource));
+
+    double value = 1.0;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_double(ds, RESOURCE0, 3, &value));
+    EXPECT_EQ(0.0, value);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_double(ds, RESOURCE0, 3, 42.5));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_double(ds, RESOURCE0, 3, &value));
+    EXPECT_EQ(42.5, value);
+
+    // readers must never observe a partially written value
+    const double A = 1.0;
+    const double B = -1.0e300;
+    std::vector<std::thread> threads;
+    threads.emplace_back([ds, A, B]() {
+        for (int i = 0; i < 20000; ++i)
+        {
+            EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_double(ds, RESOURCE0, 0, (i % 2) ? A : B));
+        }
+    });
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([ds, A, B]() {
+            for (int i = 0; i < 20000; ++i)
+            {
+                double v = 0.0;
+                EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_double(ds, RESOURCE0, 0, &v));
+                EXPECT_TRUE(v == 0.0 || v == A || v == B);
+            }
+        });
+    }
+    for (auto & thread : threads)
+    {
+        thread.join();
+    }
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_lock_free_reads_invalid_type) {
+    datastore_t * ds = datastore_create();
+    datastore_resource_t resource = datastore_create_string_resource(16, 1);
+    resource.flags = DATASTORE_RESOURCE_FLAG_LOCK_FREE_READS;
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_TYPE, datastore_add_resource(ds, RESOURCE0, resource));
+    free(resource.data);
+    datastore_free(&ds);
+}
+
 TEST(DatastoreTest, test_get_default_age) {
     datastore_t * ds = datastore_create();
     EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_BOOL, 3)));
@@ -1600,6 +2003,185 @@ TEST(DatastoreTest, test_independent_age_per_instance) {
     datastore_free(&ds);
 }
 
+TEST(DatastoreTest, test_get_age_with_coarse_clock) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_clock(ds, DATASTORE_CLOCK_COARSE));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 2)));
+
+    datastore_age_t age_us = 0;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, 1));
+    usleep(200000);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_age(ds, RESOURCE0, 0, &age_us));
+    EXPECT_GT(age_us, 200000 - AGE_THRESHOLD);
+    EXPECT_LT(age_us, 200000 + AGE_THRESHOLD);
+
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ARGUMENT, datastore_set_clock(ds, DATASTORE_CLOCK_LAST));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_set_clock(NULL, DATASTORE_CLOCK_MONOTONIC));
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_no_timestamp) {
+    datastore_t * ds = datastore_create();
+    datastore_resource_t resource = datastore_create_resource(DATASTORE_TYPE_UINT32, 4);
+    resource.flags = DATASTORE_RESOURCE_FLAG_NO_TIMESTAMP;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, resource));
+    resource = datastore_create_resource(DATASTORE_TYPE_UINT32, 2);
+    resource.flags = DATASTORE_RESOURCE_FLAG_NO_TIMESTAMP | DATASTORE_RESOURCE_FLAG_ATOMIC;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE1, resource));
+
+    // values are stored as usual, but never have an age
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, 42));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_increment(ds, RESOURCE0, 1));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_increment(ds, RESOURCE1, 0));
+    uint32_t values[] = { 1, 2 };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 2, 2, values, sizeof(values)));
+    datastore_write_t write = { RESOURCE1, 1, DATASTORE_TYPE_UINT32, &values[0], sizeof(values[0]) };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_batch(ds, &write, 1));
+
+    uint32_t value = 0;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_uint32(ds, RESOURCE0, 0, &value)); EXPECT_EQ(42, value);
+    datastore_age_t age_us = 0;
+    for (datastore_instance_id_t i = 0; i < 4; ++i)
+    {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_age(ds, RESOURCE0, i, &age_us)); EXPECT_EQ(DATASTORE_INVALID_AGE, age_us);
+    }
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_age(ds, RESOURCE1, 0, &age_us)); EXPECT_EQ(DATASTORE_INVALID_AGE, age_us);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_age(ds, RESOURCE1, 1, &age_us)); EXPECT_EQ(DATASTORE_INVALID_AGE, age_us);
+    datastore_free(&ds);
+}
+
+namespace detail {
+    struct StaleRecord {
+        StaleRecord() : datastore(nullptr), calls{} {}
+        const datastore_t * datastore;
+        std::atomic<int> calls[3];
+    };
+
+    static void stale_callback(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, void * context) {
+        StaleRecord * record = static_cast<StaleRecord *>(context);
+        EXPECT_EQ(record->datastore, datastore);
+        EXPECT_EQ(RESOURCE0, id);
+        ++record->calls[instance];
+    }
+}
+
+TEST(DatastoreTest, test_ttl) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 3)));
+    detail::StaleRecord record;
+    record.datastore = ds;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 1, 1));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_ttl(ds, RESOURCE0, 100000, detail::stale_callback, &record));
+
+    // instance 0 is kept fresh, 1 was set once, 2 never
+    for (int i = 0; i < 30; ++i)
+    {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, i));
+        usleep(10000);
+    }
+    EXPECT_EQ(0, record.calls[0]);
+    EXPECT_EQ(1, record.calls[1]);
+    EXPECT_EQ(1, record.calls[2]);
+
+    // reported again only after being set and going stale again
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 1, 2));
+    usleep(300000);
+    EXPECT_EQ(1, record.calls[0]);
+    EXPECT_EQ(2, record.calls[1]);
+    EXPECT_EQ(1, record.calls[2]);
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_ttl_shortened) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 3)));
+    detail::StaleRecord record;
+    record.datastore = ds;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, 1));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 1, 1));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_ttl(ds, RESOURCE0, 10000000, detail::stale_callback, &record));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_ttl(ds, RESOURCE0, 5000000, detail::stale_callback, &record));
+
+    // the new TTL applies to instances already armed with the old one, never-set ones included
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_ttl(ds, RESOURCE0, 100000, detail::stale_callback, &record));
+    usleep(50000);
+    EXPECT_EQ(0, record.calls[0]);
+    usleep(250000);
+    EXPECT_EQ(1, record.calls[0]);
+    EXPECT_EQ(1, record.calls[1]);
+    EXPECT_EQ(1, record.calls[2]);
+
+    // reported instances are not armed again, and each is still reported only once
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 1, 2));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_ttl(ds, RESOURCE0, 50000, detail::stale_callback, &record));
+    usleep(200000);
+    EXPECT_EQ(1, record.calls[0]);
+    EXPECT_EQ(2, record.calls[1]);
+    EXPECT_EQ(1, record.calls[2]);
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_ttl_invalid) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 3)));
+    datastore_resource_t resource = datastore_create_resource(DATASTORE_TYPE_UINT32, 1);
+    resource.flags = DATASTORE_RESOURCE_FLAG_NO_TIMESTAMP;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE1, resource));
+    detail::StaleRecord record;
+
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ARGUMENT, datastore_set_ttl(ds, RESOURCE0, 0, detail::stale_callback, &record));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ARGUMENT, datastore_set_ttl(ds, RESOURCE1, 1000, detail::stale_callback, &record));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ID, datastore_set_ttl(ds, RESOURCE2, 1000, detail::stale_callback, &record));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_set_ttl(ds, RESOURCE0, 1000, NULL, &record));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_set_ttl(NULL, RESOURCE0, 1000, detail::stale_callback, &record));
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_find_stale) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 3)));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE1, datastore_create_resource(DATASTORE_TYPE_FLOAT, 2)));
+    datastore_resource_t resource = datastore_create_resource(DATASTORE_TYPE_UINT32, 2);
+    resource.flags = DATASTORE_RESOURCE_FLAG_NO_TIMESTAMP;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE2, resource));
+
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, 1));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_float(ds, RESOURCE1, 1, 1.0f));
+    usleep(200000);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 1, 1));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_float(ds, RESOURCE1, 0, 1.0f));
+
+    // stale and never-set instances, in ID order; resources without timestamps are skipped
+    datastore_stale_t stale[4];
+    size_t num_stale = 0;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_find_stale(ds, 100000, stale, 4, &num_stale));
+    ASSERT_EQ(3, num_stale);
+    EXPECT_EQ(RESOURCE0, stale[0].id); EXPECT_EQ(0, stale[0].instance);
+    EXPECT_GT(stale[0].age_us, 200000);
+    EXPECT_LT(stale[0].age_us, 200000 + AGE_THRESHOLD);
+    EXPECT_EQ(RESOURCE0, stale[1].id); EXPECT_EQ(2, stale[1].instance); EXPECT_EQ(DATASTORE_INVALID_AGE, stale[1].age_us);
+    EXPECT_EQ(RESOURCE1, stale[2].id); EXPECT_EQ(1, stale[2].instance);
+
+    // the total is reported even when it does not fit
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_find_stale(ds, 100000, stale, 1, &num_stale));
+    EXPECT_EQ(3, num_stale);
+    EXPECT_EQ(RESOURCE0, stale[0].id); EXPECT_EQ(0, stale[0].instance);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_find_stale(ds, 100000, NULL, 0, &num_stale));
+    EXPECT_EQ(3, num_stale);
+
+    // nothing set within a minute is stale, except what was never set
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_find_stale(ds, 60000000, stale, 4, &num_stale));
+    ASSERT_EQ(1, num_stale);
+    EXPECT_EQ(DATASTORE_INVALID_AGE, stale[0].age_us);
+
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_find_stale(NULL, 0, stale, 4, &num_stale));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_find_stale(ds, 0, stale, 4, NULL));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_find_stale(ds, 0, NULL, 4, &num_stale));
+    datastore_free(&ds);
+}
+
 TEST(DatastoreTest, test_get_age_after_delay) {
     datastore_t * ds = datastore_create();
     EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_BOOL, 3)));
@@ -1629,24 +2211,1485 @@ TEST(DatastoreTest, test_get_age_invalid) {
     datastore_free(&ds);
 }
 
-TEST(DatastoreTest, test_get_ram_usage) {
+TEST(DatastoreTest, test_get_batch) {
     datastore_t * ds = datastore_create();
-    size_t expected_usage = 0;
-    EXPECT_EQ(expected_usage, datastore_get_ram_usage(ds));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 2)));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE1, datastore_create_resource(DATASTORE_TYPE_DOUBLE, 1)));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE2, datastore_create_string_resource(16, 1)));
 
-    // memory is only allocated at the time resources are defined
-    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT8, 4)));
-    expected_usage += 4 * sizeof(bool);
-    EXPECT_EQ(expected_usage, datastore_get_ram_usage(ds));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 1, 42));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_double(ds, RESOURCE1, 0, 2.25));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_string(ds, RESOURCE2, 0, "hello world"));
 
-    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE1, datastore_create_resource(DATASTORE_TYPE_INT32, 7)));
-    expected_usage += 7 * sizeof(int32_t);
-    EXPECT_EQ(expected_usage, datastore_get_ram_usage(ds));
+    uint32_t u0 = 99, u1 = 0;
+    double d = 0.0;
+    char str[6] = "";
+    datastore_read_t reads[] = {
+        { RESOURCE0, 0, DATASTORE_TYPE_UINT32, &u0, sizeof(u0) },
+        { RESOURCE0, 1, DATASTORE_TYPE_UINT32, &u1, sizeof(u1) },
+        { RESOURCE1, 0, DATASTORE_TYPE_DOUBLE, &d, sizeof(d) },
+        { RESOURCE2, 0, DATASTORE_TYPE_STRING, str, sizeof(str) },
+    };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_batch(ds, reads, sizeof(reads) / sizeof(reads[0])));
+
+    EXPECT_EQ(0, u0);
+    EXPECT_EQ(42, u1);
+    EXPECT_EQ(2.25, d);
+    EXPECT_STREQ("hello", str);  // truncated
+    for (const auto & read : reads)
+    {
+        EXPECT_EQ(DATASTORE_STATUS_OK, read.status);
+    }
+    EXPECT_EQ(DATASTORE_INVALID_AGE, reads[0].age_us);
+    EXPECT_LT(reads[1].age_us, AGE_THRESHOLD);
+    EXPECT_LT(reads[3].age_us, AGE_THRESHOLD);
+
+    // invalid entries are reported individually, valid entries are still read
+    u1 = 0;
+    datastore_read_t mixed[] = {
+        { RESOURCE3, 0, DATASTORE_TYPE_UINT32, &u0, sizeof(u0) },
+        { RESOURCE0, 1, DATASTORE_TYPE_UINT32, &u1, sizeof(u1) },
+        { RESOURCE0, 2, DATASTORE_TYPE_UINT32, &u0, sizeof(u0) },
+        { RESOURCE1, 0, DATASTORE_TYPE_FLOAT, &u0, sizeof(u0) },
+        { RESOURCE0, 0, DATASTORE_TYPE_UINT32, NULL, sizeof(u0) },
+        { RESOURCE1, 0, DATASTORE_TYPE_DOUBLE, &u0, sizeof(u0) },
+    };
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ID, datastore_get_batch(ds, mixed, sizeof(mixed) / sizeof(mixed[0])));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ID, mixed[0].status);
+    EXPECT_EQ(DATASTORE_STATUS_OK, mixed[1].status); EXPECT_EQ(42, u1);
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_INSTANCE, mixed[2].status);
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_TYPE, mixed[3].status);
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, mixed[4].status);
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_TOO_LARGE, mixed[5].status);
 
-    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE2, datastore_create_string_resource(71, 3)));
-    expected_usage += 71 * 3;
-    EXPECT_EQ(expected_usage, datastore_get_ram_usage(ds));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_get_batch(NULL, reads, 1));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_get_batch(ds, NULL, 1));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_batch(ds, NULL, 0));
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_get_batch_is_consistent) {
+    // a writer updates two resources together, readers must never see them differ
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 1)));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE1, datastore_create_resource(DATASTORE_TYPE_UINT32, 1)));
+
+    std::atomic<bool> done(false);
+    std::thread writer([ds, &done]() {
+        for (uint32_t i = 1; !done; ++i)
+        {
+            datastore_write_t writes[] = {
+                { RESOURCE0, 0, DATASTORE_TYPE_UINT32, &i, sizeof(i) },
+                { RESOURCE1, 0, DATASTORE_TYPE_UINT32, &i, sizeof(i) },
+            };
+            EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_batch(ds, writes, 2));
+        }
+    });
+
+    for (int i = 0; i < 10000; ++i)
+    {
+        uint32_t value0 = 0, value1 = 0;
+        datastore_read_t reads[] = {
+            { RESOURCE0, 0, DATASTORE_TYPE_UINT32, &value0, sizeof(value0) },
+            { RESOURCE1, 0, DATASTORE_TYPE_UINT32, &value1, sizeof(value1) },
+        };
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_batch(ds, reads, 2));
+        ASSERT_EQ(value0, value1);
+    }
+    done = true;
+    writer.join();
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_range) {
+    const uint32_t NUM_INSTANCES = 4096;
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, NUM_INSTANCES)));
+
+    detail::CallbackRecord record;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 5, detail::callback, &record));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 100, detail::callback, &record));
+
+    std::vector<uint32_t> values(NUM_INSTANCES);
+    for (uint32_t i = 0; i < NUM_INSTANCES; ++i)
+    {
+        values[i] = i * 3;
+    }
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 0, NUM_INSTANCES, values.data(), values.size() * sizeof(uint32_t)));
+    EXPECT_EQ(2, record.counter);
+
+    uint32_t value = 0;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_uint32(ds, RESOURCE0, 4095, &value)); EXPECT_EQ(4095 * 3, value);
+    datastore_age_t age_us = DATASTORE_INVALID_AGE;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_age(ds, RESOURCE0, 4095, &age_us)); EXPECT_LT(age_us, AGE_THRESHOLD);
+
+    // partial span
+    uint32_t span[3] = { 7, 8, 9 };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 99, 3, span, sizeof(span)));
+    EXPECT_EQ(3, record.counter);
+    EXPECT_EQ(100, record.last.instance_id);
+
+    std::vector<uint32_t> result(NUM_INSTANCES);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 0, NUM_INSTANCES, result.data(), result.size() * sizeof(uint32_t)));
+    values[99] = 7; values[100] = 8; values[101] = 9;
+    EXPECT_EQ(values, result);
+
+    uint32_t tail[2] = { 0, 0 };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, NUM_INSTANCES - 2, 2, tail, sizeof(tail)));
+    EXPECT_EQ(4094 * 3, tail[0]);
+    EXPECT_EQ(4095 * 3, tail[1]);
+
+    // strings are copied slot by slot, and always terminated
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE1, datastore_create_string_resource(4, 2)));
+    char strings[8] = { 'a', 'b', 'c', '\0', 'w', 'x', 'y', 'z' };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_range(ds, RESOURCE1, DATASTORE_TYPE_STRING, 0, 2, strings, sizeof(strings)));
+    char str[4] = "";
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_string(ds, RESOURCE1, 0, str, sizeof(str))); EXPECT_STREQ("abc", str);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_string(ds, RESOURCE1, 1, str, sizeof(str))); EXPECT_STREQ("wxy", str);
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_range_invalid) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 4)));
+
+    uint32_t values[4] = { 1, 2, 3, 4 };
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER,     datastore_set_range(NULL, RESOURCE0, DATASTORE_TYPE_UINT32, 0, 4, values, sizeof(values)));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER,     datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 0, 4, NULL, sizeof(values)));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ID,       datastore_set_range(ds, RESOURCE1, DATASTORE_TYPE_UINT32, 0, 4, values, sizeof(values)));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_TYPE,     datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_INT32, 0, 4, values, sizeof(values)));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_INSTANCE, datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 1, 4, values, sizeof(values)));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_INSTANCE, datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, -1, 2, values, sizeof(values)));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_INSTANCE, datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 2, UINT32_MAX, values, sizeof(values)));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_TOO_LARGE,        datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 0, 4, values, sizeof(values) - 1));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER,     datastore_get_range(NULL, RESOURCE0, DATASTORE_TYPE_UINT32, 0, 4, values, sizeof(values)));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_INSTANCE, datastore_get_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 3, 2, values, sizeof(values)));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_TOO_LARGE,        datastore_get_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 0, 4, values, 2));
+
+    // empty span at either end is allowed
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 4, 0, values, 0));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 0, 0, values, 0));
+
+    uint32_t value = 42;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_uint32(ds, RESOURCE0, 0, &value)); EXPECT_EQ(0, value);
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_range_lock_free_and_atomic) {
+    const uint32_t FLAGS[] = { DATASTORE_RESOURCE_FLAG_LOCK_FREE_READS, DATASTORE_RESOURCE_FLAG_ATOMIC };
+    for (auto flags : FLAGS)
+    {
+        datastore_t * ds = datastore_create();
+        datastore_resource_t resource = datastore_create_resource(DATASTORE_TYPE_INT32, 3);
+        resource.flags = flags;
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, resource));
+
+        int32_t values[3] = { -1, 0, 1 };
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_INT32, 0, 3, values, sizeof(values)));
+        int32_t result[3] = { 0 };
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_range(ds, RESOURCE0, DATASTORE_TYPE_INT32, 0, 3, result, sizeof(result)));
+        EXPECT_EQ(-1, result[0]);
+        EXPECT_EQ(0, result[1]);
+        EXPECT_EQ(1, result[2]);
+        int32_t value = 0;
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_int32(ds, RESOURCE0, 2, &value)); EXPECT_EQ(1, value);
+
+        datastore_free(&ds);
+    }
+}
+
+TEST(DatastoreTest, test_suppress_unchanged) {
+    datastore_t * ds = datastore_create();
+    datastore_resource_t resource = datastore_create_resource(DATASTORE_TYPE_UINT32, 2);
+    resource.flags = DATASTORE_RESOURCE_FLAG_SUPPRESS_UNCHANGED;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, resource));
+    resource = datastore_create_string_resource(16, 1);
+    resource.flags = DATASTORE_RESOURCE_FLAG_SUPPRESS_UNCHANGED;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE1, resource));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE2, datastore_create_resource(DATASTORE_TYPE_UINT32, 1)));
+
+    detail::CallbackRecord record;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 0, detail::callback, &record));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE1, 0, detail::callback, &record));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE2, 0, detail::callback, &record));
+
+    datastore_stats_t stats = { 99 };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_stats(ds, &stats)); EXPECT_EQ(0, stats.suppressed_writes);
+
+    // writing the initial value again is suppressed, but still refreshes the age
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, 0));
+    EXPECT_EQ(0, record.counter);
+    datastore_age_t age_us = DATASTORE_INVALID_AGE;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_age(ds, RESOURCE0, 0, &age_us)); EXPECT_LT(age_us, AGE_THRESHOLD);
+
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, 42)); EXPECT_EQ(1, record.counter);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, 42)); EXPECT_EQ(1, record.counter);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, 43)); EXPECT_EQ(2, record.counter);
+
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_string(ds, RESOURCE1, 0, "hello")); EXPECT_EQ(3, record.counter);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_string(ds, RESOURCE1, 0, "hello")); EXPECT_EQ(3, record.counter);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_string(ds, RESOURCE1, 0, "hell")); EXPECT_EQ(4, record.counter);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_as_string(ds, RESOURCE1, 0, "hell")); EXPECT_EQ(4, record.counter);
+
+    // resources without the flag are unaffected
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE2, 0, 0)); EXPECT_EQ(5, record.counter);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE2, 0, 0)); EXPECT_EQ(6, record.counter);
+
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_stats(ds, &stats)); EXPECT_EQ(4, stats.suppressed_writes);
+
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_get_stats(NULL, &stats));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_get_stats(ds, NULL));
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_suppress_unchanged_batch_and_range) {
+    datastore_t * ds = datastore_create();
+    datastore_resource_t resource = datastore_create_resource(DATASTORE_TYPE_UINT32, 4);
+    resource.flags = DATASTORE_RESOURCE_FLAG_SUPPRESS_UNCHANGED;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, resource));
+
+    detail::CallbackRecord record;
+    for (int i = 0; i < 4; ++i)
+    {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, i, detail::callback, &record));
+    }
+
+    // only instances 1 and 3 change
+    uint32_t values[4] = { 0, 1, 0, 3 };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 0, 4, values, sizeof(values)));
+    EXPECT_EQ(2, record.counter);
+    EXPECT_EQ(3, record.last.instance_id);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 0, 4, values, sizeof(values)));
+    EXPECT_EQ(2, record.counter);
+
+    // a changed instance that is later written with its new value again still notifies once
+    uint32_t five = 5;
+    uint32_t zero = 0;
+    datastore_write_t writes[] = {
+        { RESOURCE0, 0, DATASTORE_TYPE_UINT32, &five, sizeof(five) },
+        { RESOURCE0, 0, DATASTORE_TYPE_UINT32, &five, sizeof(five) },
+        { RESOURCE0, 2, DATASTORE_TYPE_UINT32, &zero, sizeof(zero) },
+    };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_batch(ds, writes, 3));
+    EXPECT_EQ(3, record.counter);
+    EXPECT_EQ(0, record.last.instance_id);
+
+    // nothing carries over to the next batch
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_batch(ds, writes, 3));
+    EXPECT_EQ(3, record.counter);
+
+    datastore_stats_t stats;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_stats(ds, &stats)); EXPECT_EQ(2 + 4 + 2 + 3, stats.suppressed_writes);
 
     datastore_free(&ds);
 }
 
+TEST(DatastoreTest, test_suppress_unchanged_string_range) {
+    datastore_t * ds = datastore_create();
+    datastore_resource_t resource = datastore_create_string_resource(8, 2);
+    resource.flags = DATASTORE_RESOURCE_FLAG_SUPPRESS_UNCHANGED;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, resource));
+    detail::CallbackRecord record;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, DATASTORE_INSTANCE_ALL, detail::callback, &record));
+
+    // the same strings, with different bytes after their terminators
+    char first[2][8] = { { 'a', 'b', '\0', 'x', 'x', 'x', 'x', 'x' }, { 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j' } };
+    char second[2][8] = { { 'a', 'b', '\0', 'y', 'y', 'y', 'y', 'y' }, { 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'k' } };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_STRING, 0, 2, first, sizeof(first)));
+    EXPECT_EQ(2, record.counter);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_STRING, 0, 2, second, sizeof(second)));
+    EXPECT_EQ(2, record.counter);
+
+    // and the same as a single write of the string
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_string(ds, RESOURCE0, 0, "ab"));
+    EXPECT_EQ(2, record.counter);
+    char value[8] = "";
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_string(ds, RESOURCE0, 1, value, sizeof(value)));
+    EXPECT_STREQ("cdefghi", value);
+
+    datastore_free(&ds);
+}
+
+namespace detail {
+    // Blocks on the notifier's worker until opened, then records the value it was called for
+    struct Gate {
+        std::atomic<bool> open;
+        std::atomic<int> calls;
+        std::atomic<uint32_t> last_value;
+        std::atomic<bool> on_writer_thread;
+        std::thread::id writer;
+        Gate() : open(false), calls(0), last_value(0), on_writer_thread(false), writer(std::this_thread::get_id()) {}
+    };
+
+    static void gated_callback(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, void * context) {
+        Gate * gate = static_cast<Gate *>(context);
+        while (!gate->open)
+        {
+            std::this_thread::yield();
+        }
+        uint32_t value = 0;
+        datastore_get_uint32(datastore, id, instance, &value);
+        gate->last_value = value;
+        if (std::this_thread::get_id() == gate->writer)
+        {
+            gate->on_writer_thread = true;
+        }
+        ++gate->calls;
+    }
+}
+
+TEST(DatastoreTest, test_notifier_block) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 2)));
+    detail::Gate gate;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 0, detail::gated_callback, &gate));
+
+    datastore_notifier_config_t config = { 64, 2, DATASTORE_BACKPRESSURE_BLOCK };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_start_notifier(ds, &config));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ARGUMENT, datastore_start_notifier(ds, &config));
+
+    // writers are not held up by a blocked subscriber while the queue has space
+    for (uint32_t i = 1; i <= 10; ++i)
+    {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, i));
+    }
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 1, 99));  // no subscribers, nothing queued
+    EXPECT_EQ(0, gate.calls);
+
+    datastore_stats_t stats;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_stats(ds, &stats));
+    EXPECT_EQ(10, stats.notifications_queued);
+    EXPECT_GE(stats.notifications_high_water, 8);
+
+    gate.open = true;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_flush_notifier(ds));
+    EXPECT_EQ(10, gate.calls);
+    EXPECT_FALSE(gate.on_writer_thread);
+
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_stats(ds, &stats));
+    EXPECT_EQ(0, stats.notifications_queued);
+    EXPECT_EQ(0, stats.notifications_dropped);
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_notifier_block_when_full) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 1)));
+    detail::Gate gate;
+    gate.open = true;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 0, detail::gated_callback, &gate));
+
+    datastore_notifier_config_t config = { 2, 1, DATASTORE_BACKPRESSURE_BLOCK };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_start_notifier(ds, &config));
+
+    // many writers, tiny queue - every notification is delivered
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+        threads.emplace_back([ds]() {
+            for (uint32_t i = 0; i < 1000; ++i)
+            {
+                EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, i));
+            }
+        });
+    }
+    for (auto & thread : threads)
+    {
+        thread.join();
+    }
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_flush_notifier(ds));
+    EXPECT_EQ(4000, gate.calls);
+
+    datastore_stats_t stats;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_stats(ds, &stats));
+    EXPECT_LE(stats.notifications_high_water, 2);
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_notifier_drop_oldest) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 1)));
+    detail::Gate gate;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 0, detail::gated_callback, &gate));
+
+    datastore_notifier_config_t config = { 4, 1, DATASTORE_BACKPRESSURE_DROP_OLDEST };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_start_notifier(ds, &config));
+
+    for (uint32_t i = 1; i <= 100; ++i)
+    {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, i));
+    }
+    datastore_stats_t stats;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_stats(ds, &stats));
+    EXPECT_GE(stats.notifications_dropped, 100 - 4 - 1);   // the worker may be holding one
+
+    gate.open = true;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_flush_notifier(ds));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_stats(ds, &stats));
+    EXPECT_EQ(100, gate.calls + stats.notifications_dropped);
+    EXPECT_EQ(100, gate.last_value);
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_notifier_coalesce) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 1)));
+    detail::Gate gate;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 0, detail::gated_callback, &gate));
+
+    datastore_notifier_config_t config = { 4, 1, DATASTORE_BACKPRESSURE_COALESCE };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_start_notifier(ds, &config));
+
+    for (uint32_t i = 1; i <= 100; ++i)
+    {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, i));
+    }
+    gate.open = true;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_flush_notifier(ds));
+
+    // at most one notification in the queue and one being delivered, and the last delivery sees the last value
+    datastore_stats_t stats;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_stats(ds, &stats));
+    EXPECT_LE(gate.calls, 2);
+    EXPECT_EQ(100, gate.calls + stats.notifications_coalesced);
+    EXPECT_EQ(100, gate.last_value);
+    EXPECT_LE(stats.notifications_high_water, 1);
+
+    // once delivered, the next write is queued again
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, 101));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_flush_notifier(ds));
+    EXPECT_EQ(101, gate.last_value);
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_notifier_free_delivers_pending) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 1)));
+    detail::Gate gate;
+    gate.open = true;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 0, detail::gated_callback, &gate));
+
+    datastore_notifier_config_t config = { 128, 3, DATASTORE_BACKPRESSURE_BLOCK };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_start_notifier(ds, &config));
+    for (uint32_t i = 0; i < 100; ++i)
+    {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, i));
+    }
+    datastore_free(&ds);
+    EXPECT_EQ(100, gate.calls);
+}
+
+TEST(DatastoreTest, test_notifier_invalid) {
+    datastore_t * ds = datastore_create();
+    datastore_notifier_config_t config = { 16, 1, DATASTORE_BACKPRESSURE_BLOCK };
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_start_notifier(NULL, &config));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_start_notifier(ds, NULL));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_flush_notifier(NULL));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_flush_notifier(ds));  // no notifier - nothing to wait for
+
+    config = { 0, 1, DATASTORE_BACKPRESSURE_BLOCK };
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ARGUMENT, datastore_start_notifier(ds, &config));
+    config = { 16, 0, DATASTORE_BACKPRESSURE_BLOCK };
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ARGUMENT, datastore_start_notifier(ds, &config));
+    config = { 16, 1, DATASTORE_BACKPRESSURE_LAST };
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ARGUMENT, datastore_start_notifier(ds, &config));
+    datastore_free(&ds);
+}
+
+namespace detail {
+    struct CoalesceRecord {
+        std::vector<std::pair<datastore_resource_id_t, datastore_instance_id_t>> calls;
+        std::vector<uint32_t> values;
+        bool write_back = false;
+    };
+
+    static void coalesce_callback(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, void * context) {
+        CoalesceRecord * record = static_cast<CoalesceRecord *>(context);
+        uint32_t value = 0;
+        datastore_get_uint32(datastore, id, instance, &value);
+        record->calls.push_back(std::make_pair(id, instance));
+        record->values.push_back(value);
+        if (record->write_back)
+        {
+            record->write_back = false;
+            datastore_set_uint32(datastore, id, instance, value + 1);
+        }
+    }
+}
+
+TEST(DatastoreTest, test_coalesced_callbacks) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 4)));
+
+    detail::CoalesceRecord coalesced;
+    detail::CallbackRecord immediate;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback_ex(ds, RESOURCE0, 0, detail::coalesce_callback, &coalesced, DATASTORE_CALLBACK_FLAG_COALESCE));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback_ex(ds, RESOURCE0, 2, detail::coalesce_callback, &coalesced, DATASTORE_CALLBACK_FLAG_COALESCE));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 0, detail::callback, &immediate));
+
+    // nothing pending
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_dispatch_pending(ds));
+    EXPECT_EQ(0u, coalesced.calls.size());
+
+    for (uint32_t i = 1; i <= 100; ++i)
+    {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 2, i));
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, i * 2));
+    }
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 1, 7));  // no coalesced callbacks
+
+    // ordinary callbacks on the same instance are unaffected
+    EXPECT_EQ(100, immediate.counter);
+    EXPECT_EQ(0u, coalesced.calls.size());
+
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_dispatch_pending(ds));
+    ASSERT_EQ(2u, coalesced.calls.size());
+    EXPECT_EQ(std::make_pair((datastore_resource_id_t)RESOURCE0, 2), coalesced.calls[0]);  // first set first
+    EXPECT_EQ(std::make_pair((datastore_resource_id_t)RESOURCE0, 0), coalesced.calls[1]);
+    EXPECT_EQ(100, coalesced.values[0]);
+    EXPECT_EQ(200, coalesced.values[1]);
+
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_dispatch_pending(ds));
+    EXPECT_EQ(2u, coalesced.calls.size());
+
+    // a write from a coalesced callback is delivered by the next dispatch
+    coalesced.write_back = true;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, 500));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_dispatch_pending(ds));
+    EXPECT_EQ(3u, coalesced.calls.size());
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_dispatch_pending(ds));
+    ASSERT_EQ(4u, coalesced.calls.size());
+    EXPECT_EQ(501, coalesced.values[3]);
+
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_dispatch_pending(NULL));
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_coalesced_callbacks_many_instances) {
+    const uint32_t NUM_INSTANCES = 1000;
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, NUM_INSTANCES)));
+    detail::CoalesceRecord coalesced;
+    for (uint32_t i = 0; i < NUM_INSTANCES; ++i)
+    {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback_ex(ds, RESOURCE0, i, detail::coalesce_callback, &coalesced, DATASTORE_CALLBACK_FLAG_COALESCE));
+    }
+
+    std::vector<uint32_t> values(NUM_INSTANCES, 3);
+    for (int burst = 0; burst < 3; ++burst)
+    {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 0, NUM_INSTANCES, values.data(), values.size() * sizeof(uint32_t)));
+    }
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_dispatch_pending(ds));
+    EXPECT_EQ(NUM_INSTANCES, coalesced.calls.size());
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_remove_set_callback) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 2)));
+    detail::CallbackRecord record1, record2;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 0, detail::callback, &record1));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 0, detail::callback, &record2));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 0, detail::callback, &record1));
+
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, 1));
+    EXPECT_EQ(2, record1.counter);
+    EXPECT_EQ(1, record2.counter);
+
+    // only the first matching registration is removed
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_remove_set_callback(ds, RESOURCE0, 0, detail::callback, &record1));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, 2));
+    EXPECT_EQ(3, record1.counter);
+    EXPECT_EQ(2, record2.counter);
+
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_remove_set_callback(ds, RESOURCE0, 0, detail::callback, &record1));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_remove_set_callback(ds, RESOURCE0, 0, detail::callback, &record2));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, 3));
+    EXPECT_EQ(3, record1.counter);
+    EXPECT_EQ(2, record2.counter);
+
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ARGUMENT, datastore_remove_set_callback(ds, RESOURCE0, 0, detail::callback, &record1));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ARGUMENT, datastore_remove_set_callback(ds, RESOURCE0, 1, detail::callback, &record1));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_INSTANCE, datastore_remove_set_callback(ds, RESOURCE0, 2, detail::callback, &record1));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ID, datastore_remove_set_callback(ds, RESOURCE1, 0, detail::callback, &record1));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_remove_set_callback(NULL, RESOURCE0, 0, detail::callback, &record1));
+
+    datastore_free(&ds);
+}
+
+namespace detail {
+    struct OneShotRecord {
+        int calls = 0;
+        CallbackRecord * other = nullptr;
+    };
+
+    // removes itself and another callback on the same instance on its first call
+    static void one_shot_callback(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, void * context) {
+        OneShotRecord * record = static_cast<OneShotRecord *>(context);
+        ++record->calls;
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_remove_set_callback(datastore, id, instance, one_shot_callback, context));
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_remove_set_callback(datastore, id, instance, callback, record->other));
+    }
+}
+
+TEST(DatastoreTest, test_remove_set_callback_from_callback) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 1)));
+    detail::CallbackRecord record;
+    detail::OneShotRecord one_shot;
+    one_shot.other = &record;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 0, detail::one_shot_callback, &one_shot));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 0, detail::callback, &record));
+
+    // the dispatch already under way still sees the callbacks it started with
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, 1));
+    EXPECT_EQ(1, one_shot.calls);
+    EXPECT_EQ(1, record.counter);
+
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, 2));
+    EXPECT_EQ(1, one_shot.calls);
+    EXPECT_EQ(1, record.counter);
+
+    datastore_free(&ds);
+}
+
+namespace detail {
+    static void atomic_count_callback(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, void * context) {
+        (void)datastore; (void)id; (void)instance;
+        static_cast<std::atomic<int> *>(context)->fetch_add(1);
+    }
+}
+
+TEST(DatastoreTest, test_set_callback_concurrent_with_dispatch) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 1)));
+    std::atomic<int> steady(0);
+    std::atomic<int> churn(0);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 0, detail::atomic_count_callback, &steady));
+
+    // one thread subscribes and unsubscribes while others set - the steady subscriber sees every set
+    const int NUM_SETTERS = 3;
+    const int NUM_SETS = 2000;
+    std::atomic<bool> done(false);
+    std::thread modifier([ds, &churn, &done]() {
+        while (!done)
+        {
+            EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 0, detail::atomic_count_callback, &churn));
+            EXPECT_EQ(DATASTORE_STATUS_OK, datastore_remove_set_callback(ds, RESOURCE0, 0, detail::atomic_count_callback, &churn));
+        }
+    });
+    std::vector<std::thread> setters;
+    for (int t = 0; t < NUM_SETTERS; ++t)
+    {
+        setters.emplace_back([ds]() {
+            for (uint32_t i = 0; i < NUM_SETS; ++i)
+            {
+                EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, i));
+            }
+        });
+    }
+    for (auto & thread : setters)
+    {
+        thread.join();
+    }
+    done = true;
+    modifier.join();
+
+    EXPECT_EQ(NUM_SETTERS * NUM_SETS, steady.load());
+    EXPECT_LE(churn.load(), NUM_SETTERS * NUM_SETS);
+
+    datastore_free(&ds);
+}
+
+namespace detail {
+    struct OrderRecord {
+        std::vector<std::string> calls;
+    };
+
+    static void store_callback(const datastore_t *, datastore_resource_id_t id, datastore_instance_id_t instance, void * context) {
+        static_cast<OrderRecord *>(context)->calls.push_back("store " + std::to_string(id) + "/" + std::to_string(instance));
+    }
+
+    static void resource_callback(const datastore_t *, datastore_resource_id_t id, datastore_instance_id_t instance, void * context) {
+        static_cast<OrderRecord *>(context)->calls.push_back("resource " + std::to_string(id) + "/" + std::to_string(instance));
+    }
+
+    static void instance_callback(const datastore_t *, datastore_resource_id_t id, datastore_instance_id_t instance, void * context) {
+        static_cast<OrderRecord *>(context)->calls.push_back("instance " + std::to_string(id) + "/" + std::to_string(instance));
+    }
+}
+
+TEST(DatastoreTest, test_wildcard_callbacks) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 1024)));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE1, datastore_create_resource(DATASTORE_TYPE_UINT32, 2)));
+    detail::OrderRecord record;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 7, detail::instance_callback, &record));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, DATASTORE_INSTANCE_ALL, detail::resource_callback, &record));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, DATASTORE_RESOURCE_ALL, DATASTORE_INSTANCE_ALL, detail::store_callback, &record));
+
+    // broadest subscription first
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 7, 1));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 1023, 1));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE1, 1, 1));
+    std::vector<std::string> expected = {
+        "store 0/7", "resource 0/7", "instance 0/7",
+        "store 0/1023", "resource 0/1023",
+        "store 1/1",
+    };
+    EXPECT_EQ(expected, record.calls);
+
+    // batch and range writes notify wildcard subscribers too
+    record.calls.clear();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_remove_set_callback(ds, DATASTORE_RESOURCE_ALL, DATASTORE_INSTANCE_ALL, detail::store_callback, &record));
+    uint32_t values[] = { 5, 6 };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 100, 2, values, sizeof(values)));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_range(ds, RESOURCE1, DATASTORE_TYPE_UINT32, 0, 2, values, sizeof(values)));
+    expected = { "resource 0/100", "resource 0/101" };
+    EXPECT_EQ(expected, record.calls);
+
+    record.calls.clear();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_remove_set_callback(ds, RESOURCE0, DATASTORE_INSTANCE_ALL, detail::resource_callback, &record));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 7, 2));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 8, 2));
+    expected = { "instance 0/7" };
+    EXPECT_EQ(expected, record.calls);
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_wildcard_callbacks_invalid) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 2)));
+    detail::OrderRecord record;
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_INSTANCE, datastore_add_set_callback(ds, DATASTORE_RESOURCE_ALL, 0, detail::store_callback, &record));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ID, datastore_add_set_callback(ds, RESOURCE1, DATASTORE_INSTANCE_ALL, detail::resource_callback, &record));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_INSTANCE, datastore_add_set_callback(ds, RESOURCE0, -2, detail::instance_callback, &record));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ARGUMENT, datastore_remove_set_callback(ds, RESOURCE0, DATASTORE_INSTANCE_ALL, detail::resource_callback, &record));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ARGUMENT, datastore_remove_set_callback(ds, DATASTORE_RESOURCE_ALL, DATASTORE_INSTANCE_ALL, detail::store_callback, &record));
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_wildcard_callbacks_coalesced) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 64)));
+    detail::CoalesceRecord coalesced;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback_ex(ds, RESOURCE0, DATASTORE_INSTANCE_ALL, detail::coalesce_callback, &coalesced, DATASTORE_CALLBACK_FLAG_COALESCE));
+
+    for (uint32_t n = 0; n < 5; ++n)
+    {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 3, n));
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 60, n));
+    }
+    EXPECT_TRUE(coalesced.calls.empty());
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_dispatch_pending(ds));
+    ASSERT_EQ(2, coalesced.calls.size());
+    EXPECT_EQ(std::make_pair((datastore_resource_id_t)RESOURCE0, 3), coalesced.calls[0]);
+    EXPECT_EQ(std::make_pair((datastore_resource_id_t)RESOURCE0, 60), coalesced.calls[1]);
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_get_ram_usage) {
+    datastore_t * ds = datastore_create();
+    size_t expected_usage = 0;
+    EXPECT_EQ(expected_usage, datastore_get_ram_usage(ds));
+
+    // memory is only allocated at the time resources are defined
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT8, 4)));
+    expected_usage += 4 * sizeof(bool);
+    EXPECT_EQ(expected_usage, datastore_get_ram_usage(ds));
+
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE1, datastore_create_resource(DATASTORE_TYPE_INT32, 7)));
+    expected_usage += 7 * sizeof(int32_t);
+    EXPECT_EQ(expected_usage, datastore_get_ram_usage(ds));
+
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE2, datastore_create_string_resource(71, 3)));
+    expected_usage += 71 * 3;
+    EXPECT_EQ(expected_usage, datastore_get_ram_usage(ds));
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_variable_string_resource) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_add_variable_string_resource(NULL, RESOURCE0, 4, 16));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ARGUMENT, datastore_add_variable_string_resource(ds, RESOURCE0, 4, 0));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_INSTANCE, datastore_add_variable_string_resource(ds, RESOURCE0, 0, 16));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_variable_string_resource(ds, RESOURCE0, 4, 16));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ID, datastore_add_variable_string_resource(ds, RESOURCE0, 4, 16));
+
+    // instances start empty, and are limited to length - 1 characters like fixed-width strings
+    char value[16] = "x";
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_string(ds, RESOURCE0, 3, value, sizeof(value)));
+    EXPECT_STREQ("", value);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_string(ds, RESOURCE0, 1, "fifteen chars!!"));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_TOO_LARGE, datastore_set_string(ds, RESOURCE0, 1, "sixteen chars!!!"));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_INSTANCE, datastore_set_string(ds, RESOURCE0, 4, "a"));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_TYPE, datastore_set_uint32(ds, RESOURCE0, 0, 1));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_string(ds, RESOURCE0, 1, value, sizeof(value)));
+    EXPECT_STREQ("fifteen chars!!", value);
+    char truncated[5] = "";
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_string(ds, RESOURCE0, 1, truncated, sizeof(truncated)));
+    EXPECT_STREQ("fift", truncated);
+
+    // shorter values are written in place, and longer ones still fit in the room left behind
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_string(ds, RESOURCE0, 1, "short"));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_string(ds, RESOURCE0, 1, ""));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_string(ds, RESOURCE0, 1, value, sizeof(value)));
+    EXPECT_STREQ("", value);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_string(ds, RESOURCE0, 1, "a bit longer"));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_string(ds, RESOURCE0, 1, value, sizeof(value)));
+    EXPECT_STREQ("a bit longer", value);
+
+    // callbacks and ages behave as for any other resource
+    detail::CallbackRecord record;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 2, detail::callback, &record));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_as_string(ds, RESOURCE0, 2, "via text"));
+    EXPECT_EQ(1, record.counter);
+    EXPECT_EQ(2, record.last.instance_id);
+    datastore_age_t age = DATASTORE_INVALID_AGE;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_age(ds, RESOURCE0, 2, &age));
+    EXPECT_NE(DATASTORE_INVALID_AGE, age);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_as_string(ds, RESOURCE0, 2, value, sizeof(value)));
+    EXPECT_STREQ("via text", value);
+
+    char batch[2][16] = { "", "" };
+    datastore_read_t reads[] = {
+        { RESOURCE0, 1, DATASTORE_TYPE_STRING, batch[0], sizeof(batch[0]) },
+        { RESOURCE0, 2, DATASTORE_TYPE_STRING, batch[1], 4 },
+    };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_batch(ds, reads, 2));
+    EXPECT_STREQ("a bit longer", batch[0]);
+    EXPECT_STREQ("via", batch[1]);
+
+    // values are not at fixed offsets, so nothing may address them directly
+    datastore_write_t write = { RESOURCE0, 0, DATASTORE_TYPE_STRING, "abc", 4 };
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_TYPE, datastore_set_batch(ds, &write, 1));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_TYPE, datastore_get_range(ds, RESOURCE0, DATASTORE_TYPE_STRING, 0, 1, value, sizeof(value)));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_TYPE, datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_STRING, 0, 1, value, sizeof(value)));
+    datastore_handle_t handle;
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_TYPE, datastore_resolve(ds, RESOURCE0, 0, DATASTORE_TYPE_STRING, &handle));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_TYPE, datastore_add(ds, RESOURCE0, 3, 1));
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_variable_string_compaction) {
+    const uint32_t num_instances = 1024;
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_variable_string_resource(ds, RESOURCE0, num_instances, 256));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_string_resource(ds, RESOURCE1, num_instances, 256));
+
+    // mostly short values with the odd long one, rewritten many times
+    std::vector<std::string> expected(num_instances);
+    uint32_t seed = 1;
+    for (int i = 0; i < 20000; ++i)
+    {
+        seed = seed * 1103515245u + 12345u;
+        uint32_t instance = (seed >> 8) % num_instances;
+        size_t length = (seed >> 24) % 16 == 0 ? 200 : (seed >> 4) % 12;
+        expected[instance] = std::string(length, static_cast<char>('a' + i % 26));
+        ASSERT_EQ(DATASTORE_STATUS_OK, datastore_set_string(ds, RESOURCE0, instance, expected[instance].c_str()));
+        ASSERT_EQ(DATASTORE_STATUS_OK, datastore_set_string(ds, RESOURCE1, instance, expected[instance].c_str()));
+    }
+    size_t total = 0;
+    for (uint32_t instance = 0; instance < num_instances; ++instance)
+    {
+        char value[256] = "";
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_string(ds, RESOURCE0, instance, value, sizeof(value)));
+        EXPECT_EQ(expected[instance], value);
+        total += expected[instance].size();
+    }
+
+    // the variable-length resource costs a small multiple of its values, far less than its fixed-width twin
+    size_t usage = datastore_get_ram_usage(ds) - num_instances * 256;
+    EXPECT_LE(total, usage);
+    EXPECT_GT(num_instances * 256 / 4, usage);
+    EXPECT_GT(3 * total + num_instances * 16, usage);
+
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_variable_string_allocator) {
+    datastore_allocator_t allocator;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_arena_allocator(&allocator, DATASTORE_ARENA_MIN_BLOCK_SIZE));
+    datastore_t * ds = datastore_create_with_allocator(&allocator);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_variable_string_resource(ds, RESOURCE0, 8, 64));
+    for (int i = 0; i < 1000; ++i)
+    {
+        std::string value(i % 63, static_cast<char>('A' + i % 26));
+        ASSERT_EQ(DATASTORE_STATUS_OK, datastore_set_string(ds, RESOURCE0, i % 8, value.c_str()));
+        char copy[64] = "";
+        ASSERT_EQ(DATASTORE_STATUS_OK, datastore_get_string(ds, RESOURCE0, i % 8, copy, sizeof(copy)));
+        ASSERT_EQ(value, copy);
+    }
+    datastore_free(&ds);
+}
+
+TEST(DatastoreTest, test_cache_aligned_resource) {
+    datastore_t * ds = datastore_create();
+    datastore_resource_t resource = datastore_create_resource(DATASTORE_TYPE_UINT32, 4);
+    resource.flags = DATASTORE_RESOURCE_FLAG_CACHE_ALIGNED | DATASTORE_RESOURCE_FLAG_ATOMIC;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, resource));
+    resource = datastore_create_string_resource(10, 3);
+    resource.flags = DATASTORE_RESOURCE_FLAG_CACHE_ALIGNED;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE1, resource));
+
+    // every instance occupies a whole cache line
+    EXPECT_EQ(4 * 64 + 3 * 64, datastore_get_ram_usage(ds));
+
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 1, 17));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_increment(ds, RESOURCE0, 2));
+    uint32_t values[] = { 7, 8 };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 2, 2, values, sizeof(values)));
+    uint32_t all[4] = { 0 };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 0, 4, all, sizeof(all)));
+    EXPECT_EQ(0, all[0]);
+    EXPECT_EQ(17, all[1]);
+    EXPECT_EQ(7, all[2]);
+    EXPECT_EQ(8, all[3]);
+
+    char strings[3][10] = { "first", "second", "third" };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_range(ds, RESOURCE1, DATASTORE_TYPE_STRING, 0, 3, strings, sizeof(strings)));
+    char value[10] = "";
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_string(ds, RESOURCE1, 2, value, sizeof(value)));
+    EXPECT_STREQ("third", value);
+    char copies[3][10] = {};
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_range(ds, RESOURCE1, DATASTORE_TYPE_STRING, 0, 3, copies, sizeof(copies)));
+    EXPECT_STREQ("second", copies[1]);
+
+    // the datastore must own the memory to lay it out
+    uint32_t external[2] = { 0 };
+    datastore_resource_t unmanaged = { external, sizeof(uint32_t), DATASTORE_TYPE_UINT32, 2, DATASTORE_RESOURCE_FLAG_CACHE_ALIGNED, false };
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ARGUMENT, datastore_add_resource(ds, RESOURCE2, unmanaged));
+
+    datastore_free(&ds);
+}
+
+namespace detail {
+    // Checks that every allocation is freed exactly once, with the size and alignment it was made with
+    struct CountingAllocator {
+        std::mutex lock;
+        std::map<void *, std::pair<size_t, size_t>> live;
+        size_t allocations = 0;
+        bool mismatched = false;
+        std::atomic<size_t> max_size{SIZE_MAX};   // larger allocations fail
+    };
+
+    static void * counting_alloc(void * context, size_t size, size_t alignment) {
+        CountingAllocator * allocator = static_cast<CountingAllocator *>(context);
+        void * ptr = nullptr;
+        if (size <= allocator->max_size && posix_memalign(&ptr, alignment < sizeof(void *) ? sizeof(void *) : alignment, size ? size : 1) == 0) {
+            std::lock_guard<std::mutex> guard(allocator->lock);
+            allocator->live[ptr] = std::make_pair(size, alignment);
+            ++allocator->allocations;
+        }
+        return ptr;
+    }
+
+    static void counting_free(void * context, void * ptr, size_t size, size_t alignment) {
+        CountingAllocator * allocator = static_cast<CountingAllocator *>(context);
+        std::lock_guard<std::mutex> guard(allocator->lock);
+        auto it = allocator->live.find(ptr);
+        if (it == allocator->live.end() || it->second != std::make_pair(size, alignment)) {
+            allocator->mismatched = true;
+        } else {
+            allocator->live.erase(it);
+        }
+        free(ptr);
+    }
+}
+
+TEST(DatastoreTest, test_custom_allocator) {
+    detail::CountingAllocator counting;
+    datastore_allocator_t allocator = { detail::counting_alloc, detail::counting_free, NULL, &counting };
+    datastore_t * ds = datastore_create_with_allocator(&allocator);
+    ASSERT_NE(nullptr, ds);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 100)));
+    datastore_resource_t aligned = datastore_create_resource(DATASTORE_TYPE_INT32, 3);
+    aligned.flags = DATASTORE_RESOURCE_FLAG_CACHE_ALIGNED;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE1, aligned));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_string_resource(ds, RESOURCE2, 4, 16));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_fixed_length_resource(ds, 5000, DATASTORE_TYPE_DOUBLE, 2));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_name(ds, RESOURCE0, "counter"));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_name(ds, RESOURCE0, "renamed"));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_name(ds, RESOURCE2, "label"));
+
+    std::atomic<int> calls(0);
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, i, detail::atomic_count_callback, &calls));
+    }
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, DATASTORE_INSTANCE_ALL, detail::atomic_count_callback, &calls));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_remove_set_callback(ds, RESOURCE0, 3, detail::atomic_count_callback, &calls));
+
+    // values of managed resources come from the allocator too
+    size_t before = counting.allocations;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE3, datastore_create_resource(DATASTORE_TYPE_UINT8, 1)));
+    EXPECT_LT(before, counting.allocations);
+
+    std::vector<uint32_t> values(100, 7);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_range(ds, RESOURCE0, DATASTORE_TYPE_UINT32, 0, 100, values.data(), values.size() * sizeof(uint32_t)));
+    EXPECT_EQ(100 + 9, calls);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_int32(ds, RESOURCE1, 2, -5));
+    int32_t value = 0;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_int32(ds, RESOURCE1, 2, &value));
+    EXPECT_EQ(-5, value);
+    datastore_resource_id_t id = -1;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_find_by_name(ds, "label", &id));
+    EXPECT_EQ(RESOURCE2, id);
+
+    datastore_notifier_config_t config = { 16, 1, DATASTORE_BACKPRESSURE_BLOCK };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_start_notifier(ds, &config));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 0, 1));
+
+    datastore_free(&ds);
+    EXPECT_FALSE(counting.mismatched);
+    EXPECT_TRUE(counting.live.empty());
+}
+
+namespace detail {
+    static void stale_counter(const datastore_t *, datastore_resource_id_t, datastore_instance_id_t, void * context) {
+        ++*static_cast<std::atomic<int> *>(context);
+    }
+}
+
+TEST(DatastoreTest, test_ttl_out_of_memory) {
+    detail::CountingAllocator counting;
+    datastore_allocator_t allocator = { detail::counting_alloc, detail::counting_free, NULL, &counting };
+    datastore_t * ds = datastore_create_with_allocator(&allocator);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_fixed_length_resource(ds, RESOURCE0, DATASTORE_TYPE_UINT8, 200));
+    std::atomic<int> calls{0};
+
+    // the expiry heap can start but not hold every instance - none may be armed without a callback
+    counting.max_size = 2048;
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_OUT_OF_MEMORY, datastore_set_ttl(ds, RESOURCE0, 1000, detail::stale_counter, &calls));
+    usleep(50000);
+    EXPECT_EQ(0, calls);
+
+    counting.max_size = SIZE_MAX;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_ttl(ds, RESOURCE0, 1000, detail::stale_counter, &calls));
+    for (int i = 0; i < 200 && calls < 200; ++i)
+    {
+        usleep(10000);
+    }
+    EXPECT_EQ(200, calls);
+
+    datastore_free(&ds);
+    EXPECT_TRUE(counting.live.empty());
+    EXPECT_FALSE(counting.mismatched);
+}
+
+TEST(DatastoreTest, test_set_name_out_of_memory) {
+    detail::CountingAllocator counting;
+    datastore_allocator_t allocator = { detail::counting_alloc, detail::counting_free, NULL, &counting };
+    datastore_t * ds = datastore_create_with_allocator(&allocator);
+    for (datastore_resource_id_t id = 0; id < 8; ++id) {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_fixed_length_resource(ds, id, DATASTORE_TYPE_UINT8, 1));
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_name(ds, id, ("r" + std::to_string(id)).c_str()));
+    }
+
+    // neither a copy that can't be allocated, nor an index that can't grow, loses the old name
+    counting.max_size = 64;
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_OUT_OF_MEMORY, datastore_set_name(ds, 0, std::string(100, 'x').c_str()));
+    EXPECT_STREQ("r0", datastore_get_name(ds, 0));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_OUT_OF_MEMORY, datastore_set_name(ds, 0, "renamed"));
+    EXPECT_STREQ("r0", datastore_get_name(ds, 0));
+    datastore_resource_id_t id = -1;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_find_by_name(ds, "r0", &id));
+    EXPECT_EQ(0, id);
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ID, datastore_find_by_name(ds, "renamed", &id));
+
+    counting.max_size = SIZE_MAX;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_name(ds, 0, "renamed"));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_find_by_name(ds, "renamed", &id));
+    EXPECT_EQ(0, id);
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ID, datastore_find_by_name(ds, "r0", &id));
+
+    datastore_free(&ds);
+    EXPECT_TRUE(counting.live.empty());
+    EXPECT_FALSE(counting.mismatched);
+}
+
+TEST(DatastoreTest, test_arena_allocator) {
+    datastore_allocator_t arena;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_arena_allocator(&arena, DATASTORE_ARENA_MIN_BLOCK_SIZE));
+    datastore_t * ds = datastore_create_with_allocator(&arena);
+    ASSERT_NE(nullptr, ds);
+
+    // enough resources to fill several blocks, and some values too large for a size class
+    for (datastore_resource_id_t id = 0; id < 200; ++id) {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, id, datastore_create_resource(DATASTORE_TYPE_UINT32, id % 2 ? 1 : 1000)));
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_name(ds, id, ("resource" + std::to_string(id)).c_str()));
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, id, 0, id));
+    }
+    datastore_resource_t aligned = datastore_create_resource(DATASTORE_TYPE_UINT32, 2);
+    aligned.flags = DATASTORE_RESOURCE_FLAG_CACHE_ALIGNED;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, 1000, aligned));
+
+    // freed callback lists are reused
+    std::atomic<int> calls(0);
+    for (int i = 0; i < 50; ++i) {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, 3, 0, detail::atomic_count_callback, &calls));
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_remove_set_callback(ds, 3, 0, detail::atomic_count_callback, &calls));
+    }
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, 3, 0, detail::atomic_count_callback, &calls));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, 3, 0, 1));
+    EXPECT_EQ(1, calls);
+
+    for (datastore_resource_id_t id = 0; id < 200; ++id) {
+        datastore_resource_id_t found = -1;
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_find_by_name(ds, ("resource" + std::to_string(id)).c_str(), &found));
+        EXPECT_EQ(id, found);
+        uint32_t value = 0;
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_uint32(ds, id, 0, &value));
+        EXPECT_EQ(id == 3 ? 1u : (uint32_t)id, value);
+    }
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, 1000, 1, 9));
+    uint32_t value = 0;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_uint32(ds, 1000, 1, &value));
+    EXPECT_EQ(9, value);
+
+    // releases the arena
+    datastore_free(&ds);
+    EXPECT_EQ(nullptr, ds);
+}
+
+TEST(DatastoreTest, test_allocator_invalid) {
+    datastore_allocator_t allocator = {};
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_arena_allocator(NULL, DATASTORE_ARENA_MIN_BLOCK_SIZE));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ARGUMENT, datastore_arena_allocator(&allocator, DATASTORE_ARENA_MIN_BLOCK_SIZE - 1));
+    EXPECT_EQ(nullptr, datastore_create_with_allocator(&allocator));
+
+    // an arena that isn't given to a datastore is released directly
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_arena_allocator(&allocator, DATASTORE_ARENA_MIN_BLOCK_SIZE));
+    void * small = allocator.alloc(allocator.context, 24, 8);
+    void * large = allocator.alloc(allocator.context, 10000, 64);
+    EXPECT_EQ(0u, (uintptr_t)small % 8);
+    EXPECT_EQ(0u, (uintptr_t)large % 64);
+    allocator.free(allocator.context, small, 24, 8);
+    EXPECT_EQ(small, allocator.alloc(allocator.context, 30, 8));
+    allocator.release(allocator.context);
+}
+
+TEST(DatastoreTest, test_static_datastore) {
+    datastore_static_config_t config = { 10, 100, 20 };
+    size_t size = datastore_static_size(&config);
+    EXPECT_LT(0u, size);
+    std::vector<uint64_t> buffer(size / sizeof(uint64_t) + 1);
+    EXPECT_EQ(nullptr, datastore_create_static(buffer.data(), size - 1, &config));
+    EXPECT_EQ(nullptr, datastore_create_static((uint8_t *)buffer.data() + 1, size, &config));
+    EXPECT_EQ(nullptr, datastore_create_static(NULL, size, &config));
+    datastore_t * ds = datastore_create_static(buffer.data(), size, &config);
+    ASSERT_NE(nullptr, ds);
+
+    // unevenly sized resources, up to the limits
+    std::vector<uint32_t> values(100);
+    uint32_t offset = 0;
+    for (datastore_resource_id_t id = 0; id < 10; ++id) {
+        uint32_t num_instances = id < 9 ? id + 1 : 100 - offset;
+        datastore_resource_t resource = { &values[offset], sizeof(uint32_t), DATASTORE_TYPE_UINT32, num_instances, 0, false };
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, 9 - id, resource));
+        offset += num_instances;
+    }
+
+    // callbacks, registered and removed in ways that leave differently sized lists behind
+    std::atomic<int> calls(0);
+    for (int round = 0; round < 3; ++round) {
+        for (int i = 0; i < 20; ++i) {
+            EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, 0, 0, detail::atomic_count_callback, &calls));
+        }
+        for (int i = 0; i < 20; ++i) {
+            EXPECT_EQ(DATASTORE_STATUS_OK, datastore_remove_set_callback(ds, 0, 0, detail::atomic_count_callback, &calls));
+        }
+        for (int i = 0; i < 20; ++i) {
+            datastore_resource_id_t id = i % 3 == 0 ? DATASTORE_RESOURCE_ALL : i % 10;
+            datastore_instance_id_t instance = i % 3 == 2 ? 0 : DATASTORE_INSTANCE_ALL;
+            EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, id, instance, detail::atomic_count_callback, &calls));
+        }
+        for (int i = 0; i < 20; ++i) {
+            datastore_resource_id_t id = i % 3 == 0 ? DATASTORE_RESOURCE_ALL : i % 10;
+            datastore_instance_id_t instance = i % 3 == 2 ? 0 : DATASTORE_INSTANCE_ALL;
+            EXPECT_EQ(DATASTORE_STATUS_OK, datastore_remove_set_callback(ds, id, instance, detail::atomic_count_callback, &calls));
+        }
+    }
+
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, 2, 1, detail::atomic_count_callback, &calls));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, 2, 1, 42));
+    EXPECT_EQ(1, calls);
+    uint32_t value = 0;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_uint32(ds, 2, 1, &value));
+    EXPECT_EQ(42, value);
+
+    // the region runs out rather than falling back to the heap
+    datastore_status_t err = DATASTORE_STATUS_OK;
+    for (int i = 0; i < 100000 && err == DATASTORE_STATUS_OK; ++i) {
+        err = datastore_add_set_callback(ds, 1, i % 2, detail::atomic_count_callback, &calls);
+    }
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_OUT_OF_MEMORY, err);
+
+    datastore_free(&ds);
+    EXPECT_EQ(nullptr, ds);
+}
+
+namespace detail {
+    // adds and removes two store-wide callbacks, retiring three lists while it runs
+    static void churn_callback(const datastore_t * datastore, datastore_resource_id_t id, datastore_instance_id_t instance, void * context) {
+        (void)id; (void)instance;
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(datastore, DATASTORE_RESOURCE_ALL, DATASTORE_INSTANCE_ALL, atomic_count_callback, context));
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(datastore, DATASTORE_RESOURCE_ALL, DATASTORE_INSTANCE_ALL, atomic_count_callback, context));
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_remove_set_callback(datastore, DATASTORE_RESOURCE_ALL, DATASTORE_INSTANCE_ALL, atomic_count_callback, context));
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_remove_set_callback(datastore, DATASTORE_RESOURCE_ALL, DATASTORE_INSTANCE_ALL, atomic_count_callback, context));
+    }
+}
+
+TEST(DatastoreTest, test_static_datastore_limits) {
+    datastore_static_config_t config = { 4, 40, 5, 12, 40, 3 };
+    size_t size = datastore_static_size(&config);
+    std::vector<uint64_t> buffer(size / sizeof(uint64_t) + 1);
+    datastore_t * ds = datastore_create_static(buffer.data(), size, &config);
+    ASSERT_NE(nullptr, ds);
+    std::vector<uint32_t> values(40);
+    for (datastore_resource_id_t id = 0; id < 4; ++id) {
+        datastore_resource_t resource = { &values[id * 10], sizeof(uint32_t), DATASTORE_TYPE_UINT32, 10, 0, false };
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, id, resource));
+    }
+
+    // names of every length up to the limit, renamed in any order
+    for (int round = 0; round < 50; ++round) {
+        for (datastore_resource_id_t id = 0; id < 4; ++id) {
+            std::string name = std::to_string(id) + std::string((round * 7 + id) % 12, 'x');
+            EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_name(ds, id, name.c_str()));
+            EXPECT_STREQ(name.c_str(), datastore_get_name(ds, id));
+            datastore_resource_id_t found = -1;
+            EXPECT_EQ(DATASTORE_STATUS_OK, datastore_find_by_name(ds, name.c_str(), &found));
+            EXPECT_EQ(id, found);
+        }
+    }
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ARGUMENT, datastore_set_name(ds, 0, "0123456789abc"));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_name(ds, 0, "0123456789ab"));
+
+    // every instance waiting for a coalesced callback
+    std::atomic<int> coalesced(0);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback_ex(ds, DATASTORE_RESOURCE_ALL, DATASTORE_INSTANCE_ALL, detail::atomic_count_callback, &coalesced, DATASTORE_CALLBACK_FLAG_COALESCE));
+    for (int round = 1; round <= 3; ++round) {
+        for (datastore_resource_id_t id = 0; id < 4; ++id) {
+            for (datastore_instance_id_t instance = 0; instance < 10; ++instance) {
+                EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, id, instance, round));
+            }
+        }
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_dispatch_pending(ds));
+        EXPECT_EQ(round * 40, coalesced);
+    }
+
+    // callback lists replaced while a callback is running
+    std::atomic<int> calls(0);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, 1, 0, detail::churn_callback, &calls));
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, 1, 0, i));
+    }
+    datastore_free(&ds);
+
+    // without room for them, names and coalesced callbacks are rejected up front
+    datastore_static_config_t minimal = { 1, 1, 1 };
+    size = datastore_static_size(&minimal);
+    ds = datastore_create_static(buffer.data(), size, &minimal);
+    ASSERT_NE(nullptr, ds);
+    datastore_resource_t resource = { &values[0], sizeof(uint32_t), DATASTORE_TYPE_UINT32, 1, 0, false };
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, 0, resource));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ARGUMENT, datastore_set_name(ds, 0, "x"));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ARGUMENT, datastore_add_set_callback_ex(ds, 0, 0, detail::atomic_count_callback, &coalesced, DATASTORE_CALLBACK_FLAG_COALESCE));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, 0, 0, detail::atomic_count_callback, &calls));
+    datastore_free(&ds);
+}
+
+namespace schema {
+    struct Temperature : datastore::Resource<10, float, 4> {};
+    struct Count : datastore::Resource<11, uint8_t, 3> {};
+    struct Total : datastore::Resource<12, double> {};
+    struct Label : datastore::Resource<13, char[10], 2> {};
+    struct Hits : datastore::Resource<14, uint32_t, 2, DATASTORE_RESOURCE_FLAG_ATOMIC> {};
+    typedef datastore::Store<Temperature, Count, Total, Label, Hits> Store;
+
+    // laid out in order, each aligned for its type
+    static_assert(Store::offset_of<Temperature>() == 0, "");
+    static_assert(Store::offset_of<Count>() == 16, "");
+    static_assert(Store::offset_of<Total>() == 24, "");
+    static_assert(Store::offset_of<Label>() == 32, "");
+    static_assert(Store::offset_of<Hits>() == 52, "");
+    static_assert(Store::storage_size == 60, "");
+}
+
+TEST(DatastoreTest, test_schema) {
+    schema::Store store;
+    EXPECT_EQ(DATASTORE_STATUS_OK, store.status());
+    EXPECT_EQ(16 + 3 + 8 + 20 + 8, datastore_get_ram_usage(store.c_datastore()));
+
+    EXPECT_EQ(DATASTORE_STATUS_OK, store.set<schema::Temperature>(2, 21.5f));
+    EXPECT_EQ(21.5f, store.get<schema::Temperature>(2));
+    EXPECT_EQ(0.0f, store.get<schema::Temperature>(3));
+    EXPECT_EQ(DATASTORE_STATUS_OK, store.set<schema::Count>(1, 200));
+    EXPECT_EQ(200, store.get<schema::Count>(1));
+    EXPECT_EQ(DATASTORE_STATUS_OK, store.set<schema::Total>(0, -1.25));
+    EXPECT_EQ(-1.25, store.get<schema::Total>());
+    EXPECT_EQ(DATASTORE_STATUS_OK, store.set<schema::Label>(1, "label"));
+    char label[10] = "";
+    EXPECT_EQ(DATASTORE_STATUS_OK, store.get<schema::Label>(1, label));
+    EXPECT_STREQ("label", label);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_increment(store.c_datastore(), schema::Hits::id, 1));
+    EXPECT_EQ(1u, store.get<schema::Hits>(1));
+
+    // the C API sees the same resources
+    float value = 0.0f;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_float(store.c_datastore(), 10, 2, &value));
+    EXPECT_EQ(21.5f, value);
+
+    // writes go through the datastore, callbacks included
+    detail::CallbackRecord record;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(store.c_datastore(), schema::Count::id, 2, detail::callback, &record));
+    EXPECT_EQ(DATASTORE_STATUS_OK, store.set<schema::Count>(2, 7));
+    EXPECT_EQ(1, record.counter);
+    EXPECT_EQ(schema::Count::id, record.last.resource_id);
+    EXPECT_EQ(2, record.last.instance_id);
+
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_INSTANCE, store.set<schema::Count>(3, 1));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_INSTANCE, store.set<schema::Count>(-1, 1));
+    uint8_t count = 0;
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_INSTANCE, store.get<schema::Count>(3, count));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_TOO_LARGE, store.set<schema::Label>(0, "0123456789"));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, store.set<schema::Label>(0, NULL));
+    EXPECT_EQ(DATASTORE_STATUS_OK, store.set<schema::Label>(0, "012345678"));
+    EXPECT_EQ(DATASTORE_STATUS_OK, store.get<schema::Label>(0, label));
+    EXPECT_STREQ("012345678", label);
+}
+
+TEST(DatastoreTest, test_handle) {
+    datastore_t * ds = datastore_create();
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE0, datastore_create_resource(DATASTORE_TYPE_UINT32, 3)));
+    datastore_resource_t lock_free = datastore_create_resource(DATASTORE_TYPE_DOUBLE, 1);
+    lock_free.flags = DATASTORE_RESOURCE_FLAG_LOCK_FREE_READS;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE1, lock_free));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_resource(ds, RESOURCE2, datastore_create_string_resource(8, 2)));
+
+    datastore_handle_t handle;
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_resolve(NULL, RESOURCE0, 0, DATASTORE_TYPE_UINT32, &handle));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_NULL_POINTER, datastore_resolve(ds, RESOURCE0, 0, DATASTORE_TYPE_UINT32, NULL));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_ID, datastore_resolve(ds, RESOURCE3, 0, DATASTORE_TYPE_UINT32, &handle));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_TYPE, datastore_resolve(ds, RESOURCE0, 0, DATASTORE_TYPE_INT32, &handle));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_INSTANCE, datastore_resolve(ds, RESOURCE0, 3, DATASTORE_TYPE_UINT32, &handle));
+
+    // reads and writes are those of the typed functions, callbacks and ages included
+    detail::CallbackRecord record;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_add_set_callback(ds, RESOURCE0, 2, detail::callback, &record));
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_resolve(ds, RESOURCE0, 2, DATASTORE_TYPE_UINT32, &handle));
+    EXPECT_EQ(sizeof(uint32_t), handle.size);
+    uint32_t value = 42;
+    datastore_handle_set(&handle, &value);
+    EXPECT_EQ(1, record.counter);
+    EXPECT_EQ(RESOURCE0, record.last.resource_id);
+    EXPECT_EQ(2, record.last.instance_id);
+    datastore_age_t age = DATASTORE_INVALID_AGE;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_age(ds, RESOURCE0, 2, &age));
+    EXPECT_NE(DATASTORE_INVALID_AGE, age);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_uint32(ds, RESOURCE0, 2, 17));
+    datastore_handle_get(&handle, &value);
+    EXPECT_EQ(17, value);
+
+    // one handle serves every instance of its resource
+    value = 5;
+    datastore_handle_set_instance(&handle, 0, &value);
+    EXPECT_EQ(2, record.counter);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_uint32(ds, RESOURCE0, 0, &value));
+    EXPECT_EQ(5, value);
+    datastore_handle_set_instance(&handle, 2, &value);
+    EXPECT_EQ(3, record.counter);
+    datastore_handle_get_instance(&handle, 2, &value);
+    EXPECT_EQ(5, value);
+
+    datastore_handle_t lock_free_handle;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_resolve(ds, RESOURCE1, 0, DATASTORE_TYPE_DOUBLE, &lock_free_handle));
+    double real = 2.5;
+    datastore_handle_set(&lock_free_handle, &real);
+    real = 0.0;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_double(ds, RESOURCE1, 0, &real));
+    EXPECT_EQ(2.5, real);
+
+    datastore_handle_t string_handle;
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_resolve(ds, RESOURCE2, 1, DATASTORE_TYPE_STRING, &string_handle));
+    EXPECT_EQ(8u, string_handle.size);
+    char slot[8] = "abc";
+    datastore_handle_set(&string_handle, slot);
+    char copy[8] = "";
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_get_string(ds, RESOURCE2, 1, copy, sizeof(copy)));
+    EXPECT_STREQ("abc", copy);
+    EXPECT_EQ(DATASTORE_STATUS_OK, datastore_set_string(ds, RESOURCE2, 1, "defghij"));
+    datastore_handle_get(&string_handle, copy);
+    EXPECT_STREQ("defghij", copy);
+
+    datastore_free(&ds);
+}
+
+namespace schema {
+    struct Samples : datastore::Resource<20, uint8_t, 10000> {};
+    struct Peak : datastore::Resource<21, float> {};
+    typedef datastore::Store<Samples, Peak> LargeStore;
+
+    // one handle per resource, however many instances they have
+    static_assert(sizeof(LargeStore) < LargeStore::storage_size + 2 * sizeof(datastore_handle_t) + 64, "");
+}
+
+TEST(DatastoreTest, test_schema_large) {
+    schema::LargeStore store;
+    EXPECT_EQ(DATASTORE_STATUS_OK, store.status());
+    EXPECT_EQ(DATASTORE_STATUS_OK, store.set<schema::Samples>(9999, 42));
+    EXPECT_EQ(42, store.get<schema::Samples>(9999));
+    EXPECT_EQ(0, store.get<schema::Samples>(0));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_INSTANCE, store.set<schema::Samples>(10000, 1));
+
+    datastore::Handle<uint8_t> sample;
+    EXPECT_EQ(DATASTORE_STATUS_OK, store.resolve<schema::Samples>(5000, sample));
+    sample.set(7);
+    EXPECT_EQ(7, store.get<schema::Samples>(5000));
+}
+
+TEST(DatastoreTest, test_typed_handle) {
+    schema::Store store;
+    datastore::Handle<float> temperature;
+    EXPECT_FALSE(temperature.valid());
+    EXPECT_EQ(DATASTORE_STATUS_OK, store.resolve<schema::Temperature>(3, temperature));
+    EXPECT_TRUE(temperature.valid());
+    temperature.set(-4.0f);
+    EXPECT_EQ(-4.0f, store.get<schema::Temperature>(3));
+    EXPECT_EQ(DATASTORE_STATUS_OK, store.set<schema::Temperature>(3, 8.0f));
+    EXPECT_EQ(8.0f, temperature.get());
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_INSTANCE, store.resolve<schema::Temperature>(4, temperature));
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_INSTANCE, store.resolve<schema::Temperature>(-1, temperature));
+    EXPECT_EQ(8.0f, temperature.get());
+
+    datastore::Handle<char[10]> label;
+    EXPECT_EQ(DATASTORE_STATUS_OK, store.resolve<schema::Label>(0, label));
+    char text[10] = "handle";
+    label.set(text);
+    char copy[10] = "";
+    label.get(copy);
+    EXPECT_STREQ("handle", copy);
+
+    // strings must match the resource's length
+    datastore::Handle<char[12]> wrong_length;
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_TYPE, wrong_length.resolve(store.c_datastore(), schema::Label::id, 0));
+    EXPECT_FALSE(wrong_length.valid());
+    datastore::Handle<uint32_t> wrong_type;
+    EXPECT_EQ(DATASTORE_STATUS_ERROR_INVALID_TYPE, wrong_type.resolve(store.c_datastore(), schema::Label::id, 0));
+}
+